@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Size of the first block of an arena, enough for a typical input line
+#define ARENA_BLOCK_SIZE 4096
+// Largest block kept around by arena_reset(), bigger ones go back to malloc()
+#define ARENA_MAX_RETAINED (1024 * 1024)
+#define ARENA_ALIGN(size)                                                      \
+    (((size) + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+// Allocations are aligned as long as blocks are (malloc() returns memory
+// aligned for any type) and data starts on an aligned offset
+_Static_assert(offsetof(arena_block_t, data) % ARENA_ALIGNMENT == 0,
+               "arena_block_t::data must be aligned to ARENA_ALIGNMENT");
+
+void arena_init(arena_t *arena)
+{
+    arena->block = NULL;
+    arena->last = NULL;
+}
+
+void arena_destroy(arena_t *arena)
+{
+    arena_block_t *block = arena->block;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena_init(arena);
+}
+
+void arena_reset(arena_t *arena)
+{
+    // Keep the largest block, as long as it isn't excessively large
+    arena_block_t *keep = NULL;
+    arena_block_t *block = arena->block;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+
+        if (block->size <= ARENA_MAX_RETAINED &&
+            (keep == NULL || block->size > keep->size)) {
+            free(keep);
+            keep = block;
+        } else {
+            free(block);
+        }
+
+        block = next;
+    }
+
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->block = keep;
+    arena->last = NULL;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size = ARENA_ALIGN(size);
+
+    arena_block_t *block = arena->block;
+    if (block == NULL || block->size - block->used < size) {
+        // Each block is at least twice as big as the one before it, so the
+        // number of blocks stays logarithmic in the total size
+        size_t blockSize = (block != NULL) ? block->size * 2 : ARENA_BLOCK_SIZE;
+        if (blockSize < size) {
+            blockSize = size;
+        }
+
+        arena_block_t *newBlock =
+            (arena_block_t *)malloc(sizeof(arena_block_t) + blockSize);
+        if (newBlock == NULL) {
+            return NULL;
+        }
+        newBlock->next = block;
+        newBlock->size = blockSize;
+        newBlock->used = 0;
+
+        arena->block = block = newBlock;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    arena->last = ptr;
+
+    return ptr;
+}
+
+void *arena_realloc(arena_t *arena, void *ptr, size_t oldSize, size_t newSize)
+{
+    if (ptr != NULL && ptr == arena->last) {
+        // Most recent allocation, grow or shrink it in place if it fits
+        arena_block_t *block = arena->block;
+        size_t start = (char *)ptr - block->data;
+        if (start + ARENA_ALIGN(newSize) <= block->size) {
+            block->used = start + ARENA_ALIGN(newSize);
+            return ptr;
+        }
+    }
+
+    void *newPtr = arena_alloc(arena, newSize);
+    if (newPtr != NULL && ptr != NULL) {
+        memcpy(newPtr, ptr, (oldSize < newSize) ? oldSize : newSize);
+    }
+
+    return newPtr;
+}
+
+char *arena_strdup(arena_t *arena, const char *str)
+{
+    size_t len = strlen(str) + 1; // + 1 for NULL-terminator
+
+    char *copy = (char *)arena_alloc(arena, len);
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+    }
+
+    return copy;
+}
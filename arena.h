@@ -0,0 +1,78 @@
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Bump allocator for memory that is released all at once, e.g. everything
+/// built while parsing a single input line.
+///
+/// Allocations are carved out of large blocks and can't be freed one by one,
+/// arena_reset() releases all of them in one go.
+////////////////////////////////////////////////////////////////////////////////
+
+// Alignment of every allocation, enough for any type (including SSE vectors
+// and long double)
+#define ARENA_ALIGNMENT 16
+
+// Block of memory allocations are carved out of
+typedef struct arena_block_t {
+    struct arena_block_t *next; // previously filled block
+    size_t size;                // number of bytes in data
+    size_t used;                // number of bytes of data handed out
+    _Alignas(ARENA_ALIGNMENT) char data[]; // after padding the header
+} arena_block_t;
+
+typedef struct arena_t {
+    arena_block_t *block; // block allocations are currently made from
+    void *last;           // most recent allocation, can be grown in place
+} arena_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Initialize an empty arena, no memory is allocated until first allocation.
+///
+/// @param   arena   arena_t *, arena to initialize.
+////////////////////////////////////////////////////////////////////////////////
+void arena_init(arena_t *arena);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release all memory held by the arena.
+///
+/// @param   arena   arena_t *, arena to destroy.
+////////////////////////////////////////////////////////////////////////////////
+void arena_destroy(arena_t *arena);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release all allocations made from the arena. A block is kept around so that
+/// the next user of the arena doesn't have to go back to malloc().
+///
+/// @param   arena   arena_t *, arena to reset.
+////////////////////////////////////////////////////////////////////////////////
+void arena_reset(arena_t *arena);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Allocate memory from the arena, suitably aligned for any type.
+///
+/// @param   arena   arena_t *, arena to allocate from.
+/// @param   size    size_t, number of bytes to allocate.
+/// @return          void *, allocated memory, NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+void *arena_alloc(arena_t *arena, size_t size);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Grow or shrink an allocation. The most recent allocation is resized in
+/// place when possible, others are copied to a new allocation.
+///
+/// @param   arena     arena_t *, arena ptr was allocated from.
+/// @param   ptr       void *, allocation to resize, may be NULL.
+/// @param   oldSize   size_t, current size of the allocation.
+/// @param   newSize   size_t, requested size of the allocation.
+/// @return            void *, resized allocation, NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+void *arena_realloc(arena_t *arena, void *ptr, size_t oldSize, size_t newSize);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Copy a string into the arena.
+///
+/// @param   arena   arena_t *, arena to allocate from.
+/// @param   str     const char *, NULL-terminated string to copy.
+/// @return          char *, copy of str, NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+char *arena_strdup(arena_t *arena, const char *str);
@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "argbatch.h"
+#include "command.h"
+#include "variable.h"
+
+// Room left in ARG_MAX for what exec() adds (the path, auxiliary vector), the
+// same margin POSIX asks xargs to leave
+#define ARGBATCH_HEADROOM 2048
+
+// Exit status when a batch could not be started, like a command not found
+#define ARGBATCH_NOT_STARTED 127
+
+static argbatch_t argbatch_settings = {0, 1, 0};
+
+argbatch_t *argbatch_global()
+{
+    return &argbatch_settings;
+}
+
+// Parse a size such as '65536', '256k' or '1M', returns -1 if invalid
+static long argbatch_parseSize(const char *text)
+{
+    char *end;
+    errno = 0;
+    long size = strtol(text, &end, 10);
+    if (errno != 0 || end == text || size < 0) {
+        return -1;
+    }
+
+    if (*end == 'k' || *end == 'K') {
+        size *= 1024;
+        ++end;
+    } else if (*end == 'm' || *end == 'M') {
+        size *= 1024 * 1024;
+        ++end;
+    }
+
+    return (*end == '\0' && size <= 1L << 30) ? size : -1;
+}
+
+int argbatch_parse(int argc, char **argv, argbatch_t *conf)
+{
+    argbatch_t parsed = *conf;
+
+    int i = 1;
+    for (; i < argc; ++i) {
+        if (strcmp(argv[i], "on") == 0) {
+            parsed.enabled = 1;
+        } else if (strcmp(argv[i], "off") == 0) {
+            parsed.enabled = 0;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            char *end;
+            long parallel = strtol(argv[++i], &end, 10);
+            if (*argv[i] == '\0' || *end != '\0' || parallel < 1 ||
+                parallel > 1024) {
+                fprintf(stderr, "batch: invalid parallelism '%s'\n", argv[i]);
+                return -1;
+            }
+            parsed.parallel = parallel;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            parsed.size = argbatch_parseSize(argv[++i]);
+            if (parsed.size == -1) {
+                fprintf(stderr, "batch: invalid size '%s'\n", argv[i]);
+                return -1;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (i != argc) {
+        fprintf(stderr, "usage: batch [on|off] [-j parallel] [-s size]\n");
+        return -1;
+    }
+    *conf = parsed;
+
+    return 0;
+}
+
+// Bytes an argument takes from ARG_MAX, its string and its pointer
+static size_t argbatch_argSize(const char *arg)
+{
+    return strlen(arg) + 1 + sizeof(char *);
+}
+
+// Bytes of arguments a batch may have
+static long argbatch_limit(const argbatch_t *conf)
+{
+    if (conf->size > 0) {
+        return conf->size;
+    }
+
+    long limit = sysconf(_SC_ARG_MAX);
+    if (limit <= 0) {
+        limit = _POSIX_ARG_MAX;
+    }
+    // The environment is passed along with the arguments
+    char **envp = variable_envp();
+    for (char **it = envp; it != NULL && *it != NULL; ++it) {
+        limit -= argbatch_argSize(*it);
+    }
+    limit -= ARGBATCH_HEADROOM;
+
+    // Leave a batch room for at least a few arguments
+    return limit > _POSIX_ARG_MAX ? limit : _POSIX_ARG_MAX;
+}
+
+void argbatch_print(FILE *stream, const argbatch_t *conf)
+{
+    fprintf(stream, "batch %s\n", conf->enabled ? "on" : "off");
+    fprintf(stream, "parallel %d\n", conf->parallel);
+    fprintf(stream, "size %ld\n", argbatch_limit(conf));
+}
+
+int argbatch_needed(const argbatch_t *conf, const command_t *command)
+{
+    if (!conf->enabled || command->numExpanded == 0) {
+        return 0;
+    }
+
+    long limit = argbatch_limit(conf);
+    long size = 0;
+    for (char **it = command->argv; *it != NULL; ++it) {
+        size += argbatch_argSize(*it);
+        if (size > limit) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Wait for a batch, returns its exit status, -1 if it was killed by a signal
+// (with its exit status in 'status')
+static int argbatch_wait(int *status)
+{
+    int wstatus;
+    while (waitpid(-1, &wstatus, 0) == -1) {
+        if (errno != EINTR) {
+            *status = ARGBATCH_NOT_STARTED;
+            return -1;
+        }
+    }
+
+    if (WIFSIGNALED(wstatus)) {
+        *status = 128 + WTERMSIG(wstatus);
+        return -1;
+    }
+    *status = WEXITSTATUS(wstatus);
+
+    return 0;
+}
+
+int argbatch_run(const argbatch_t *conf,
+                 const char *path,
+                 const command_t *command)
+{
+    char **argv = command->argv;
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        ++argc;
+    }
+
+    // Arguments [start, end) are split into batches, the others are passed
+    // to every batch
+    int end = argc - command->numTrailing;
+    int start = end - command->numExpanded;
+    if (start < 1) {
+        start = 1;
+    }
+    long fixedSize = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (i < start || i >= end) {
+            fixedSize += argbatch_argSize(argv[i]);
+        }
+    }
+    long limit = argbatch_limit(conf);
+
+    // Reused for every batch, exec() has copied it once posix_spawn()
+    // returns
+    char **batch = (char **)malloc(sizeof(char *) * (argc + 1));
+    if (batch == NULL) {
+        fprintf(stderr, "sane: out of memory\n");
+        return ARGBATCH_NOT_STARTED;
+    }
+    memcpy(batch, argv, sizeof(char *) * start);
+
+    char **envp = variable_envp();
+    if (envp == NULL) {
+        fprintf(stderr, "sane: out of memory\n");
+        free(batch);
+        return ARGBATCH_NOT_STARTED;
+    }
+    int result = 0;
+    int numRunning = 0;
+    int stop = 0;
+    int next = start;
+    while (next < end && !stop) {
+        // At least one argument, a batch that still doesn't fit fails with
+        // E2BIG like the whole command would have
+        long size = fixedSize;
+        int numArgs = start;
+        do {
+            size += argbatch_argSize(argv[next]);
+            batch[numArgs++] = argv[next++];
+        } while (next < end && size + argbatch_argSize(argv[next]) <= limit);
+        memcpy(batch + numArgs, argv + end,
+               sizeof(char *) * (argc - end + 1));
+
+        pid_t pid;
+        int err = posix_spawn(&pid, path, NULL, NULL, batch, envp);
+        if (err != 0) {
+            fprintf(stderr, "sane exec: %s\n", strerror(err));
+            result = ARGBATCH_NOT_STARTED;
+            break;
+        }
+        ++numRunning;
+
+        if (numRunning == conf->parallel) {
+            int status;
+            // Like xargs, a batch killed by a signal stops the command
+            stop = argbatch_wait(&status) != 0;
+            result = status > result ? status : result;
+            --numRunning;
+        }
+    }
+
+    for (; numRunning > 0; --numRunning) {
+        int status;
+        argbatch_wait(&status);
+        result = status > result ? status : result;
+    }
+    free(batch);
+
+    return result;
+}
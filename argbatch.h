@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Batching of commands whose arguments don't fit in ARG_MAX (see the 'batch'
+/// builtin):
+///
+///     batch [on|off] [-j parallel] [-s size]
+///
+/// When batching is on, an external command whose wildcards expanded to more
+/// arguments than exec() accepts is run once per batch of them instead of
+/// failing with E2BIG, like 'find | xargs' would run it:
+///
+///     batch on ; rm *.log
+///
+/// runs 'rm' with as many of the paths as fit each time. The arguments before
+/// the first expanded wildcard and after the last one are passed to every
+/// batch, so 'cp *.jpg photos/' works too. Commands that must see all their
+/// arguments at once (e.g. 'tar cf out.tar *') must not be batched.
+///
+///  - parallel: number of batches running at the same time, 1 by default.
+///  - size: bytes of arguments per batch, with an optional k or M suffix, 0 for
+///    ARG_MAX less the size of the environment.
+///
+/// The batches of a command run in a subshell, which is the command as far as
+/// pipelines, jobs and 'wait' are concerned. Its exit status is the highest
+/// exit status of the batches.
+////////////////////////////////////////////////////////////////////////////////
+
+// Forward declaration
+struct command_t;
+
+typedef struct argbatch_t {
+    int enabled;  // 1 if commands too long to exec are batched
+    int parallel; // number of batches running at the same time
+    long size;    // bytes of arguments per batch, 0 to fit ARG_MAX
+} argbatch_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   argbatch_t *, settings used by the shell.
+////////////////////////////////////////////////////////////////////////////////
+argbatch_t *argbatch_global();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse the arguments of 'batch' into conf. Errors are printed to stderr.
+///
+/// @param   argc   int, number of arguments, including 'batch'.
+/// @param   argv   char **, arguments.
+/// @param   conf   argbatch_t *, settings to change.
+/// @return         int, 0 if successful, -1 if the arguments are invalid.
+////////////////////////////////////////////////////////////////////////////////
+int argbatch_parse(int argc, char **argv, argbatch_t *conf);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the settings and the size of a batch, one 'name value' pair per line.
+///
+/// @param   stream   FILE *, stream to print to.
+/// @param   conf     const argbatch_t *, settings to print.
+////////////////////////////////////////////////////////////////////////////////
+void argbatch_print(FILE *stream, const argbatch_t *conf);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   conf      const argbatch_t *, settings to use.
+/// @param   command   const struct command_t *, command about to be executed.
+/// @return            int, 1 if batching is on and the command's arguments
+///                    don't fit in a batch, 0 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int argbatch_needed(const argbatch_t *conf, const struct command_t *command);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run the command once per batch of its expanded arguments and wait for the
+/// batches, meant to run in a child of the shell (stdin and stdout are the
+/// command's).
+///
+/// @param   conf      const argbatch_t *, settings to use.
+/// @param   path      const char *, path to execute, from sane_hashLookup().
+/// @param   command   const struct command_t *, command to run.
+/// @return            int, highest exit status of the batches, 127 if a
+///                    batch could not be started.
+////////////////////////////////////////////////////////////////////////////////
+int argbatch_run(const argbatch_t *conf,
+                 const char *path,
+                 const struct command_t *command);
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Helpers shared by the benchmarks in bench/.
+///
+/// Every benchmark prints one line per measurement in the form:
+///
+///     <benchmark name> <value> <unit>
+///
+/// so that the output of two runs can be compared with diff or a spreadsheet.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   double, seconds elapsed on the monotonic clock.
+////////////////////////////////////////////////////////////////////////////////
+static inline double bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print a single measurement.
+///
+/// @param   name    const char *, name of the measurement.
+/// @param   value   double, measured value.
+/// @param   unit    const char *, unit of the measured value.
+////////////////////////////////////////////////////////////////////////////////
+static inline void bench_report(const char *name, double value, const char *unit)
+{
+    printf("%-48s %14.3f %s\n", name, value, unit);
+    fflush(stdout);
+}
+
+static inline int bench_compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Median of measurements, less sensitive to a noisy run than the mean.
+///
+/// @param   samples      double *, measurements, sorted in place.
+/// @param   numSamples   int, number of measurements, at least 1.
+/// @return               double, median of the measurements.
+////////////////////////////////////////////////////////////////////////////////
+static inline double bench_median(double *samples, int numSamples)
+{
+    qsort(samples, numSamples, sizeof(double), &bench_compareDoubles);
+
+    return samples[numSamples / 2];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run a script with the shell and wait for it, for end to end benchmarks.
+///
+/// @param   shell   const char *, path of the shell, e.g. "./bin/sane".
+/// @param   path    const char *, path of the script.
+/// @return          double, elapsed time in seconds, -1 if the shell could not
+///                  be run or didn't exit normally.
+////////////////////////////////////////////////////////////////////////////////
+static inline double bench_runScript(const char *shell, const char *path)
+{
+    extern char **environ;
+    char *argv[] = {(char *)shell, (char *)path, NULL};
+
+    double start = bench_now();
+    pid_t pid;
+    if (posix_spawn(&pid, shell, NULL, NULL, argv, environ) != 0) {
+        return -1;
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)) {
+        return -1;
+    }
+
+    return bench_now() - start;
+}
@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Background job fan-out: a script starting 'jobs' commands in the background
+/// ('true &') and waiting for all of them, with the builtin (run in a
+/// subshell) and the external command.
+///
+/// usage: bench_jobs [jobs] [shell]
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// Write a script starting 'jobs' background commands to 'path', returns 0 if
+// successful, -1 otherwise
+static int writeScript(const char *path, int jobs, const char *command)
+{
+    FILE *script = fopen(path, "w");
+    if (script == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < jobs; ++i) {
+        fprintf(script, "%s &\n", command);
+    }
+    fprintf(script, "wait\n");
+
+    return fclose(script);
+}
+
+int main(int argc, char **argv)
+{
+    int jobs = argc > 1 ? atoi(argv[1]) : 1000;
+    const char *shell = argc > 2 ? argv[2] : "./bin/sane";
+
+    char path[] = "/tmp/bench_jobsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("bench_jobs");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    const char *kinds[] = {"builtin", "external"};
+    const char *commands[] = {"true", "/bin/true"};
+    for (int k = 0; k < 2; ++k) {
+        if (writeScript(path, jobs, commands[k]) != 0) {
+            perror("bench_jobs");
+            break;
+        }
+
+        double elapsed = bench_runScript(shell, path);
+        if (elapsed < 0) {
+            fprintf(stderr, "bench_jobs: %s failed\n", shell);
+            break;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "jobs/%s/fanout_%d", kinds[k], jobs);
+        bench_report(name, jobs / elapsed, "jobs/s");
+    }
+
+    unlink(path);
+
+    return EXIT_SUCCESS;
+}
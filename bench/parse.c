@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Cost of turning a line into commands: tokenise(), separateCommands() (which
+/// expands wildcards) and freeCommands(), on a typical line and on adversarial
+/// ones (a long quoted string, 100k tokens, 10k commands, many wildcards).
+///
+/// usage: bench_parse [iterations]
+///
+/// Each measurement is the median over the iterations, in microseconds per
+/// line. The wildcards are matched against a temporary directory of 2000
+/// files.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../arena.h"
+#include "../command.h"
+#include "../token.h"
+#include "bench.h"
+
+#define NUM_FILES 2000
+
+// Append 'count' copies of 'text' to 'line', returns the end of the line
+static char *repeat(char *line, const char *text, int count)
+{
+    size_t len = strlen(text);
+    for (int i = 0; i < count; ++i) {
+        memcpy(line, text, len);
+        line += len;
+    }
+    *line = '\0';
+
+    return line;
+}
+
+// Create a directory of NUM_FILES empty files, half .c and half .h, returns
+// 0 if successful
+static int makeFiles(char *dir)
+{
+    if (mkdtemp(dir) == NULL) {
+        return -1;
+    }
+
+    char path[256];
+    for (int i = 0; i < NUM_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/file_%04d.%c", dir, i,
+                 (i % 2) ? 'h' : 'c');
+        FILE *file = fopen(path, "w");
+        if (file == NULL) {
+            return -1;
+        }
+        fclose(file);
+    }
+
+    return 0;
+}
+
+static void removeFiles(const char *dir)
+{
+    char path[256];
+    for (int i = 0; i < NUM_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/file_%04d.%c", dir, i,
+                 (i % 2) ? 'h' : 'c');
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 21;
+
+    char dir[] = "/tmp/bench_parseXXXXXX";
+    if (makeFiles(dir) != 0) {
+        perror("bench_parse");
+        return EXIT_FAILURE;
+    }
+
+    // 64KB quoted string with escaped quotes
+    char *quoted = malloc(64 * 1024 + 64);
+    char *end = repeat(quoted, "echo \"", 1);
+    end = repeat(end, "lorem ipsum \\\"dolor\\\" sit amet ", 64 * 1024 / 32);
+    repeat(end, "\"", 1);
+
+    // One command with 100k arguments
+    char *tokens = malloc(100000 * 2 + 16);
+    repeat(repeat(tokens, "echo", 1), " a", 100000);
+
+    // 10k commands
+    char *commands = malloc(10000 * 7 + 16);
+    repeat(commands, "true ; ", 10000);
+
+    // Patterns matching all, half and a few of the files
+    char globs[4096] = "ls";
+    const char *patterns[] = {"*", "*.c", "file_1*.h", "file_?99?.c",
+                              "file_[0-4]*"};
+    for (int i = 0; i < 40; ++i) {
+        char pattern[256];
+        snprintf(pattern, sizeof(pattern), " %s/%s", dir, patterns[i % 5]);
+        strcat(globs, pattern);
+    }
+
+    const char *names[] = {"typical", "quoted_64KB", "tokens_100k",
+                           "commands_10k", "globs_40x2000"};
+    const char *lines[] = {
+        "ls -l --color=auto foo/bar.c | grep -v x > out.txt ; echo done &",
+        quoted, tokens, commands, globs};
+
+    char *work = NULL;
+    char **token = NULL;
+    int tokenCapacity = 0;
+    command_t *command = NULL;
+    int commandCapacity = 0;
+    arena_t arena;
+    arena_init(&arena);
+
+    double *samples = malloc(sizeof(double) * 3 * iterations);
+    if (quoted == NULL || tokens == NULL || commands == NULL ||
+        samples == NULL) {
+        fprintf(stderr, "bench_parse: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *phases[] = {"tokenise", "separateCommands", "freeCommands"};
+    for (int l = 0; l < sizeof(lines) / sizeof(lines[0]); ++l) {
+        size_t len = strlen(lines[l]);
+        free(work);
+        work = malloc(len + 64);
+        if (work == NULL) {
+            fprintf(stderr, "bench_parse: out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 0; i < iterations; ++i) {
+            memcpy(work, lines[l], len + 1);
+
+            double start = bench_now();
+            int numTokens = tokenise(work, &token, &tokenCapacity);
+            double tokenised = bench_now();
+            int numCommands = separateCommands(token, numTokens, &command,
+                                               &commandCapacity, &arena);
+            double separated = bench_now();
+            if (numCommands <= 0) {
+                fprintf(stderr, "bench_parse: %s: parsing failed\n",
+                        names[l]);
+                return EXIT_FAILURE;
+            }
+            freeCommands(command, numCommands, &arena);
+            double freed = bench_now();
+
+            samples[i] = (tokenised - start) * 1e6;
+            samples[iterations + i] = (separated - tokenised) * 1e6;
+            samples[2 * iterations + i] = (freed - separated) * 1e6;
+        }
+
+        for (int p = 0; p < 3; ++p) {
+            char name[64];
+            snprintf(name, sizeof(name), "parse/%s/%s", names[l], phases[p]);
+            bench_report(name, bench_median(samples + p * iterations,
+                                            iterations),
+                         "us");
+        }
+    }
+
+    arena_destroy(&arena);
+    free(command);
+    free(token);
+    free(work);
+    free(samples);
+    free(commands);
+    free(tokens);
+    free(quoted);
+    removeFiles(dir);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Pipelines of 'cat' stages, run by the builtin (in subshells) and by the
+/// external command:
+///
+///  - the run time of long pipelines ('echo x | cat | ... | cat') of 10, 100
+///    and 1000 stages, the time per stage stays flat if starting a stage
+///    doesn't depend on the length of the pipeline,
+///  - the throughput of 'cat data | cat | ... | cat' through 1 to 8 stages.
+///
+/// usage: bench_pipeline [repeats] [data MB] [shell]
+///
+/// Each pipeline is run 'repeats' times by one script.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// Write a script running 'first | cat | ... | cat > /dev/null' (of 'stages'
+// commands) 'repeats' times to 'path'. Returns 0 if successful, -1 otherwise.
+static int writeScript(const char *path,
+                       int repeats,
+                       int stages,
+                       const char *first,
+                       const char *cat)
+{
+    FILE *script = fopen(path, "w");
+    if (script == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < repeats; ++i) {
+        fprintf(script, "%s", first);
+        for (int k = 1; k < stages; ++k) {
+            fprintf(script, " | %s", cat);
+        }
+        fprintf(script, " > /dev/null\n");
+    }
+
+    return fclose(script);
+}
+
+// Write 'size' bytes of text lines to 'path', returns 0 if successful
+static int writeData(const char *path, size_t size)
+{
+    FILE *data = fopen(path, "w");
+    if (data == NULL) {
+        return -1;
+    }
+
+    const char *line = "2024-01-01T00:00:00Z GET /index.html 200 1234 0.001\n";
+    size_t lineLen = strlen(line);
+    for (size_t written = 0; written + lineLen <= size; written += lineLen) {
+        fputs(line, data);
+    }
+
+    return fclose(data);
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = argc > 1 ? atoi(argv[1]) : 20;
+    int dataMB = argc > 2 ? atoi(argv[2]) : 64;
+    const char *shell = argc > 3 ? argv[3] : "./bin/sane";
+
+    char path[] = "/tmp/bench_pipelineXXXXXX";
+    char dataPath[] = "/tmp/bench_pipeline_dataXXXXXX";
+    int fd = mkstemp(path);
+    int dataFd = mkstemp(dataPath);
+    if (fd == -1 || dataFd == -1) {
+        perror("bench_pipeline");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    close(dataFd);
+
+    size_t dataSize = (size_t)dataMB * 1024 * 1024;
+    if (writeData(dataPath, dataSize) != 0) {
+        perror("bench_pipeline");
+        unlink(path);
+        unlink(dataPath);
+        return EXIT_FAILURE;
+    }
+
+    const char *kinds[] = {"builtin", "external"};
+    const char *cats[] = {"cat", "/bin/cat"};
+    for (int k = 0; k < 2; ++k) {
+        for (int stages = 10; stages <= 1000; stages *= 10) {
+            if (writeScript(path, repeats, stages, "echo x", cats[k]) != 0) {
+                perror("bench_pipeline");
+                break;
+            }
+
+            double elapsed = bench_runScript(shell, path);
+            if (elapsed < 0) {
+                fprintf(stderr, "bench_pipeline: %s failed\n", shell);
+                break;
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "pipeline/%s/%d_stages", kinds[k],
+                     stages);
+            bench_report(name, elapsed / repeats * 1e3, "ms");
+            snprintf(name, sizeof(name), "pipeline/%s/%d_stages/per_stage",
+                     kinds[k], stages);
+            bench_report(name, elapsed / repeats / stages * 1e6, "us");
+        }
+    }
+
+    // Fewer runs of the throughput pipelines, they move the whole file
+    int dataRepeats = (repeats + 4) / 5;
+    for (int k = 0; k < 2; ++k) {
+        char first[128];
+        snprintf(first, sizeof(first), "%s %s", cats[k], dataPath);
+        for (int stages = 1; stages <= 8; stages *= 2) {
+            if (writeScript(path, dataRepeats, stages, first, cats[k]) != 0) {
+                perror("bench_pipeline");
+                break;
+            }
+
+            double elapsed = bench_runScript(shell, path);
+            if (elapsed < 0) {
+                fprintf(stderr, "bench_pipeline: %s failed\n", shell);
+                break;
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "pipeline/%s/throughput_%d_stages",
+                     kinds[k], stages);
+            bench_report(name, (double)dataMB * dataRepeats / elapsed,
+                         "MB/s");
+        }
+    }
+
+    unlink(dataPath);
+    unlink(path);
+
+    return EXIT_SUCCESS;
+}
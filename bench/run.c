@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Cost of running a command from a C program: system() and popen(), which
+/// start /bin/sh to parse the line, against sane_run() and sane_runCapture()
+/// from libsane, which parse it in the calling process.
+///
+/// usage: bench_run [iterations]
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../run.h"
+#include "../sane.h"
+#include "bench.h"
+
+// Line run by every iteration, with a pipe so /bin/sh can't exec it directly
+#define BENCH_LINE "/bin/echo hello | /bin/cat"
+
+// Read all the output of a popen() stream, returns its length
+static size_t readAll(FILE *stream, char *output, size_t size)
+{
+    size_t length = 0;
+    size_t numRead;
+    while ((numRead = fread(output, 1, size, stream)) > 0) {
+        length += numRead;
+    }
+
+    return length;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    char output[256];
+
+    double start = bench_now();
+    for (int i = 0; i < iterations; ++i) {
+        if (system(BENCH_LINE " > /dev/null") != 0) {
+            fprintf(stderr, "bench_run: system() failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    double systemTime = bench_now() - start;
+
+    start = bench_now();
+    for (int i = 0; i < iterations; ++i) {
+        FILE *stream = popen(BENCH_LINE, "r");
+        if (stream == NULL || readAll(stream, output, sizeof(output)) != 6 ||
+            pclose(stream) != 0) {
+            fprintf(stderr, "bench_run: popen() failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    double popenTime = bench_now() - start;
+
+    if (sane_init() != 0) {
+        fprintf(stderr, "bench_run: initialization of shell failed\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = 0;
+    start = bench_now();
+    for (int i = 0; i < iterations; ++i) {
+        if (sane_run(BENCH_LINE " > /dev/null", &status) != 0 ||
+            status != 0) {
+            fprintf(stderr, "bench_run: sane_run() failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    double runTime = bench_now() - start;
+
+    start = bench_now();
+    for (int i = 0; i < iterations; ++i) {
+        size_t outputLen;
+        if (sane_runCapture(BENCH_LINE, &status, output, sizeof(output),
+                            &outputLen) != 0 ||
+            status != 0 || strcmp(output, "hello\n") != 0) {
+            fprintf(stderr, "bench_run: sane_runCapture() failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    double captureTime = bench_now() - start;
+
+    sane_shutdown();
+
+    bench_report("run/system", systemTime / iterations * 1e6, "us");
+    bench_report("run/sane_run", runTime / iterations * 1e6, "us");
+    bench_report("run/popen", popenTime / iterations * 1e6, "us");
+    bench_report("run/sane_runCapture", captureTime / iterations * 1e6, "us");
+
+    return EXIT_SUCCESS;
+}
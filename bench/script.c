@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Run time of a script made of the commands scripts use the most (echo,
+/// printf, test and true), once run by the shell's builtins and once by the
+/// external commands, which is what every line cost before they were builtins.
+///
+/// usage: bench_script [lines] [shell]
+///
+/// The external commands are named by their full path, so the shell doesn't
+/// use its builtins for them.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// Write a script of 'lines' lines to 'path', the commands are prefixed with
+// 'prefix' (e.g. "/usr/bin/"). Returns 0 if successful, -1 otherwise.
+static int writeScript(const char *path, int lines, const char *prefix)
+{
+    FILE *script = fopen(path, "w");
+    if (script == NULL) {
+        return -1;
+    }
+
+    // echo and printf lines are all different, like lines printing a
+    // variable would be, so they aren't all served by the parse cache
+    for (int i = 0; i < lines; ++i) {
+        switch (i % 4) {
+        case 0:
+            fprintf(script, "%secho line %d > /dev/null\n", prefix, i);
+            break;
+        case 1:
+            fprintf(script, "%sprintf '%%s %%d\\\\n' line %d > /dev/null\n",
+                    prefix, i);
+            break;
+        case 2:
+            fprintf(script, "%s[ -f Makefile ]\n", prefix);
+            break;
+        default:
+            fprintf(script, "%strue\n", prefix);
+            break;
+        }
+    }
+
+    return fclose(script);
+}
+
+int main(int argc, char **argv)
+{
+    int lines = argc > 1 ? atoi(argv[1]) : 100000;
+    const char *shell = argc > 2 ? argv[2] : "./bin/sane";
+
+    char path[] = "/tmp/bench_scriptXXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("bench_script");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    const char *kinds[] = {"builtin", "external"};
+    const char *prefixes[] = {"", "/usr/bin/"};
+    for (int k = 0; k < 2; ++k) {
+        if (writeScript(path, lines, prefixes[k]) != 0) {
+            perror("bench_script");
+            break;
+        }
+
+        double elapsed = bench_runScript(shell, path);
+        if (elapsed < 0) {
+            fprintf(stderr, "bench_script: %s failed\n", shell);
+            break;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "script/%s/%d_lines", kinds[k], lines);
+        bench_report(name, elapsed, "s");
+        snprintf(name, sizeof(name), "script/%s/per_line", kinds[k]);
+        bench_report(name, elapsed / lines * 1e6, "us");
+    }
+
+    unlink(path);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Spawn rate and latency of an external command ('/bin/true', run to the end)
+/// for each of the shell's spawn backends.
+///
+/// usage: bench_spawn [iterations] [ballast MB]
+///
+/// The ballast is touched heap memory that makes the shell's address space
+/// larger, which is what makes fork() slow for long running shells.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../run.h"
+#include "../sane.h"
+#include "bench.h"
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    int ballastMB = argc > 2 ? atoi(argv[2]) : 256;
+
+    if (sane_init() != 0) {
+        fprintf(stderr, "bench_spawn: initialization of shell failed\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *backends[] = {"fork", "posix"};
+    for (int withBallast = 0; withBallast < 2; ++withBallast) {
+        char *ballast = NULL;
+        if (withBallast) {
+            size_t size = (size_t)ballastMB * 1024 * 1024;
+            ballast = malloc(size);
+            if (ballast == NULL) {
+                break;
+            }
+            memset(ballast, 1, size);
+        }
+
+        for (int b = 0; b < 2; ++b) {
+            char line[64];
+            snprintf(line, sizeof(line), "spawn %s", backends[b]);
+            int status;
+            sane_run(line, &status);
+
+            double start = bench_now();
+            for (int i = 0; i < iterations; ++i) {
+                sane_run("/bin/true", &status);
+            }
+            double elapsed = bench_now() - start;
+
+            char name[64];
+            snprintf(name, sizeof(name), "spawn/%s/ballast_%dMB", backends[b],
+                     withBallast ? ballastMB : 0);
+            bench_report(name, iterations / elapsed, "spawns/s");
+            strcat(name, "/latency");
+            bench_report(name, elapsed / iterations * 1e6, "us");
+        }
+
+        free(ballast);
+    }
+
+    sane_shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Throughput of tokenise() on synthetic command lines, for every scanning
+/// implementation supported by the machine.
+///
+/// usage: bench_tokenise [line size MB] [iterations]
+///
+/// Every implementation's tokens are compared against the scalar
+/// implementation's before it is timed.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../token.h"
+#include "bench.h"
+
+// Fill 'line' with copies of 'pattern' up to 'size' bytes
+static void fillLine(char *line, size_t size, const char *pattern)
+{
+    size_t patternLen = strlen(pattern);
+    size_t len = 0;
+    while (len + patternLen <= size) {
+        memcpy(line + len, pattern, patternLen);
+        len += patternLen;
+    }
+    line[len] = '\0';
+}
+
+// Run tokenise() on a copy of line, returns the number of tokens
+static int tokeniseCopy(const char *line,
+                        size_t len,
+                        char *work,
+                        char ***token,
+                        int *capacity)
+{
+    memcpy(work, line, len + 1);
+    return tokenise(work, token, capacity);
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (size_t)(argc > 1 ? atoi(argv[1]) : 4) * 1024 * 1024;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+    // Long quoted strings
+    char quoted[1024] = "echo \"";
+    for (int i = 0; i < 60; ++i) {
+        strcat(quoted, (i % 20 == 19) ? "so \\\"quoted\\\" " : "lorem ipsum ");
+    }
+    strcat(quoted, "\" ; ");
+
+    // Long unquoted tokens
+    char paths[1024] = "";
+    for (int i = 0; i < 4; ++i) {
+        strcat(paths, "/usr/local/share/some/deeply/nested/directory/"
+                      "structure/with/a/long/file_name_number_0123456789.txt ");
+    }
+
+    const char *names[] = {"words", "quoted", "paths", "blanks"};
+    const char *patterns[] = {
+        "ls -l --color=auto foo/bar.c baz_qux.h | grep -v x ; ", quoted, paths,
+        "a      \t      b \t\t\t\t    c                                   "};
+    const char *implNames[] = {"scalar", "sse2", "avx2"};
+
+    char *line = malloc(size + 1);
+    char *work = malloc(size + 64);
+    char *expected = malloc(size + 64);
+    char **token = NULL;
+    int capacity = 0;
+    if (line == NULL || work == NULL || expected == NULL) {
+        fprintf(stderr, "bench_tokenise: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int p = 0; p < sizeof(patterns) / sizeof(patterns[0]); ++p) {
+        fillLine(line, size, patterns[p]);
+        size_t len = strlen(line);
+
+        tokeniseSetImplementation(TOKENISE_SCALAR);
+        int expectedTokens = tokeniseCopy(line, len, work, &token, &capacity);
+        memcpy(expected, work, len + 1);
+
+        for (int impl = TOKENISE_SCALAR; impl <= TOKENISE_AVX2; ++impl) {
+            if (tokeniseSetImplementation(impl) != 0) {
+                continue;
+            }
+
+            int numTokens = tokeniseCopy(line, len, work, &token, &capacity);
+            if (numTokens != expectedTokens ||
+                memcmp(work, expected, len + 1) != 0) {
+                fprintf(stderr, "bench_tokenise: %s tokens differ for %s\n",
+                        implNames[impl], names[p]);
+                return EXIT_FAILURE;
+            }
+
+            double elapsed = 0.0;
+            for (int i = 0; i < iterations; ++i) {
+                memcpy(work, line, len + 1);
+                double start = bench_now();
+                tokenise(work, &token, &capacity);
+                elapsed += bench_now() - start;
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "tokenise/%s/%s", names[p],
+                     implNames[impl]);
+            bench_report(name, (double)len * iterations / elapsed / 1e9,
+                         "GB/s");
+        }
+    }
+
+    free(token);
+    free(expected);
+    free(work);
+    free(line);
+
+    return EXIT_SUCCESS;
+}
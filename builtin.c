@@ -0,0 +1,144 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "strmap.h"
+
+// Command name -> sane_builtin_t *
+static strmap_t sane_builtinMap;
+
+// Release a builtin loaded from a library, compiled in builtins are static
+static void sane_builtinFree(void *value)
+{
+    sane_builtin_t *builtin = (sane_builtin_t *)value;
+    if (builtin->handle == NULL) {
+        return;
+    }
+
+    // Every loaded builtin holds a reference to its library
+    dlclose(builtin->handle);
+    free((char *)builtin->name);
+    free((char *)builtin->library);
+    free(builtin);
+}
+
+int sane_builtinRegister(sane_builtin_t *builtin)
+{
+    void *previous;
+    if (strmap_put(&sane_builtinMap, builtin->name, builtin, &previous) != 0) {
+        return -1;
+    }
+    if (previous != NULL) {
+        sane_builtinFree(previous);
+    }
+
+    return 0;
+}
+
+int sane_builtinLoad(const char *path, const char *name)
+{
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "enable: %s\n", dlerror());
+        return -1;
+    }
+
+    // sane_builtin_<name> and the optional sane_builtin_<name>_accepts
+    size_t symbolSize = strlen("sane_builtin__accepts") + strlen(name) + 1;
+    char symbol[symbolSize];
+    snprintf(symbol, symbolSize, "sane_builtin_%s", name);
+    void *func = dlsym(handle, symbol);
+    if (func == NULL) {
+        fprintf(stderr, "enable: %s: %s not found\n", path, symbol);
+        dlclose(handle);
+        return -1;
+    }
+    snprintf(symbol, symbolSize, "sane_builtin_%s_accepts", name);
+    void *accepts = dlsym(handle, symbol);
+
+    sane_builtin_t *builtin = (sane_builtin_t *)malloc(sizeof(sane_builtin_t));
+    if (builtin == NULL) {
+        fprintf(stderr, "enable: out of memory\n");
+        dlclose(handle);
+        return -1;
+    }
+    // POSIX guarantees function pointers survive the conversion from void *
+    *(void **)&builtin->func = func;
+    *(void **)&builtin->accepts = accepts;
+    builtin->handle = handle;
+    builtin->name = strdup(name);
+    builtin->library = strdup(path);
+
+    if (builtin->name == NULL || builtin->library == NULL ||
+        sane_builtinRegister(builtin) != 0) {
+        fprintf(stderr, "enable: out of memory\n");
+        sane_builtinFree(builtin);
+        return -1;
+    }
+
+    return 0;
+}
+
+int sane_builtinRemove(const char *name)
+{
+    void *builtin = strmap_remove(&sane_builtinMap, name);
+    if (builtin == NULL) {
+        return -1;
+    }
+    sane_builtinFree(builtin);
+
+    return 0;
+}
+
+sane_builtin_t *sane_builtinFind(const char *name)
+{
+    return (sane_builtin_t *)strmap_get(&sane_builtinMap, name);
+}
+
+int sane_builtinNext(size_t *it, const char **name)
+{
+    void *value;
+    return strmap_next(&sane_builtinMap, it, name, &value);
+}
+
+static int sane_builtinCompare(const void *a, const void *b)
+{
+    return strcmp((*(sane_builtin_t *const *)a)->name,
+                  (*(sane_builtin_t *const *)b)->name);
+}
+
+void sane_builtinPrint(FILE *stream)
+{
+    sane_builtin_t **builtins = (sane_builtin_t **)malloc(
+        sizeof(sane_builtin_t *) * sane_builtinMap.count);
+    if (builtins == NULL && sane_builtinMap.count > 0) {
+        return;
+    }
+
+    size_t numBuiltins = 0;
+    size_t it = 0;
+    const char *name;
+    void *value;
+    while (strmap_next(&sane_builtinMap, &it, &name, &value)) {
+        builtins[numBuiltins++] = (sane_builtin_t *)value;
+    }
+    qsort(builtins, numBuiltins, sizeof(sane_builtin_t *),
+          &sane_builtinCompare);
+
+    for (size_t i = 0; i < numBuiltins; ++i) {
+        if (builtins[i]->library != NULL) {
+            fprintf(stream, "%s\t%s\n", builtins[i]->name,
+                    builtins[i]->library);
+        } else {
+            fprintf(stream, "%s\n", builtins[i]->name);
+        }
+    }
+
+    free(builtins);
+}
+
+void sane_builtinClear()
+{
+    strmap_destroy(&sane_builtinMap, &sane_builtinFree);
+}
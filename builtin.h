@@ -0,0 +1,97 @@
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Builtin registry (see the 'enable' builtin).
+///
+/// Maps command names to the functions that run them inside the shell, so
+/// finding out whether a command is a builtin is a single hash lookup.
+/// Builtins can also be loaded from shared libraries at run time:
+///
+///     enable -f ./metrics.so emit
+///
+/// loads the function
+///
+///     int sane_builtin_emit(int argc, char **argv);
+///
+/// from metrics.so. It's called like the compiled in builtins: argv[0] is the
+/// name of the command, stdin and stdout are already redirected and the
+/// return value is the command's exit status. A library may also define
+/// 'int sane_builtin_<name>_accepts(int argc, char **argv)' returning 0 for
+/// arguments the builtin doesn't handle, the external command of the same name
+/// is run for those instead.
+////////////////////////////////////////////////////////////////////////////////
+
+typedef int (*sane_builtinFunc_t)(int argc, char **argv);
+
+typedef struct sane_builtin_t {
+    const char *name;
+    sane_builtinFunc_t func;
+    // Whether the builtin handles the given arguments (utilities such as
+    // 'cat' leave some options to the external command), NULL if it takes
+    // any arguments
+    sane_builtinFunc_t accepts;
+    void *handle;        // dlopen() handle, NULL if compiled in
+    const char *library; // path of the library it was loaded from
+} sane_builtin_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Add a compiled in builtin, replacing any builtin of the same name.
+///
+/// @param   builtin   sane_builtin_t *, builtin to add, must stay valid until
+///                    sane_builtinClear().
+/// @return            int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int sane_builtinRegister(sane_builtin_t *builtin);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Load a builtin from a shared library, replacing any builtin of the same
+/// name.
+///
+/// @param   path   const char *, path of the library, passed to dlopen().
+/// @param   name   const char *, name of the builtin.
+/// @return         int, 0 if successful, -1 otherwise (the reason has been
+///                 printed to stderr).
+////////////////////////////////////////////////////////////////////////////////
+int sane_builtinLoad(const char *path, const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove a builtin, so its name runs the external command. Libraries are
+/// closed once none of their builtins are left.
+///
+/// @param   name   const char *, name of the builtin.
+/// @return         int, 0 if successful, -1 if there is no such builtin.
+////////////////////////////////////////////////////////////////////////////////
+int sane_builtinRemove(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   name   const char *, command name (argv[0]).
+/// @return         sane_builtin_t *, builtin called name, NULL if there is
+///                 none.
+////////////////////////////////////////////////////////////////////////////////
+sane_builtin_t *sane_builtinFind(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Iterate over the names of the builtins (in no particular order), e.g. to
+/// complete command names:
+///
+///     size_t it = 0;
+///     while (sane_builtinNext(&it, &name)) { ... }
+///
+/// @param   it     size_t *, iterator, set to 0 before the first call.
+/// @param   name   const char **, name out.
+/// @return         int, 1 if a name was returned, 0 at the end.
+////////////////////////////////////////////////////////////////////////////////
+int sane_builtinNext(size_t *it, const char **name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the names of the builtins, one per line and sorted, followed by the
+/// library for loaded builtins.
+///
+/// @param   stream   FILE *, stream to print to.
+////////////////////////////////////////////////////////////////////////////////
+void sane_builtinPrint(FILE *stream);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove all builtins and close the libraries they were loaded from.
+////////////////////////////////////////////////////////////////////////////////
+void sane_builtinClear();
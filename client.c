@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Client of the shell server (see server.h), runs a line with the server's
+/// shell and exits with its exit status.
+///
+/// usage: sane-client socket line...
+///
+/// The words of the line are joined with spaces, like 'sh -c' callers tend to
+/// expect. The line runs with the client's stdin, stdout, stderr and working
+/// directory.
+////////////////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+// Exit status when the line couldn't be run by the server
+#define CLIENT_FAILURE 255
+
+// Join the words of the line into 'line', returns its length, -1 if the line
+// is too long for a request
+static int joinLine(int argc, char **argv, char *line)
+{
+    size_t length = 0;
+    for (int i = 0; i < argc; ++i) {
+        size_t wordLen = strlen(argv[i]);
+        if (length + wordLen + 1 > SERVER_MAX_LINE) {
+            return -1;
+        }
+        if (i > 0) {
+            line[length++] = ' ';
+        }
+        memcpy(line + length, argv[i], wordLen);
+        length += wordLen;
+    }
+
+    return length;
+}
+
+// Connect to the server, returns the socket, -1 on error
+static int connectServer(const char *path)
+{
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Send the line with stdin, stdout, stderr and the working directory, returns
+// 0 if successful, -1 on error
+static int sendRequest(int server, const char *line, size_t length)
+{
+    int fds[SERVER_NUM_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    fds[3] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fds[3] == -1) {
+        return -1;
+    }
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {(void *)line, length};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    ssize_t numSent = sendmsg(server, &message, MSG_NOSIGNAL);
+    int err = errno;
+    close(fds[3]);
+    errno = err;
+
+    return numSent == (ssize_t)length ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: sane-client socket line...\n");
+        return 2;
+    }
+
+    char *line = (char *)malloc(SERVER_MAX_LINE);
+    if (line == NULL) {
+        fprintf(stderr, "sane-client: out of memory\n");
+        return CLIENT_FAILURE;
+    }
+    int length = joinLine(argc - 2, argv + 2, line);
+    if (length <= 0) {
+        // Requests can't be empty, an empty line has nothing to run
+        free(line);
+        if (length == 0) {
+            return 0;
+        }
+        fprintf(stderr, "sane-client: line too long\n");
+        return CLIENT_FAILURE;
+    }
+
+    int server = connectServer(argv[1]);
+    if (server == -1) {
+        fprintf(stderr, "sane-client: %s: %s\n", argv[1], strerror(errno));
+        free(line);
+        return CLIENT_FAILURE;
+    }
+
+    int status = CLIENT_FAILURE;
+    if (sendRequest(server, line, length) != 0) {
+        fprintf(stderr, "sane-client: send: %s\n", strerror(errno));
+    } else if (recv(server, &status, sizeof(status), 0) != sizeof(status)) {
+        fprintf(stderr, "sane-client: server closed the connection\n");
+        status = CLIENT_FAILURE;
+    }
+
+    close(server);
+    free(line);
+
+    return status;
+}
@@ -1,9 +1,12 @@
-#include <glob.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "command.h"
+#include "variable.h"
+#include "wildcard.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Returns 1 if the token is a command separator and 0 otherwise.
@@ -24,6 +27,110 @@ int separator(const char *token)
     return 0;
 }
 
+// Characters escaped in the values of variables, so that copyArgument() and
+// wildcard_expand() take them literally
+#define VARIABLE_ESCAPED "\\\"'*?["
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the variable referenced at a '$', as '$name' or '${name}'.
+///
+/// @param   it        const char *, points to the '$'.
+/// @param   nameLen   size_t *, length of the name out.
+/// @return            size_t, number of characters of the reference, 0 if
+///                    the '$' isn't followed by a name (it is then taken
+///                    literally).
+////////////////////////////////////////////////////////////////////////////////
+static size_t findVariable(const char *it, size_t *nameLen)
+{
+    if (it[1] == '{') {
+        const char *close = strchr(it + 2, '}');
+        if (close == NULL || !variable_isName(it + 2, close - it - 2)) {
+            return 0;
+        }
+        *nameLen = close - it - 2;
+        return *nameLen + 3;
+    }
+
+    size_t len = 0;
+    while (it[len + 1] == '_' || isalnum((unsigned char)it[len + 1])) {
+        ++len;
+    }
+    if (len == 0 || isdigit((unsigned char)it[1])) {
+        return 0;
+    }
+    *nameLen = len;
+
+    return len + 1;
+}
+
+// Append a character to the expansion, or only count it if 'expansion' is
+// NULL
+static void appendChar(char *expansion, size_t *len, char c)
+{
+    if (expansion != NULL) {
+        expansion[*len] = c;
+    }
+    ++*len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Replace the variables of a token with their values. A variable that isn't
+/// set expands to nothing. Tokens in single quotes and a '$' escaped with '\\'
+/// are left as they are.
+///
+/// @param   arena   arena_t *, arena to allocate the expansion from.
+/// @param   token   const char *, NULL-terminated token to expand.
+/// @return          const char *, the token itself if it has no variables,
+///                  else its expansion, in which the values' quotes, '\\' and
+///                  wildcard characters are escaped. NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static const char *expandVariables(arena_t *arena, const char *token)
+{
+    if (token[0] == '\'' || strchr(token, '$') == NULL) {
+        return token;
+    }
+
+    // Measure the expansion, then fill it in
+    char *expansion = NULL;
+    size_t len = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        len = 0;
+        for (const char *it = token; *it != '\0'; ++it) {
+            size_t nameLen;
+            size_t refLen = (*it == '$') ? findVariable(it, &nameLen) : 0;
+            if (refLen == 0) {
+                if (*it == '\\' && *(it + 1) != '\0') {
+                    appendChar(expansion, &len, *it++);
+                }
+                appendChar(expansion, &len, *it);
+                continue;
+            }
+
+            char name[nameLen + 1];
+            memcpy(name, it + (it[1] == '{' ? 2 : 1), nameLen);
+            name[nameLen] = '\0';
+            const char *value = variable_get(name);
+            for (; value != NULL && *value != '\0'; ++value) {
+                if (strchr(VARIABLE_ESCAPED, *value) != NULL) {
+                    appendChar(expansion, &len, '\\');
+                }
+                appendChar(expansion, &len, *value);
+            }
+            it += refLen - 1;
+        }
+
+        if (pass == 0) {
+            expansion = (char *)arena_alloc(arena, len + 1);
+            if (expansion == NULL) {
+                return NULL;
+            }
+        }
+    }
+    expansion[len] = '\0';
+
+    return expansion;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// This function searches the given array of tokens (from cp->first to
 /// cp->last) and attempts to find the standard input redirection symbol "<" or
@@ -36,11 +143,13 @@ int separator(const char *token)
 ///
 /// @param   token   const char *[], array of tokens.
 /// @param   cp      command_t *, pointer to command struct.
+/// @param   arena   arena_t *, arena to allocate file names from.
 /// @return          int, 0 if no error,
 ///                       -1 if redirect symbol at end of input,
-///                       -2 if ambiguous redirect.
+///                       -2 if ambiguous redirect,
+///                       -3 if out of memory.
 ////////////////////////////////////////////////////////////////////////////////
-int searchRedirection(char *token[], command_t *cp)
+int searchRedirection(char *token[], command_t *cp, arena_t *arena)
 {
     if (cp != NULL) {
         for (int i = cp->first; i <= cp->last; ++i) {
@@ -49,63 +158,43 @@ int searchRedirection(char *token[], command_t *cp)
 
                 // Check that redirection symbol isn't last token in command
                 if (i == cp->last) {
-                    fprintf(
-                        stderr,
-                        "sane: syntax error, expected path after token '%s'\n",
-                        token[i]);
                     return -1;
                 }
 
+                const char *file = expandVariables(arena, token[i + 1]);
+                if (file == NULL) {
+                    return -3;
+                }
+
                 // Check for ambiguity
                 // If requested inpath/outpath contains wildcard characters and
-                // is ambiguous (glob returns more than 1 path), fail
-                glob_t globResult;
-                glob(token[i + 1], 0, NULL, &globResult);
+                // is ambiguous (matches more than 1 path), fail
+                char **paths;
+                int numPaths = wildcard_expand(file, 0, &paths);
+                if (numPaths == -1) {
+                    return -3;
+                }
 
-                if (globResult.gl_pathc > 1) {
+                if (numPaths > 1) {
                     // Skip command
-                    fprintf(stderr, "sane: %s: ambiguous redirect\n",
-                            token[i + 1]);
                     return -2;
                 }
 
-                if (globResult.gl_pathc > 0) { // Exactly one path matched
-                    // Else, handle redirection
-                    if (strcmp(token[i], REDIR_IN) == 0) {
-                        size_t len = strlen(globResult.gl_pathv[0]) +
-                                     1; // + 1 for NULL-terminator
-                        char *tmp = (char *)malloc(sizeof(char) * len);
-                        memset(tmp, '\0', len);
-                        cp->stdin_file = strcpy(tmp, globResult.gl_pathv[0]);
-                        ++i;
-                    } else if (strcmp(token[i], REDIR_OUT) == 0) {
-                        size_t len = strlen(globResult.gl_pathv[0]) +
-                                     1; // + 1 for NULL-terminator
-                        char *tmp = (char *)malloc(sizeof(char) * len);
-                        memset(tmp, '\0', len);
-                        cp->stdout_file = strcpy(tmp, globResult.gl_pathv[0]);
-                        ++i;
-                    }
-                } else { // No paths matched
-                    // Just use token
-                    if (strcmp(token[i], REDIR_IN) == 0) {
-                        size_t len =
-                            strlen(token[i + 1]) + 1; // + 1 for NULL-terminator
-                        char *tmp = (char *)malloc(sizeof(char) * len);
-                        memset(tmp, '\0', len);
-                        cp->stdin_file = strcpy(tmp, token[i + 1]);
-                        ++i;
-                    } else if (strcmp(token[i], REDIR_OUT) == 0) {
-                        size_t len =
-                            strlen(token[i + 1]) + 1; // + 1 for NULL-terminator
-                        char *tmp = (char *)malloc(sizeof(char) * len);
-                        memset(tmp, '\0', len);
-                        cp->stdout_file = strcpy(tmp, token[i + 1]);
-                        ++i;
-                    }
+                // Use the path if exactly one path matched, if no paths
+                // matched just use token
+                char *path = arena_strdup(arena,
+                                          (numPaths > 0) ? paths[0] : file);
+                if (path == NULL) {
+                    return -3;
                 }
 
-                globfree(&globResult);
+                // Handle redirection
+                if (strcmp(token[i], REDIR_IN) == 0) {
+                    cp->stdin_file = path;
+                } else {
+                    cp->stdout_file = path;
+                }
+                ++i;
             }
         }
     }
@@ -114,12 +203,70 @@ int searchRedirection(char *token[], command_t *cp)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Dynamically allocates memory for the cp->argv property.
+/// Copy a token into the arena, ignoring escape characters ('\\') and the
+/// quote characters 'quote1' and 'quote2'. The character following an ignored
+/// character is always copied.
+///
+/// @param   arena    arena_t *, arena to allocate copy from.
+/// @param   str      const char *, NULL-terminated token to copy.
+/// @param   quote1   char, quote character to ignore.
+/// @param   quote2   char, quote character to ignore.
+/// @return           char *, copy of token, NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static char *
+copyArgument(arena_t *arena, const char *str, char quote1, char quote2)
+{
+    // Ignoring characters only ever makes the copy shorter
+    size_t len = strlen(str) + 1; // + 1 for NULL-terminator
+    char *tmp = (char *)arena_alloc(arena, len);
+    if (tmp == NULL) {
+        return NULL;
+    }
+
+    size_t k = 0;
+    for (const char *it = str; *it != '\0'; ++it) {
+        if (*it == '\\' || *it == quote1 || *it == quote2) {
+            tmp[k] = *(it + 1);
+
+            // Don't increment iterator again if at end of token
+            if (*(it + 1)) {
+                ++it;
+            }
+        } else {
+            tmp[k] = *it;
+        }
+        ++k;
+    }
+    tmp[k] = '\0';
+
+    // Give back what we didn't use, tmp is the most recent allocation
+    return (char *)arena_realloc(arena, tmp, len, k + 1);
+}
+
+// Paths a wildcard expanded to, kept aside until the size of argv is known
+typedef struct argv_expansion_t {
+    struct argv_expansion_t *next;
+    int slot;     // index in argv of the wildcard the paths replace
+    int numPaths; // number of paths, more than one, or none for a token
+                  // whose variables expanded to nothing
+    char *paths[];
+} argv_expansion_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Allocates memory for the cp->argv property from the arena.
+///
+/// Each expansion of a wildcard is copied into its own chunk as it's made, and
+/// argv is allocated once its final size is known, so a line with many globs
+/// (or a glob matching many files) never copies argv around to grow it.
+/// Variables are expanded before wildcards, so a variable can name the
+/// directory a wildcard is matched in.
 ///
 /// @param   token   char *[], array of tokens.
 /// @param   cp      command_t *, pointer to command_t structure to fill.
+/// @param   arena   arena_t *, arena to allocate argv from.
+/// @return          int, 0 if successful, -1 if out of memory.
 ////////////////////////////////////////////////////////////////////////////////
-void buildCommandArgumentArray(char *token[], command_t *cp)
+int buildCommandArgumentArray(char *token[], command_t *cp, arena_t *arena)
 {
     int ii = cp->first;
     for (; ii <= cp->last; ++ii) {
@@ -130,206 +277,167 @@ void buildCommandArgumentArray(char *token[], command_t *cp)
         }
     }
 
-    unsigned int n = (ii - cp->first) + 1; // Last element in argv must be NULL
+    // One slot per token, a wildcard's slot stays NULL until the merge below
+    unsigned int numSlots = ii - cp->first;
+    unsigned int n = numSlots + 1; // Last element in argv must be NULL
 
-    cp->argv = realloc(cp->argv, sizeof(char *) * n);
+    char **slots = (char **)arena_alloc(arena, sizeof(char *) * n);
+    if (slots == NULL) {
+        return -1;
+    }
     // Don't match any wildcards in first token (command to execute)
-    size_t len1 = strlen(token[cp->first]) + 1;
-    char *tmp1 = (char *)malloc(sizeof(char) * len1);
-    memset(tmp1, '\0', len1);
-    cp->argv[0] = strcpy(tmp1, token[cp->first]);
+    const char *name = expandVariables(arena, token[cp->first]);
+    if (name == NULL) {
+        return -1;
+    }
+    slots[0] = (name == token[cp->first])
+                   ? arena_strdup(arena, name)
+                   : copyArgument(arena, name, '"', '\'');
+    if (slots[0] == NULL) {
+        return -1;
+    }
 
-    int offset = 1;
+    argv_expansion_t *expansions = NULL;
+    argv_expansion_t **tail = &expansions;
     for (int i = cp->first + 1; i < ii; ++i) {
-        char *it = token[i];
+        const char *it = expandVariables(arena, token[i]);
+        if (it == NULL) {
+            return -1;
+        }
+        int slot = i - cp->first;
         if (*it == '"' || *it == '\'') {
-            char quoteType = *it;
-            char *startIt = it;
-
-            size_t len = 0;
-            for (; *it != '\0'; ++it) {
-                // Make sure to ignore escape characters and inner quotes of
-                // quoteType kind
-                if (*it == '\\' || *it == quoteType) {
-                    if (*(it + 1)) {
-                        ++it;
-                    } else {
-                        // Nothing after ignored character, don't increase len
-                        break;
-                    }
-                }
-                ++len;
+            // Make sure to ignore escape characters and inner quotes of
+            // quoteType kind
+            slots[slot] = copyArgument(arena, it, *it, *it);
+            if (slots[slot] == NULL) {
+                return -1;
             }
-            ++len; // For NULL terminator
-
-            char *tmp = (char *)malloc(sizeof(char) * len);
-            memset(tmp, '\0', len);
-
-            int k = 0;
-            for (it = startIt; *it != '\0'; ++it) {
-                // Make sure to ignore escape characters and inner quotes of "
-                // kind
-                if (*it == '\\' || *it == quoteType) {
-                    tmp[k] = *(it + 1);
-
-                    // Don't increment iterator again if at end of token
-                    if (*(it + 1)) {
-                        ++it;
-                    }
-                } else {
-                    tmp[k] = *it;
-                }
-                ++k;
+            continue;
+        }
+
+        // Unquoted variables that aren't set leave no argument behind, like
+        // a wildcard expanding to no paths would
+        char **paths = NULL;
+        int numPaths = 0;
+        if (*it != '\0') {
+            numPaths = wildcard_expand(it, WILDCARD_TILDE, &paths);
+            if (numPaths == -1) {
+                return -1;
             }
+        }
 
-            cp->argv[offset] = tmp;
-            ++offset;
-            /* } else if ((*it == '\\' && *(it + 1) == '"') || */
-            /*            (*it == '\\' && *(it + 1) == '\'')) { */
-            /*     char *startIt = it; */
-
-            /*     size_t len = 0; */
-            /*     for (; *it != '\0'; ++it) { */
-            /*         // Make sure to ignore escape characters and inner quotes
-             * of */
-            /*         // both kinds */
-            /*         if (*it == '\\' || *it == '"' || *it == '\'') { */
-            /*             if (*(it + 1)) { */
-            /*                 ++it; */
-            /*             } else { */
-            /*                 // Nothing after ignored character, don't
-             * increase len */
-            /*                 break; */
-            /*             } */
-            /*         } */
-            /*         ++len; */
-            /*     } */
-            /*     ++len; // For NULL terminator */
-
-            /*     char *tmp = (char *)malloc(sizeof(char) * len); */
-            /*     memset(tmp, '\0', len); */
-
-            /*     int k = 0; */
-            /*     for (it = startIt; *it != '\0'; ++it) { */
-            /*         // Make sure to ignore escape characters and inner quotes
-             * of */
-            /*         // both kinds */
-            /*         if (*it == '\\' || *it == '"' || *it == '\'') { */
-            /*             tmp[k] = *(it + 1); */
-
-            /*             // Don't increment iterator again if at end of token
-             */
-            /*             if (*(it + 1)) { */
-            /*                 ++it; */
-            /*             } */
-            /*         } else { */
-            /*             tmp[k] = *it; */
-            /*         } */
-            /*         ++k; */
-            /*     } */
-
-            /*     cp->argv[offset] = tmp; */
-            /*     ++offset; */
+        if (numPaths == 0 && *it != '\0') {
+            // Handle escape characters
+            slots[slot] = copyArgument(arena, it, '"', '\'');
+        } else if (numPaths == 1) {
+            slots[slot] = copyArgument(arena, paths[0], '"', '\'');
         } else {
-            glob_t globResult;
-            glob(token[i], GLOB_TILDE, NULL, &globResult);
-
-            if (globResult.gl_pathc > 0) {
-                n +=
-                    globResult.gl_pathc - 1; // already counted one of the paths
-
-                cp->argv = realloc(cp->argv, sizeof(char *) * n);
-                for (int j = 0; j < globResult.gl_pathc; ++j) {
-                    /* size_t len = strlen(globResult.gl_pathv[j]) + */
-                    /*              1; // +1 for NULL terminator */
-                    size_t len = 0;
-                    for (int k = 0; k < strlen(globResult.gl_pathv[j]); ++k) {
-                        if (globResult.gl_pathv[j][k] == '\\' ||
-                            globResult.gl_pathv[j][k] == '"' ||
-                            globResult.gl_pathv[j][k] == '\'') {
-                            if (globResult.gl_pathv[j][k + 1]) {
-                                ++k;
-                            } else {
-                                // Nothing after ignored character, don't
-                                // increase length
-                                break;
-                            }
-                        }
-                        ++len;
-                    }
-                    ++len; // +1 for NULL-terminator
-
-                    char *tmp = (char *)malloc(sizeof(char) * len);
-                    memset(tmp, '\0', len);
-
-                    int k = 0;
-                    for (char *it = globResult.gl_pathv[j]; *it != '\0'; ++it) {
-                        // Handle escape characters
-                        if (*it == '\\' || *it == '"' || *it == '\'') {
-                            // Make sure to ignore escape character
-                            tmp[k] = *(it + 1);
-
-                            if (*(it + 1)) {
-                                ++it;
-                            }
-                        } else {
-                            tmp[k] = *it;
-                        }
-                        ++k;
-                    }
-
-                    cp->argv[offset + j] = tmp;
+            // The paths are only valid until the next expansion
+            argv_expansion_t *expansion = (argv_expansion_t *)arena_alloc(
+                arena, sizeof(argv_expansion_t) + sizeof(char *) * numPaths);
+            if (expansion == NULL) {
+                return -1;
+            }
+            expansion->next = NULL;
+            expansion->slot = slot;
+            expansion->numPaths = numPaths;
+            for (int j = 0; j < numPaths; ++j) {
+                // Handle escape characters
+                expansion->paths[j] = copyArgument(arena, paths[j], '"', '\'');
+                if (expansion->paths[j] == NULL) {
+                    return -1;
                 }
+            }
+            *tail = expansion;
+            tail = &expansion->next;
 
-                offset += globResult.gl_pathc;
-            } else {
-                size_t len = 0;
-                for (int k = 0; k < strlen(token[i]); ++k) {
-                    if (token[i][k] == '\\' || token[i][k] == '"' ||
-                        token[i][k] == '\'') {
-                        if (token[i][k + 1]) {
-                            ++k;
-                        } else {
-                            // Nothing after ignored character, dont increase
-                            // length
-                            break;
-                        }
-                    }
-                    ++len;
-                }
-                ++len; // +1 for NULL-terminator
-
-                char *tmp = (char *)malloc(sizeof(char) * len);
-                memset(tmp, '\0', len);
-
-                int k = 0;
-                for (char *it = token[i]; *it != '\0'; ++it) {
-                    // Handle escape characters
-                    if (*it == '\\' || *it == '"' || *it == '\'') {
-                        // Make sure to ignore escape character
-                        tmp[k] = *(it + 1);
-
-                        // Don't increment iterator again if at end of token
-                        if (*(it + 1)) {
-                            ++it;
-                        }
-                    } else {
-                        tmp[k] = *it;
-                    }
-                    ++k;
-                }
+            n += numPaths - 1; // the slot already counted one of the paths
+            slots[slot] = NULL;
+            continue;
+        }
+        if (slots[slot] == NULL) {
+            return -1;
+        }
+    }
+    slots[numSlots] = NULL;
 
-                cp->argv[offset] = tmp;
-                ++offset;
-            }
+    if (expansions == NULL) {
+        cp->argv = slots;
+        cp->numExpanded = 0;
+        cp->numTrailing = 0;
+        return 0;
+    }
+
+    // Merge the slots and the expansions into argv of the final size
+    cp->argv = (char **)arena_alloc(arena, sizeof(char *) * n);
+    if (cp->argv == NULL) {
+        return -1;
+    }
+    unsigned int offset = 0;
+    unsigned int slot = 0;
+    // argv[0] is never expanded, an end of 0 means no wildcard was
+    unsigned int expandedStart = 0;
+    unsigned int expandedEnd = 0;
+    for (argv_expansion_t *expansion = expansions; expansion != NULL;
+         expansion = expansion->next) {
+        unsigned int numBefore = expansion->slot - slot;
+        memcpy(cp->argv + offset, slots + slot, sizeof(char *) * numBefore);
+        offset += numBefore;
+        if (expansion->numPaths > 0 && expandedEnd == 0) {
+            expandedStart = offset;
+        }
+        memcpy(cp->argv + offset, expansion->paths,
+               sizeof(char *) * expansion->numPaths);
+        offset += expansion->numPaths;
+        if (expansion->numPaths > 0) {
+            expandedEnd = offset;
+        }
+        slot = expansion->slot + 1;
+    }
+    cp->numExpanded = expandedEnd - expandedStart;
+    cp->numTrailing = (expandedEnd > 0) ? (n - 1) - expandedEnd : 0;
+    // The rest of the slots, including the terminating NULL
+    memcpy(cp->argv + offset, slots + slot,
+           sizeof(char *) * (numSlots + 1 - slot));
+
+    return 0;
+}
 
-            globfree(&globResult);
+// Number of commands the command array starts with, enough for most lines
+#define INITIAL_NUM_COMMANDS 4
+
+////////////////////////////////////////////////////////////////////////////////
+/// Make sure there is room for one more command in the command array, doubling
+/// its size if it is full. The new command is cleared.
+///
+/// @return   command_t *, the new command, NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static command_t *
+reserveCommand(command_t **command, int *capacity, int numCommands)
+{
+    if (numCommands >= *capacity) {
+        int newCapacity =
+            (*capacity > 0) ? *capacity * 2 : INITIAL_NUM_COMMANDS;
+        command_t *newCommand =
+            (command_t *)realloc(*command, sizeof(command_t) * newCapacity);
+        if (newCommand == NULL) {
+            return NULL;
         }
+        *command = newCommand;
+        *capacity = newCapacity;
     }
-    cp->argv[n - 1] = NULL;
+
+    command_t *cp = &(*command)[numCommands];
+    memset(cp, 0, sizeof(command_t));
+
+    return cp;
 }
 
-int separateCommands(char *token[], int numTokens, command_t command[])
+int separateCommands(char *token[],
+                     int numTokens,
+                     command_t **commandArray,
+                     int *capacity,
+                     arena_t *arena)
 {
     int result = 0;
 
@@ -343,6 +451,10 @@ int separateCommands(char *token[], int numTokens, command_t command[])
         return -3;
     }
 
+    // Directories read for wildcards in this line may have changed since the
+    // previous line
+    wildcard_newLine();
+
     int first = 0;
     int last = 0;
     const char *sep = SEP_SEQ;
@@ -359,9 +471,13 @@ int separateCommands(char *token[], int numTokens, command_t command[])
                 return -2;
             }
 
-            command[c].first = first;
-            command[c].last = last - 1;
-            command[c].sep = sep;
+            command_t *cp = reserveCommand(commandArray, capacity, c);
+            if (cp == NULL) {
+                return -1;
+            }
+            cp->first = first;
+            cp->last = last - 1;
+            cp->sep = sep;
             ++c;
 
             // Advance first index
@@ -375,9 +491,13 @@ int separateCommands(char *token[], int numTokens, command_t command[])
                 return -2;
             }
 
-            command[c].first = first;
-            command[c].last = last;
-            command[c].sep = sep;
+            command_t *cp = reserveCommand(commandArray, capacity, c);
+            if (cp == NULL) {
+                return -1;
+            }
+            cp->first = first;
+            cp->last = last;
+            cp->sep = sep;
             ++c;
 
             // Advance first index
@@ -386,52 +506,49 @@ int separateCommands(char *token[], int numTokens, command_t command[])
     }
 
     int numCommands = c;
+    command_t *command = *commandArray;
+
+    // Check the last token of the last command
+    if (strcmp(token[last], SEP_PIPE) == 0) { // last token is pipe separator
+        return -4;
+    }
 
     for (int i = 0; i < numCommands; ++i) {
         // Search for redirection symbols
-        int err = searchRedirection(token, &(command[i]));
+        int err = searchRedirection(token, &(command[i]), arena);
         // Redirection operator at end of command (no file specified)
         if (err == -1) {
+            freeCommands(command, i + 1, arena);
             return -5;
         } else if (err == -2) {
             result = -6;
+        } else if (err == -3) {
+            freeCommands(command, i + 1, arena);
+            return -1;
         }
 
         // Build argv for each command.
-        buildCommandArgumentArray(token, &(command[i]));
+        if (buildCommandArgumentArray(token, &(command[i]), arena) != 0) {
+            freeCommands(command, i + 1, arena);
+            return -1;
+        }
     }
 
-    // Check the last token of the last command
-    if (strcmp(token[last], SEP_PIPE) == 0) { // last token is pipe separator
-        return -4;
+    if (result != 0) {
+        freeCommands(command, numCommands, arena);
     }
 
-
     return (result == 0 ? numCommands : result);
 }
 
-void freeCommands(command_t command[], int numCommands)
+void freeCommands(command_t command[], int numCommands, arena_t *arena)
 {
     for (unsigned int i = 0; i < numCommands; ++i) {
-        // Free input redirection
-        if (command[i].stdin_file != NULL) {
-            free(command[i].stdin_file);
-            command[i].stdin_file = NULL;
-        }
-        // Free output redirection
-        if (command[i].stdout_file != NULL) {
-            free(command[i].stdout_file);
-            command[i].stdout_file = NULL;
-        }
-
-        if (command[i].argv != NULL) {
-            // Free each token
-            for (int j = 0; command[i].argv[j] != NULL; ++j) {
-                free(command[i].argv[j]);
-            }
-            // Free array
-            free(command[i].argv);
-            command[i].argv = NULL;
-        }
+        command[i].stdin_file = NULL;
+        command[i].stdout_file = NULL;
+        command[i].argv = NULL;
     }
+
+    // Release all argument and redirection strings in one go
+    arena_reset(arena);
 }
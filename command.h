@@ -1,5 +1,3 @@
-#define MAX_NUM_COMMANDS 100
-
 // Command separators
 #define SEP_PIPE "|" // Pipe separator
 #define SEP_CON "&"  // Concurrent execution separator "&"
@@ -8,6 +6,9 @@
 #define REDIR_IN "<"
 #define REDIR_OUT ">"
 
+// Forward declaration
+struct arena_t;
+
 // Command structure
 typedef struct command_t {
     int first; // index to the first token into  the array
@@ -20,21 +21,31 @@ typedef struct command_t {
                        // redirection
     char *stdout_file; // if not NULL, points to the file name for stdout
                        // redirection
+    int numExpanded;   // number of arguments from the first to the last
+                       // wildcard that matched several paths, 0 if none did
+    int numTrailing;   // number of arguments after them, counted from the
+                       // end so prefixes removed from argv don't change it
 } command_t;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Separate the list of null-terminated tokens in the "token" array into a
-/// sequence of commands, which are stored in the "command" array.
+/// sequence of commands, which are stored in the "*command" array.
+///
+/// The command array is grown as needed and can be reused for the next line
+/// once the commands in it have been freed with freeCommands(). The argument
+/// arrays, argument strings and redirection file names of the commands are
+/// allocated from 'arena'.
 ///
-/// @pre   The array "command" must have at least MAX_NUM_COMMANDS number of
-///        elements.
+/// @pre   '*command' is NULL or an array of '*capacity' elements allocated with
+///        malloc().
 ///
 /// @param   token       char *[], array of tokens.
 /// @param   numTokens   int, number of tokens in token array.
-/// @param   command     command_t [], array of commands out.
+/// @param   command     command_t **, array of commands in/out.
+/// @param   capacity    int *, number of elements in command array in/out.
+/// @param   arena       arena_t *, arena the commands are allocated from.
 /// @return            int,
-///  1) -1 if the array "command" is too small for all
-///      commands.
+///  1) -1 if the command array could not be grown (out of memory).
 ///  2) < -1, if there are any of the following syntax errors in the list of
 ///     tokens:
 ///      a) -2, if any two successive commands are separated by more than one
@@ -49,18 +60,25 @@ typedef struct command_t {
 ///
 /// @note   The last command may be followed by "&", ";", or nothing. If nothing
 /// follows the last command, we assume it is followed by ";".
-/// @note All members of the command struct should be initialized to 0 before
-/// calling this function.
+/// @note   If an error is returned, no commands need to be freed.
 ////////////////////////////////////////////////////////////////////////////////
-int separateCommands(char *token[], int numTokens, command_t command[]);
+int separateCommands(char *token[],
+                     int numTokens,
+                     command_t **command,
+                     int *capacity,
+                     struct arena_t *arena);
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Free all dynamically allocated memory associated with the given numCommands
-/// in the passed command array.
+/// in the passed command array, by resetting the arena they were allocated
+/// from.
 ///
 /// @pre There are atleast numCommands in the command array.
 ///
 /// @param   command       command_t [], array of commands to free.
 /// @param   numCommands   int, number of commands in command array to free.
+/// @param   arena         arena_t *, arena the commands were allocated from.
 ////////////////////////////////////////////////////////////////////////////////
-void freeCommands(command_t command[], int numCommands);
+void freeCommands(command_t command[],
+                  int numCommands,
+                  struct arena_t *arena);
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "complete.h"
+#include "execindex.h"
+#include "wildcard.h"
+
+// Characters wildcard_expand() would treat as a pattern
+#define COMPLETE_MAGIC "*?[\\"
+
+static int complete_add(complete_t *completion, const char *match)
+{
+    if (completion->numMatches == completion->capacity) {
+        size_t capacity = completion->capacity * 2 + 64;
+        const char **matches = (const char **)realloc(
+            completion->matches, sizeof(const char *) * capacity);
+        if (matches == NULL) {
+            return -1;
+        }
+        completion->matches = matches;
+        completion->capacity = capacity;
+    }
+    completion->matches[completion->numMatches++] = match;
+
+    return 0;
+}
+
+static int complete_compare(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Builtins and executables starting with the word
+static int complete_commands(complete_t *completion, const char *word)
+{
+    size_t wordLen = strlen(word);
+    size_t it = 0;
+    const char *name;
+    while (sane_builtinNext(&it, &name)) {
+        if (strncmp(name, word, wordLen) == 0 &&
+            complete_add(completion, name) != 0) {
+            return -1;
+        }
+    }
+
+    // Without an index builtins can still be completed
+    size_t first;
+    int numNames = execindex_find(word, &first);
+    for (int i = 0; i < numNames; ++i) {
+        if (complete_add(completion, execindex_name(first + i)) != 0) {
+            return -1;
+        }
+    }
+
+    qsort(completion->matches, completion->numMatches, sizeof(const char *),
+          &complete_compare);
+    // A builtin shadowing an executable is completed once
+    size_t numMatches = 0;
+    for (size_t i = 0; i < completion->numMatches; ++i) {
+        if (numMatches == 0 || strcmp(completion->matches[numMatches - 1],
+                                      completion->matches[i]) != 0) {
+            completion->matches[numMatches++] = completion->matches[i];
+        }
+    }
+    completion->numMatches = numMatches;
+
+    return 0;
+}
+
+// Paths starting with the word, i.e. matching the word followed by '*'
+static int complete_paths(complete_t *completion, const char *word)
+{
+    size_t wordLen = strlen(word);
+    char pattern[wordLen * 2 + 2];
+    char *it = pattern;
+    for (const char *c = word; *c != '\0'; ++c) {
+        if (strchr(COMPLETE_MAGIC, *c) != NULL) {
+            *it++ = '\\';
+        }
+        *it++ = *c;
+    }
+    strcpy(it, "*");
+
+    // Directories are checked for changes again, like for a new line
+    wildcard_newLine();
+    char **paths;
+    int numPaths = wildcard_expand(pattern, WILDCARD_TILDE, &paths);
+    if (numPaths == -1) {
+        return -1;
+    }
+    for (int i = 0; i < numPaths; ++i) {
+        if (complete_add(completion, paths[i]) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int complete_find(complete_t *completion, const char *line, size_t cursor)
+{
+    completion->numMatches = 0;
+
+    // The word starts after the last space not escaped with a '\'
+    size_t start = cursor;
+    while (start > 0 && !(line[start - 1] == ' ' &&
+                          (start < 2 || line[start - 2] != '\\'))) {
+        --start;
+    }
+    completion->start = start;
+
+    size_t before = start;
+    while (before > 0 && line[before - 1] == ' ') {
+        --before;
+    }
+    int command = before == 0 || strchr("|&;", line[before - 1]) != NULL;
+
+    // The word as the command will see it, without escapes
+    char word[cursor - start + 1];
+    size_t wordLen = 0;
+    for (size_t i = start; i < cursor; ++i) {
+        if (line[i] == '\\' && i + 1 < cursor) {
+            ++i;
+        }
+        word[wordLen++] = line[i];
+    }
+    word[wordLen] = '\0';
+
+    completion->paths = !command || strchr(word, '/') != NULL;
+    if (completion->paths) {
+        return complete_paths(completion, word);
+    }
+
+    return complete_commands(completion, word);
+}
+
+void complete_free(complete_t *completion)
+{
+    free(completion->matches);
+    completion->matches = NULL;
+    completion->numMatches = 0;
+    completion->capacity = 0;
+}
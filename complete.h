@@ -0,0 +1,36 @@
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Completion of the word before the cursor (see lineedit.h).
+///
+/// The first word of a command (at the start of the line or after '|', '&' or
+/// ';') completes to builtins and to the executables in PATH, from the shared
+/// index of execindex.h. Other words, and command words containing a '/',
+/// complete to paths, listed through the directory cache of wildcard.h.
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct complete_t {
+    size_t start;         // offset of the word being completed in the line
+    int paths;            // 1 if the candidates are paths, 0 if commands
+    const char **matches; // candidates, sorted
+    size_t numMatches;
+    size_t capacity;
+} complete_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the candidates for the word ending at the cursor.
+///
+/// @param   completion   complete_t *, zeroed before the first call, receives
+///                       the candidates, valid until the next call.
+/// @param   line         const char *, line being edited.
+/// @param   cursor       size_t, offset of the cursor in the line.
+/// @return               int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int complete_find(complete_t *completion, const char *line, size_t cursor);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release the candidates' array.
+///
+/// @param   completion   complete_t *, completion to release.
+////////////////////////////////////////////////////////////////////////////////
+void complete_free(complete_t *completion);
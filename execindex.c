@@ -0,0 +1,494 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "execindex.h"
+#include "strmap.h"
+#include "variable.h"
+
+#define EXECINDEX_MAGIC "SANEXI01"
+// Directories modified less than this many seconds before the index was built
+// could be modified again without their mtime changing, such an index is
+// rebuilt on its next use
+#define EXECINDEX_RACY_SECONDS 2
+
+#define EXECINDEX_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+// A PATH directory, as it was when the index was built
+typedef struct execindex_dir_t {
+    uint64_t dev;
+    uint64_t ino; // 0 if the directory couldn't be read
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+} execindex_dir_t;
+
+// Start of the file, followed by PATH (NULL-terminated, padded to 8 bytes),
+// the directories, the offsets of the sorted names and the names
+typedef struct execindex_header_t {
+    char magic[8];
+    uint64_t size;     // size of the file
+    int64_t builtSec;  // time the index was built
+    uint32_t pathLen;  // length of PATH
+    uint32_t numDirs;  // number of absolute directories in PATH
+    uint32_t numNames; // number of names
+    uint32_t padding;
+} execindex_header_t;
+
+// Mapping of the index, or a copy in memory if it couldn't be saved
+static char *execindex_map = NULL;
+static size_t execindex_mapSize = 0;
+static int execindex_mapped = 0; // 1 if execindex_map is mmap'd
+static const uint32_t *execindex_names = NULL;
+static uint32_t execindex_numNames = 0;
+
+void execindex_clear()
+{
+    if (execindex_mapped) {
+        munmap(execindex_map, execindex_mapSize);
+    } else {
+        free(execindex_map);
+    }
+    execindex_map = NULL;
+    execindex_mapSize = 0;
+    execindex_mapped = 0;
+    execindex_names = NULL;
+    execindex_numNames = 0;
+}
+
+static const execindex_dir_t *execindex_dirs(const char *index)
+{
+    const execindex_header_t *header = (const execindex_header_t *)index;
+    return (const execindex_dir_t *)(index + EXECINDEX_ALIGN(
+                                                 sizeof(execindex_header_t) +
+                                                 header->pathLen + 1));
+}
+
+// Fill in the directory as it is now
+static void execindex_statDir(const char *dir, execindex_dir_t *entry)
+{
+    struct stat dirStat;
+    memset(entry, 0, sizeof(execindex_dir_t));
+    if (stat(dir, &dirStat) == 0 && S_ISDIR(dirStat.st_mode)) {
+        entry->dev = dirStat.st_dev;
+        entry->ino = dirStat.st_ino;
+        entry->mtimeSec = dirStat.st_mtim.tv_sec;
+        entry->mtimeNsec = dirStat.st_mtim.tv_nsec;
+    }
+}
+
+// Call 'func' for each absolute directory of PATH, with 'dir' NULL-terminated
+// in a buffer of PATH_MAX bytes. Stops early and returns -1 if 'func' does.
+static int execindex_forEachDir(const char *path,
+                                int (*func)(const char *dir, void *data),
+                                void *data)
+{
+    char dir[PATH_MAX];
+    const char *it = path;
+    while (*it != '\0') {
+        const char *end = strchrnul(it, ':');
+        size_t dirLen = end - it;
+        // Relative directories depend on the working directory
+        if (dirLen > 0 && *it == '/' && dirLen < sizeof(dir)) {
+            memcpy(dir, it, dirLen);
+            dir[dirLen] = '\0';
+            if (func(dir, data) != 0) {
+                return -1;
+            }
+        }
+        it = (*end == ':') ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+typedef struct execindex_check_t {
+    const execindex_dir_t *dirs;
+    uint32_t numDirs;
+    uint32_t numChecked;
+    int64_t builtSec;
+} execindex_check_t;
+
+static int execindex_checkDir(const char *dir, void *data)
+{
+    execindex_check_t *check = (execindex_check_t *)data;
+    if (check->numChecked == check->numDirs) {
+        return -1;
+    }
+
+    const execindex_dir_t *expected = &check->dirs[check->numChecked++];
+    execindex_dir_t current;
+    execindex_statDir(dir, &current);
+
+    if (current.ino != 0 &&
+        current.mtimeSec + EXECINDEX_RACY_SECONDS > check->builtSec) {
+        return -1;
+    }
+    return memcmp(&current, expected, sizeof(current)) == 0 ? 0 : -1;
+}
+
+// Returns 1 if the index was built from PATH and its directories didn't
+// change since
+static int execindex_isValid(const char *index, size_t size, const char *path)
+{
+    const execindex_header_t *header = (const execindex_header_t *)index;
+    size_t pathLen = strlen(path);
+    if (size < sizeof(execindex_header_t) ||
+        memcmp(header->magic, EXECINDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->size != size || header->pathLen != pathLen ||
+        EXECINDEX_ALIGN(sizeof(execindex_header_t) + pathLen + 1) +
+                sizeof(execindex_dir_t) * (size_t)header->numDirs +
+                sizeof(uint32_t) * (size_t)header->numNames >
+            size ||
+        memcmp(index + sizeof(execindex_header_t), path, pathLen + 1) != 0) {
+        return 0;
+    }
+
+    execindex_check_t check = {execindex_dirs(index), header->numDirs, 0,
+                               header->builtSec};
+    return execindex_forEachDir(path, &execindex_checkDir, &check) == 0 &&
+           check.numChecked == check.numDirs;
+}
+
+// Start using an index, 'mapped' is 1 if it's mmap'd
+static void execindex_use(char *index, size_t size, int mapped)
+{
+    const execindex_header_t *header = (const execindex_header_t *)index;
+
+    execindex_map = index;
+    execindex_mapSize = size;
+    execindex_mapped = mapped;
+    execindex_names = (const uint32_t *)(execindex_dirs(index) +
+                                         header->numDirs);
+    execindex_numNames = header->numNames;
+}
+
+// Name of the index file for PATH, dynamically allocated, NULL if out of
+// memory
+static char *execindex_file(const char *path)
+{
+    char *file = NULL;
+    unsigned long hash = strmap_hash(path);
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    const char *tmpDir = getenv("TMPDIR");
+    int result;
+    if (runtimeDir != NULL && *runtimeDir == '/') {
+        result = asprintf(&file, "%s/sane-exec-%lx", runtimeDir, hash);
+    } else {
+        result = asprintf(&file, "%s/sane-exec-%d-%lx",
+                          (tmpDir != NULL && *tmpDir == '/') ? tmpDir : "/tmp",
+                          (int)getuid(), hash);
+    }
+
+    return result == -1 ? NULL : file;
+}
+
+// Map the index file if it's valid for PATH, returns 0 if successful
+static int execindex_open(const char *file, const char *path)
+{
+    // In a shared directory the file must be the user's own
+    int fd = open(file, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) ||
+        fileStat.st_uid != getuid() || (fileStat.st_mode & 022) != 0 ||
+        fileStat.st_size < (off_t)sizeof(execindex_header_t)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = fileStat.st_size;
+    char *index = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index == MAP_FAILED) {
+        return -1;
+    }
+    if (!execindex_isValid(index, size, path)) {
+        munmap(index, size);
+        return -1;
+    }
+    execindex_use(index, size, 1);
+
+    return 0;
+}
+
+// Names found while building an index
+typedef struct execindex_build_t {
+    char *pool; // NULL-terminated names, one after the other
+    size_t poolSize;
+    size_t poolCapacity;
+    uint32_t *names; // offsets in the pool
+    uint32_t numNames;
+    uint32_t capacity;
+    execindex_dir_t *dirs;
+    uint32_t numDirs;
+    uint32_t dirsCapacity;
+} execindex_build_t;
+
+static int execindex_addName(execindex_build_t *build, const char *name)
+{
+    size_t nameSize = strlen(name) + 1;
+    if (build->poolSize + nameSize > build->poolCapacity) {
+        size_t capacity = build->poolCapacity * 2 + nameSize + 4096;
+        char *pool = (char *)realloc(build->pool, capacity);
+        if (pool == NULL) {
+            return -1;
+        }
+        build->pool = pool;
+        build->poolCapacity = capacity;
+    }
+    if (build->numNames == build->capacity) {
+        uint32_t capacity = build->capacity * 2 + 256;
+        uint32_t *names =
+            (uint32_t *)realloc(build->names, sizeof(uint32_t) * capacity);
+        if (names == NULL) {
+            return -1;
+        }
+        build->names = names;
+        build->capacity = capacity;
+    }
+
+    build->names[build->numNames++] = build->poolSize;
+    memcpy(build->pool + build->poolSize, name, nameSize);
+    build->poolSize += nameSize;
+
+    return 0;
+}
+
+static int execindex_readDir(const char *dir, void *data)
+{
+    execindex_build_t *build = (execindex_build_t *)data;
+    if (build->numDirs == build->dirsCapacity) {
+        uint32_t capacity = build->dirsCapacity * 2 + 16;
+        execindex_dir_t *dirs = (execindex_dir_t *)realloc(
+            build->dirs, sizeof(execindex_dir_t) * capacity);
+        if (dirs == NULL) {
+            return -1;
+        }
+        build->dirs = dirs;
+        build->dirsCapacity = capacity;
+    }
+
+    // Before reading, a change while reading makes the index out of date
+    execindex_dir_t *entry = &build->dirs[build->numDirs++];
+    execindex_statDir(dir, entry);
+    DIR *stream = opendir(dir);
+    if (stream == NULL) {
+        memset(entry, 0, sizeof(execindex_dir_t));
+        return 0;
+    }
+
+    int result = 0;
+    struct dirent *it;
+    while (result == 0 && (it = readdir(stream)) != NULL) {
+        // Hidden files aren't commands anyone types
+        if (it->d_type == DT_DIR || it->d_name[0] == '.') {
+            continue;
+        }
+        // Symbolic links are followed, like execvp() would
+        struct stat fileStat;
+        if (fstatat(dirfd(stream), it->d_name, &fileStat, 0) == 0 &&
+            S_ISREG(fileStat.st_mode) && (fileStat.st_mode & 0111) != 0) {
+            result = execindex_addName(build, it->d_name);
+        }
+    }
+    closedir(stream);
+
+    return result;
+}
+
+static int execindex_compare(const void *a, const void *b, void *pool)
+{
+    return strcmp((const char *)pool + *(const uint32_t *)a,
+                  (const char *)pool + *(const uint32_t *)b);
+}
+
+// Lay out the index file in memory, returns it, NULL if out of memory
+static char *execindex_layout(execindex_build_t *build,
+                              const char *path,
+                              size_t *size)
+{
+    qsort_r(build->names, build->numNames, sizeof(uint32_t),
+            &execindex_compare, build->pool);
+    // A name in several directories is completed once
+    uint32_t numNames = 0;
+    for (uint32_t i = 0; i < build->numNames; ++i) {
+        if (numNames == 0 ||
+            strcmp(build->pool + build->names[numNames - 1],
+                   build->pool + build->names[i]) != 0) {
+            build->names[numNames++] = build->names[i];
+        }
+    }
+    build->numNames = numNames;
+
+    size_t pathLen = strlen(path);
+    size_t dirsOffset =
+        EXECINDEX_ALIGN(sizeof(execindex_header_t) + pathLen + 1);
+    size_t namesOffset = dirsOffset + sizeof(execindex_dir_t) * build->numDirs;
+    size_t poolOffset = namesOffset + sizeof(uint32_t) * numNames;
+    *size = poolOffset + build->poolSize;
+    if (*size > UINT32_MAX) {
+        return NULL;
+    }
+
+    char *index = (char *)calloc(1, *size);
+    if (index == NULL) {
+        return NULL;
+    }
+    execindex_header_t *header = (execindex_header_t *)index;
+    memcpy(header->magic, EXECINDEX_MAGIC, sizeof(header->magic));
+    header->size = *size;
+    header->builtSec = time(NULL);
+    header->pathLen = pathLen;
+    header->numDirs = build->numDirs;
+    header->numNames = numNames;
+    memcpy(index + sizeof(execindex_header_t), path, pathLen + 1);
+    memcpy(index + dirsOffset, build->dirs,
+           sizeof(execindex_dir_t) * build->numDirs);
+    uint32_t *names = (uint32_t *)(index + namesOffset);
+    for (uint32_t i = 0; i < numNames; ++i) {
+        names[i] = poolOffset + build->names[i];
+    }
+    memcpy(index + poolOffset, build->pool, build->poolSize);
+
+    return index;
+}
+
+// Write the index to a temporary file renamed to 'file', returns 0 if
+// successful
+static int execindex_save(const char *file, const char *index, size_t size)
+{
+    size_t fileLen = strlen(file);
+    char temporary[fileLen + sizeof(".XXXXXX")];
+    memcpy(temporary, file, fileLen);
+    memcpy(temporary + fileLen, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int fd = mkostemp(temporary, O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t numWritten = 0;
+    while (numWritten < size) {
+        ssize_t result = write(fd, index + numWritten, size - numWritten);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            break;
+        }
+        numWritten += result;
+    }
+    close(fd);
+
+    if (numWritten != size || rename(temporary, file) != 0) {
+        unlink(temporary);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Read the PATH directories into a new index, saved to 'file' for the other
+// shells. Returns 0 if successful, -1 if out of memory.
+static int execindex_build(const char *file, const char *path)
+{
+    execindex_build_t build;
+    memset(&build, 0, sizeof(build));
+
+    char *index = NULL;
+    size_t size = 0;
+    if (execindex_forEachDir(path, &execindex_readDir, &build) == 0) {
+        index = execindex_layout(&build, path, &size);
+    }
+    free(build.pool);
+    free(build.names);
+    free(build.dirs);
+    if (index == NULL) {
+        return -1;
+    }
+
+    // Without a file to share, the index is still good for this shell
+    execindex_save(file, index, size);
+    execindex_use(index, size, 0);
+
+    return 0;
+}
+
+// Make sure the index is up to date, returns 0 if successful, -1 otherwise
+static int execindex_sync()
+{
+    const char *path = variable_get("PATH");
+    if (path == NULL) {
+        // Same default as execvp()
+        path = "/bin:/usr/bin";
+    }
+
+    if (execindex_map != NULL &&
+        execindex_isValid(execindex_map, execindex_mapSize, path)) {
+        return 0;
+    }
+    execindex_clear();
+
+    char *file = execindex_file(path);
+    if (file == NULL) {
+        return -1;
+    }
+    // Another shell may have rebuilt it already
+    int result = execindex_open(file, path);
+    if (result != 0) {
+        result = execindex_build(file, path);
+    }
+    free(file);
+
+    return result;
+}
+
+// Index of the first name for which strncmp(name, prefix, prefixLen) >= 0,
+// or > 0 if 'after' is 1
+static uint32_t execindex_bound(const char *prefix, size_t prefixLen, int after)
+{
+    uint32_t low = 0;
+    uint32_t high = execindex_numNames;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int order = strncmp(execindex_map + execindex_names[middle], prefix,
+                            prefixLen);
+        if (order < 0 || (after && order == 0)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+int execindex_find(const char *prefix, size_t *first)
+{
+    if (execindex_sync() != 0) {
+        return -1;
+    }
+
+    size_t prefixLen = strlen(prefix);
+    uint32_t low = execindex_bound(prefix, prefixLen, 0);
+    uint32_t high = execindex_bound(prefix, prefixLen, 1);
+    *first = low;
+
+    return high - low;
+}
+
+const char *execindex_name(size_t i)
+{
+    return execindex_map + execindex_names[i];
+}
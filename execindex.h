@@ -0,0 +1,41 @@
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Index of the executables in PATH, for completing command names.
+///
+/// The index is a sorted array of names in a file shared by every shell of
+/// the user with the same PATH:
+///
+///     $XDG_RUNTIME_DIR/sane-exec-<hash of PATH>, or
+///     $TMPDIR/sane-exec-<uid>-<hash of PATH> (/tmp by default)
+///
+/// It's mmap'd, so completing a name is a binary search rather than reading
+/// every PATH directory, which on some hosts holds 20k+ binaries. The file
+/// records the device, inode and mtime of each PATH directory it was built
+/// from; a lookup checks them with one stat() per directory and rebuilds the
+/// index if any changed. A shell that finds the file out of date first looks
+/// for a newer file written by another shell, then rebuilds it in a temporary
+/// file renamed over the old one, so readers always see a complete index.
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the executables whose name starts with a prefix.
+///
+/// @param   prefix   const char *, NULL-terminated prefix, "" for all names.
+/// @param   first    size_t *, set to the index of the first name found.
+/// @return           int, number of names found (names 'first' to 'first' +
+///                   count - 1 of execindex_name()), -1 if the index could not
+///                   be built or mapped.
+////////////////////////////////////////////////////////////////////////////////
+int execindex_find(const char *prefix, size_t *first);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   i   size_t, index of a name, in sorted order.
+/// @return      const char *, the name, valid until the next execindex_find().
+////////////////////////////////////////////////////////////////////////////////
+const char *execindex_name(size_t i);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Unmap the index.
+////////////////////////////////////////////////////////////////////////////////
+void execindex_clear();
@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fastcopy.h"
+
+// Largest amount of data moved by a single system call, small enough that a
+// signal doesn't have to wait for a whole file
+#define FASTCOPY_CHUNK (1 << 20)
+// Size of the buffer used by the read()/write() fallback
+#define FASTCOPY_BUFFER_SIZE (128 * 1024)
+
+// Number of writes in a row after which a pipe was still full that make it
+// grow, see fastcopy_setGrowPipes()
+#define FASTCOPY_FULL_WRITES 4
+
+// Ways of copying, tried in this order until one is supported
+#define FASTCOPY_COPY_FILE_RANGE 0
+#define FASTCOPY_SENDFILE 1
+#define FASTCOPY_SPLICE 2
+#define FASTCOPY_READ_WRITE 3
+
+static int fastcopy_growPipes = 0;
+
+void fastcopy_setGrowPipes(int grow)
+{
+    fastcopy_growPipes = grow;
+}
+
+// Called after each write to the pipe 'fd', doubles its capacity once it has
+// been full after FASTCOPY_FULL_WRITES writes in a row, i.e. its reader
+// doesn't keep up. 'numFull' counts the writes. Returns 0 once the pipe can't
+// grow any more.
+static int fastcopy_grow(int fd, int *numFull)
+{
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    int used;
+    if (size < 0 || ioctl(fd, FIONREAD, &used) != 0) {
+        return 0;
+    }
+
+    if (used < size) {
+        *numFull = 0;
+    } else if (++*numFull == FASTCOPY_FULL_WRITES) {
+        *numFull = 0;
+        // Fails past /proc/sys/fs/pipe-max-size
+        return fcntl(fd, F_SETPIPE_SZ, size * 2) >= 0;
+    }
+
+    return 1;
+}
+
+// Returns 1 if the error means the method isn't supported for these files and
+// the next one should be tried
+static int fastcopy_unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV ||
+           err == EOPNOTSUPP || err == ESPIPE ||
+           err == EBADF; // copy_file_range() refuses O_APPEND outputs
+}
+
+// Write all of the buffer, returns 0 if successful, -1 on error
+static int fastcopy_writeAll(int fd, const char *buffer, size_t size)
+{
+    while (size > 0) {
+        ssize_t numWritten = write(fd, buffer, size);
+        if (numWritten < 0) {
+            return -1;
+        }
+        buffer += numWritten;
+        size -= numWritten;
+    }
+
+    return 0;
+}
+
+// 'grow' is 1 if 'out' is a pipe to grow with fastcopy_grow()
+static int fastcopy_readWrite(int in, int out, int grow)
+{
+    char *buffer = (char *)malloc(FASTCOPY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    int result = 0;
+    int numFull = 0;
+    ssize_t numRead;
+    while ((numRead = read(in, buffer, FASTCOPY_BUFFER_SIZE)) != 0) {
+        if (numRead < 0 || fastcopy_writeAll(out, buffer, numRead) != 0) {
+            result = -1;
+            break;
+        }
+        if (grow) {
+            grow = fastcopy_grow(out, &numFull);
+        }
+    }
+
+    int err = errno;
+    free(buffer);
+    errno = err;
+
+    return result;
+}
+
+// Copy with the given method, returns 0 when the end of 'in' is reached, -1 on
+// error
+static int fastcopy_with(int method, int in, int out, int grow)
+{
+    if (method == FASTCOPY_READ_WRITE) {
+        return fastcopy_readWrite(in, out, grow);
+    }
+
+    int numFull = 0;
+    while (1) {
+        ssize_t numCopied;
+        if (method == FASTCOPY_COPY_FILE_RANGE) {
+            numCopied =
+                copy_file_range(in, NULL, out, NULL, FASTCOPY_CHUNK, 0);
+        } else if (method == FASTCOPY_SENDFILE) {
+            numCopied = sendfile(out, in, NULL, FASTCOPY_CHUNK);
+        } else {
+            numCopied = splice(in, NULL, out, NULL, FASTCOPY_CHUNK,
+                               SPLICE_F_MOVE | SPLICE_F_MORE);
+        }
+
+        if (numCopied == 0) {
+            return 0;
+        } else if (numCopied < 0) {
+            return -1;
+        }
+        if (grow) {
+            grow = fastcopy_grow(out, &numFull);
+        }
+    }
+}
+
+int fastcopy_fd(int in, int out)
+{
+    struct stat inStat, outStat;
+    if (fstat(in, &inStat) != 0 || fstat(out, &outStat) != 0) {
+        return -1;
+    }
+
+    int method = FASTCOPY_READ_WRITE;
+    if (S_ISREG(inStat.st_mode) && S_ISREG(outStat.st_mode)) {
+        method = FASTCOPY_COPY_FILE_RANGE;
+    } else if (S_ISREG(inStat.st_mode)) {
+        method = FASTCOPY_SENDFILE;
+    } else if (S_ISFIFO(inStat.st_mode) || S_ISFIFO(outStat.st_mode)) {
+        method = FASTCOPY_SPLICE;
+    }
+
+    int grow = fastcopy_growPipes && S_ISFIFO(outStat.st_mode);
+
+    // All methods copy from the current offsets and advance them, so a method
+    // failing part way through leaves the rest for the next one
+    for (; method < FASTCOPY_READ_WRITE; ++method) {
+        if (method == FASTCOPY_SPLICE && !S_ISFIFO(inStat.st_mode) &&
+            !S_ISFIFO(outStat.st_mode)) {
+            continue;
+        }
+        if (fastcopy_with(method, in, out, grow) == 0) {
+            return 0;
+        } else if (!fastcopy_unsupported(errno)) {
+            return -1;
+        }
+    }
+
+    return fastcopy_readWrite(in, out, grow);
+}
+
+// tee() the input pipe into the first output, then splice() the same data
+// into the second one. Returns 0 at the end of the input, -1 on error.
+static int fastcopy_teeSplice(int in, const int *out, int *failed)
+{
+    char buffer[4096];
+
+    while (1) {
+        ssize_t numCopied = tee(in, out[0], FASTCOPY_CHUNK, 0);
+        if (numCopied == 0) {
+            return 0;
+        } else if (numCopied < 0) {
+            return -1;
+        }
+
+        // Consume what was duplicated, into the second output or nowhere once
+        // writing to it failed
+        size_t left = numCopied;
+        while (left > 0) {
+            ssize_t numMoved;
+            if (!failed[1]) {
+                numMoved = splice(in, NULL, out[1], NULL, left, SPLICE_F_MOVE);
+                if (numMoved < 0 && errno != EINTR) {
+                    failed[1] = 1;
+                    continue;
+                }
+            } else {
+                numMoved = read(
+                    in, buffer, left < sizeof(buffer) ? left : sizeof(buffer));
+            }
+            if (numMoved < 0) {
+                return -1;
+            }
+            left -= numMoved;
+        }
+    }
+}
+
+// Returns 1 if splice() can write to the file
+static int fastcopy_canSplice(int fd)
+{
+    struct stat fdStat;
+    if (fstat(fd, &fdStat) != 0) {
+        return 0;
+    }
+
+    return S_ISFIFO(fdStat.st_mode) ||
+           (S_ISREG(fdStat.st_mode) && !(fcntl(fd, F_GETFL) & O_APPEND));
+}
+
+int fastcopy_tee(int in, const int *out, int numOut, int *failed)
+{
+    if (numOut == 1 && !failed[0]) {
+        if (fastcopy_fd(in, out[0]) == 0) {
+            return 0;
+        } else if (errno != EPIPE) {
+            return -1;
+        }
+        failed[0] = 1;
+    } else if (numOut == 2 && !failed[0] && !failed[1]) {
+        struct stat inStat, outStat;
+        if (fstat(in, &inStat) == 0 && fstat(out[0], &outStat) == 0 &&
+            S_ISFIFO(inStat.st_mode) && S_ISFIFO(outStat.st_mode) &&
+            fastcopy_canSplice(out[1])) {
+            if (fastcopy_teeSplice(in, out, failed) == 0) {
+                return 0;
+            } else if (errno != EPIPE) {
+                return -1;
+            }
+            // Nothing is left half copied when tee() fails, continue without
+            // the first output
+            failed[0] = 1;
+        }
+    }
+
+    char *buffer = (char *)malloc(FASTCOPY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    int result = 0;
+    ssize_t numRead;
+    while ((numRead = read(in, buffer, FASTCOPY_BUFFER_SIZE)) != 0) {
+        if (numRead < 0) {
+            result = -1;
+            break;
+        }
+        for (int i = 0; i < numOut; ++i) {
+            if (!failed[i] && fastcopy_writeAll(out[i], buffer, numRead) != 0) {
+                failed[i] = 1;
+            }
+        }
+    }
+
+    int err = errno;
+    free(buffer);
+    errno = err;
+
+    return result;
+}
@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copy data between file descriptors without passing it through user space
+/// where the kernel allows it:
+///
+///  - copy_file_range() between regular files,
+///  - sendfile() from a regular file to anything,
+///  - splice() to or from a pipe,
+///  - read()/write() otherwise, or if the above aren't supported for the
+///    given files.
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+/// Copy everything that can be read from 'in' to 'out', starting at their
+/// current offsets.
+///
+/// @param   in    int, file descriptor to read from.
+/// @param   out   int, file descriptor to write to.
+/// @return        int, 0 if successful, -1 on error (errno is set, EINTR if
+///                interrupted by a signal).
+////////////////////////////////////////////////////////////////////////////////
+int fastcopy_fd(int in, int out);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Copy everything that can be read from 'in' to each of the given outputs,
+/// like tee. With a single output this is fastcopy_fd(). If 'in' and the first
+/// of two outputs are pipes, the data is duplicated with tee() and moved to the
+/// second one with splice().
+///
+/// @param   in       int, file descriptor to read from.
+/// @param   out      const int *, file descriptors to write to.
+/// @param   numOut   int, number of file descriptors in out.
+/// @param   failed   int *, one flag per output, 0 on entry. Set to 1 for each
+///                   output that could not be written to, writing to the
+///                   others continues.
+/// @return           int, 0 if successful, -1 if reading failed (errno is
+///                   set).
+////////////////////////////////////////////////////////////////////////////////
+int fastcopy_tee(int in, const int *out, int numOut, int *failed);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Grow pipes written to by fastcopy_fd() when they stay full, i.e. their
+/// reader is slower than the copy, so both sides are woken up less often.
+///
+/// @param   grow   int, 1 to grow pipes, 0 to leave them as they are.
+////////////////////////////////////////////////////////////////////////////////
+void fastcopy_setGrowPipes(int grow);
@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "history.h"
+
+// Blocks of the history with lines containing a trigram
+typedef struct history_blocks_t {
+    uint32_t *blocks; // in increasing order
+    uint32_t length;
+    uint32_t capacity;
+} history_blocks_t;
+
+// Path of the history file, NULL if history is off, looked up on first use
+static char *history_path = NULL;
+static int history_pathKnown = 0;
+
+// Descriptor of the history file and its identity, to notice it was replaced
+static int history_fd = -1;
+static dev_t history_dev;
+static ino_t history_ino;
+
+// Mapping of the history file
+static char *history_map = NULL;
+static size_t history_mapSize = 0;
+// Offset one past the last complete line in the mapping
+static size_t history_end = 0;
+
+// HISTORY_NUM_BUCKETS lists of blocks, NULL until the first search needing it
+static history_blocks_t *history_index = NULL;
+// Offset up to which lines are indexed
+static size_t history_indexed = 0;
+
+static const char *history_file()
+{
+    if (!history_pathKnown) {
+        history_pathKnown = 1;
+        const char *path = getenv("SANE_HISTORY");
+        const char *home = getenv("HOME");
+        if (path == NULL && home != NULL) {
+            if (asprintf(&history_path, "%s/.sane_history", home) == -1) {
+                history_path = NULL;
+            }
+        } else if (path != NULL && *path != '\0') {
+            history_path = strdup(path);
+        }
+    }
+
+    return history_path;
+}
+
+// Open the history file if it isn't open yet, returns 0 if successful, 1 if
+// history is off, -1 on error
+static int history_open()
+{
+    if (history_fd != -1) {
+        return 0;
+    }
+    const char *path = history_file();
+    if (path == NULL) {
+        return 1;
+    }
+
+    history_fd =
+        open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (history_fd == -1) {
+        return -1;
+    }
+    struct stat fileStat;
+    if (fstat(history_fd, &fileStat) != 0) {
+        int err = errno;
+        close(history_fd);
+        history_fd = -1;
+        errno = err;
+        return -1;
+    }
+    history_dev = fileStat.st_dev;
+    history_ino = fileStat.st_ino;
+
+    return 0;
+}
+
+static void history_freeIndex()
+{
+    if (history_index != NULL) {
+        for (int i = 0; i < HISTORY_NUM_BUCKETS; ++i) {
+            free(history_index[i].blocks);
+        }
+        free(history_index);
+        history_index = NULL;
+    }
+    history_indexed = 0;
+}
+
+// Forget the mapping and the index, the history file stays open
+static void history_unmap()
+{
+    if (history_map != NULL) {
+        munmap(history_map, history_mapSize);
+    }
+    history_map = NULL;
+    history_mapSize = 0;
+    history_end = 0;
+    history_freeIndex();
+}
+
+int history_add(const char *line, size_t length)
+{
+    if (length == 0) {
+        return 0;
+    }
+    int result = history_open();
+    if (result != 0) {
+        return result == 1 ? 0 : -1;
+    }
+
+    // A single write, appended as a whole even if other shells append too
+    struct iovec iov[2] = {{(void *)line, length}, {"\n", 1}};
+    ssize_t numWritten = writev(history_fd, iov, 2);
+    if (numWritten != (ssize_t)length + 1) {
+        if (numWritten >= 0) {
+            errno = ENOSPC;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+// Map what was appended to the history file since the last call, returns 0 if
+// successful, 1 if history is off, -1 on error
+static int history_sync()
+{
+    int result = history_open();
+    if (result != 0) {
+        return result;
+    }
+
+    // Start over if the file was replaced (e.g. rotated) or truncated
+    struct stat fileStat;
+    if (stat(history_path, &fileStat) == 0 &&
+        (fileStat.st_dev != history_dev || fileStat.st_ino != history_ino)) {
+        history_unmap();
+        close(history_fd);
+        history_fd = -1;
+        if (history_open() != 0) {
+            return -1;
+        }
+    }
+    if (fstat(history_fd, &fileStat) != 0) {
+        return -1;
+    }
+    size_t size = fileStat.st_size;
+    if (size < history_end) {
+        history_unmap();
+    }
+    if (size == history_mapSize) {
+        return 0;
+    }
+
+    // The pages are only read when searched
+    char *map = NULL;
+    if (size > 0) {
+        map = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, history_fd, 0);
+        if (map == MAP_FAILED) {
+            return -1;
+        }
+    }
+    if (history_map != NULL) {
+        munmap(history_map, history_mapSize);
+    }
+    history_map = map;
+    history_mapSize = size;
+
+    // Another shell may be in the middle of appending a line
+    const char *newline = (const char *)memrchr(
+        history_map + history_end, '\n', history_mapSize - history_end);
+    if (newline != NULL) {
+        history_end = newline + 1 - history_map;
+    }
+
+    return 0;
+}
+
+static uint32_t history_hash(const char *it)
+{
+    uint32_t trigram = (unsigned char)it[0] << 16 |
+                       (unsigned char)it[1] << 8 | (unsigned char)it[2];
+
+    return ((trigram * 2654435761u) >> 8) % HISTORY_NUM_BUCKETS;
+}
+
+// Add a block to a list unless it's already the last one, returns 0 if
+// successful, -1 if out of memory
+static int history_addBlock(history_blocks_t *list, uint32_t block)
+{
+    if (list->length > 0 && list->blocks[list->length - 1] == block) {
+        return 0;
+    }
+
+    if (list->length == list->capacity) {
+        uint32_t capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+        uint32_t *blocks = (uint32_t *)realloc(
+            list->blocks, sizeof(uint32_t) * capacity);
+        if (blocks == NULL) {
+            return -1;
+        }
+        list->blocks = blocks;
+        list->capacity = capacity;
+    }
+    list->blocks[list->length++] = block;
+
+    return 0;
+}
+
+// Index the lines mapped since the last call, returns 0 if successful, -1 if
+// out of memory
+static int history_indexLines()
+{
+    if (history_index == NULL) {
+        history_index = (history_blocks_t *)calloc(HISTORY_NUM_BUCKETS,
+                                                   sizeof(history_blocks_t));
+        if (history_index == NULL) {
+            return -1;
+        }
+    }
+
+    const char *it = history_map + history_indexed;
+    const char *end = history_map + history_end;
+    while (it < end) {
+        const char *newline = (const char *)memchr(it, '\n', end - it);
+        uint32_t block = (it - history_map) / HISTORY_BLOCK_SIZE;
+        for (const char *trigram = it; trigram + 3 <= newline; ++trigram) {
+            if (history_addBlock(&history_index[history_hash(trigram)],
+                                 block) != 0) {
+                // A partial index would miss lines, build it again next time
+                history_freeIndex();
+                errno = ENOMEM;
+                return -1;
+            }
+        }
+        it = newline + 1;
+    }
+    history_indexed = history_end;
+
+    return 0;
+}
+
+// Number of blocks in the list up to and including 'block'
+static uint32_t history_upperBound(const history_blocks_t *list, uint32_t block)
+{
+    uint32_t low = 0;
+    uint32_t high = list->length;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (list->blocks[middle] <= block) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+// Offset of the most recent line of a block starting before 'before' and
+// containing the text, -1 if there is none
+static off_t history_scanBlock(uint32_t block,
+                               size_t before,
+                               const char *text,
+                               size_t textLen)
+{
+    size_t start = (size_t)block * HISTORY_BLOCK_SIZE;
+    size_t end = start + HISTORY_BLOCK_SIZE;
+    if (end > before) {
+        end = before;
+    }
+    // Skip the end of a line starting in the previous block
+    if (start > 0 && start < end && history_map[start - 1] != '\n') {
+        const char *newline = (const char *)memchr(
+            history_map + start, '\n', history_end - start);
+        start = newline + 1 - history_map;
+    }
+
+    off_t found = -1;
+    while (start < end) {
+        const char *line = history_map + start;
+        const char *newline =
+            (const char *)memchr(line, '\n', history_end - start);
+        if (memmem(line, newline - line, text, textLen) != NULL) {
+            found = start;
+        }
+        start = newline + 1 - history_map;
+    }
+
+    return found;
+}
+
+// Offset of the most recent line starting before 'before' and containing the
+// text, -1 if there is none, -2 if out of memory
+static off_t history_find(const char *text, size_t before)
+{
+    if (before == 0) {
+        return -1;
+    }
+    size_t textLen = strlen(text);
+    uint32_t last = (before - 1) / HISTORY_BLOCK_SIZE;
+
+    // Shorter texts have no trigram, every block is a candidate
+    if (textLen < 3) {
+        for (uint32_t block = last + 1; block-- > 0;) {
+            off_t found = history_scanBlock(block, before, text, textLen);
+            if (found >= 0) {
+                return found;
+            }
+        }
+        return -1;
+    }
+
+    if (history_indexLines() != 0) {
+        return -2;
+    }
+
+    // Candidates come from the shortest list and must be in the others
+    const history_blocks_t *shortest = NULL;
+    for (size_t i = 0; i + 3 <= textLen; ++i) {
+        const history_blocks_t *list = &history_index[history_hash(text + i)];
+        if (shortest == NULL || list->length < shortest->length) {
+            shortest = list;
+        }
+    }
+
+    for (uint32_t k = history_upperBound(shortest, last); k-- > 0;) {
+        uint32_t block = shortest->blocks[k];
+        int candidate = 1;
+        for (size_t i = 0; i + 3 <= textLen && candidate; ++i) {
+            const history_blocks_t *list =
+                &history_index[history_hash(text + i)];
+            uint32_t bound = history_upperBound(list, block);
+            candidate = bound > 0 && list->blocks[bound - 1] == block;
+        }
+        if (candidate) {
+            off_t found = history_scanBlock(block, before, text, textLen);
+            if (found >= 0) {
+                return found;
+            }
+        }
+    }
+
+    return -1;
+}
+
+off_t history_search(const char *text,
+                     off_t before,
+                     const char **line,
+                     size_t *length)
+{
+    int result = history_sync();
+    if (result != 0) {
+        return result == 1 ? -1 : -2;
+    }
+
+    if (before < 0 || (size_t)before > history_end) {
+        before = history_end;
+    }
+    off_t found = history_find(text, before);
+    if (found >= 0) {
+        *line = history_map + found;
+        *length = (const char *)memchr(*line, '\n', history_end - found) -
+                  *line;
+    }
+
+    return found;
+}
+
+int history_print(FILE *stream, const char *text, int count)
+{
+    int result = history_sync();
+    if (result != 0 || count <= 0) {
+        return result == -1 ? -1 : 0;
+    }
+
+    off_t *found = (off_t *)malloc(sizeof(off_t) * count);
+    if (found == NULL) {
+        return -1;
+    }
+    int numFound = 0;
+    off_t before = history_end;
+    while (numFound < count &&
+           (before = history_find(text, before)) >= 0) {
+        found[numFound++] = before;
+    }
+
+    // Oldest first, the most recent entry ends up next to the prompt
+    for (int i = numFound - 1; i >= 0; --i) {
+        const char *line = history_map + found[i];
+        const char *newline =
+            (const char *)memchr(line, '\n', history_end - found[i]);
+        fwrite(line, 1, newline + 1 - line, stream);
+    }
+    free(found);
+
+    if (before == -2) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+void history_clear()
+{
+    history_unmap();
+    if (history_fd != -1) {
+        close(history_fd);
+        history_fd = -1;
+    }
+    free(history_path);
+    history_path = NULL;
+    history_pathKnown = 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <sys/types.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Persistent history of the lines run by interactive shells (see the
+/// 'history' builtin), kept in the file named by SANE_HISTORY, by default
+/// ~/.sane_history. An empty SANE_HISTORY turns history off.
+///
+/// The file is append-only, one line per entry. Each entry is appended with a
+/// single O_APPEND write, so shells sharing the file never interleave their
+/// entries. Nothing is read at startup: the file is only opened for the first
+/// append or search, and mmap'd rather than read, so startup doesn't depend on
+/// the size of the history.
+///
+/// Searches go through an in-memory trigram index built on the first search.
+/// The file is split in HISTORY_BLOCK_SIZE blocks, and each of
+/// HISTORY_NUM_BUCKETS hashed trigrams lists the blocks with lines containing
+/// it. Only the blocks listed for every trigram of the text searched for are
+/// scanned. Entries appended since the last search, by this shell or others,
+/// are mapped and indexed when the next search starts.
+////////////////////////////////////////////////////////////////////////////////
+
+// Bytes of history per block of the index, lines belong to the block they
+// start in
+#define HISTORY_BLOCK_SIZE 32768
+// Number of lists of blocks, trigrams are hashed to one of them
+#define HISTORY_NUM_BUCKETS 65536
+
+////////////////////////////////////////////////////////////////////////////////
+/// Append an entry to the history.
+///
+/// @param   line     const char *, line to append, without a newline.
+/// @param   length   size_t, length of the line.
+/// @return           int, 0 if successful or history is off, -1 if the
+///                   history file could not be written (errno is set).
+////////////////////////////////////////////////////////////////////////////////
+int history_add(const char *line, size_t length);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the most recent entry containing some text, before a given entry.
+///
+/// @param   text     const char *, NULL-terminated text to search for, the
+///                   empty string matches every entry.
+/// @param   before   off_t, offset of the entry to search before, -1 to
+///                   search the whole history.
+/// @param   line     const char **, set to the entry found, not
+///                   NULL-terminated, valid until the next search.
+/// @param   length   size_t *, set to the length of the entry.
+/// @return           off_t, offset of the entry, pass it as 'before' to find
+///                   the next older one, -1 if no entry matched, -2 if the
+///                   history could not be read or indexed (errno is set).
+////////////////////////////////////////////////////////////////////////////////
+off_t history_search(const char *text,
+                     off_t before,
+                     const char **line,
+                     size_t *length);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the most recent entries containing some text, oldest first.
+///
+/// @param   stream   FILE *, stream to print to.
+/// @param   text     const char *, text to search for, "" for every entry.
+/// @param   count    int, maximum number of entries to print.
+/// @return           int, 0 if successful, -1 if the history could not be
+///                   read or indexed (errno is set).
+////////////////////////////////////////////////////////////////////////////////
+int history_print(FILE *stream, const char *text, int count);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Unmap the history, release the index and close the history file.
+////////////////////////////////////////////////////////////////////////////////
+void history_clear();
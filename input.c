@@ -0,0 +1,137 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "input.h"
+
+// Number of bytes requested from the file descriptor per read()
+#define INPUT_BLOCK_SIZE (64 * 1024)
+
+static void input_init(input_t *input, int fd, int closeFd)
+{
+    input->fd = fd;
+    input->closeFd = closeFd;
+    input->eof = 0;
+    input->buffer = NULL;
+    input->size = 0;
+    input->start = 0;
+    input->end = 0;
+    input->scanned = 0;
+    input->lineNum = 0;
+}
+
+int input_openFd(input_t *input, int fd, int closeFd)
+{
+    input_init(input, fd, closeFd);
+
+    // Leave room for the terminating NULL
+    input->buffer = (char *)malloc(INPUT_BLOCK_SIZE + 1);
+    if (input->buffer == NULL) {
+        return -1;
+    }
+    input->size = INPUT_BLOCK_SIZE + 1;
+    input->buffer[0] = '\0';
+
+    return 0;
+}
+
+int input_openString(input_t *input, const char *str)
+{
+    input_init(input, -1, 0);
+
+    input->buffer = strdup(str);
+    if (input->buffer == NULL) {
+        return -1;
+    }
+    input->end = strlen(str);
+    input->size = input->end + 1;
+    input->eof = 1;
+
+    return 0;
+}
+
+// Read the next block of input into the buffer, making room as needed.
+// Returns number of bytes read, 0 at end of input, -1 on error.
+static ssize_t input_fill(input_t *input)
+{
+    // Move the partial line to the front of the buffer
+    if (input->start > 0) {
+        memmove(input->buffer, input->buffer + input->start,
+                input->end - input->start);
+        input->end -= input->start;
+        input->scanned -= input->start;
+        input->start = 0;
+    }
+
+    // Line is longer than the buffer, grow it
+    if (input->size - 1 - input->end < INPUT_BLOCK_SIZE / 2) {
+        size_t size = input->size * 2;
+        char *buffer = (char *)realloc(input->buffer, size);
+        if (buffer == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        input->buffer = buffer;
+        input->size = size;
+    }
+
+    ssize_t numRead;
+    do {
+        numRead = read(input->fd, input->buffer + input->end,
+                       input->size - 1 - input->end);
+    } while (numRead == -1 && errno == EINTR);
+
+    if (numRead > 0) {
+        input->end += numRead;
+        input->buffer[input->end] = '\0';
+    }
+
+    return numRead;
+}
+
+ssize_t input_readLine(input_t *input, char **line)
+{
+    char *newline;
+    while ((newline = (char *)memchr(input->buffer + input->scanned, '\n',
+                                     input->end - input->scanned)) == NULL) {
+        input->scanned = input->end;
+
+        if (!input->eof) {
+            ssize_t numRead = input_fill(input);
+            if (numRead == -1) {
+                return -2;
+            } else if (numRead == 0) {
+                input->eof = 1;
+            }
+        } else if (input->start < input->end) {
+            // Last line isn't followed by a newline
+            newline = input->buffer + input->end;
+            break;
+        } else {
+            return -1;
+        }
+    }
+
+    *newline = '\0';
+    *line = input->buffer + input->start;
+    ssize_t len = newline - *line;
+
+    input->start = input->scanned = newline - input->buffer;
+    if (input->start < input->end) {
+        input->start = ++input->scanned;
+    }
+    ++input->lineNum;
+
+    return len;
+}
+
+void input_close(input_t *input)
+{
+    if (input->closeFd) {
+        close(input->fd);
+    }
+    free(input->buffer);
+
+    input_init(input, -1, 0);
+}
@@ -0,0 +1,57 @@
+#include <stddef.h>
+#include <sys/types.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Line reader for shell input. Input is read in large blocks and split into
+/// lines in place, so reading a script costs a read() per block rather than
+/// per line.
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct input_t {
+    int fd;         // file descriptor read from
+    int closeFd;    // 1 if fd should be closed by input_close()
+    int eof;        // 1 once the end of input was reached
+    char *buffer;   // input read but not yet returned, NULL-terminated
+    size_t size;    // number of bytes allocated for buffer
+    size_t start;   // offset of the first byte not yet returned
+    size_t end;     // offset one past the last byte read
+    size_t scanned; // offset up to which no newline was found
+    size_t lineNum; // number of the last line returned, starting at 1
+} input_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Read input from a file descriptor.
+///
+/// @param   input     input_t *, reader to initialize.
+/// @param   fd        int, file descriptor to read from.
+/// @param   closeFd   int, 1 if fd should be closed by input_close().
+/// @return            int, 0 on success, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int input_openFd(input_t *input, int fd, int closeFd);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Read input from a string, e.g. the argument of 'sane -c'.
+///
+/// @param   input   input_t *, reader to initialize.
+/// @param   str     const char *, NULL-terminated input, copied.
+/// @return          int, 0 on success, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int input_openString(input_t *input, const char *str);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Get the next line of input, without its newline. Interrupted reads are
+/// retried.
+///
+/// @param   input   input_t *, reader to read from.
+/// @param   line    char **, set to the line, valid until the next call.
+/// @return          ssize_t, length of the line, -1 at end of input, -2 if
+///                  reading failed (errno is set) or out of memory.
+////////////////////////////////////////////////////////////////////////////////
+ssize_t input_readLine(input_t *input, char **line);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release the reader's buffer, and close its file descriptor if requested.
+///
+/// @param   input   input_t *, reader to close.
+////////////////////////////////////////////////////////////////////////////////
+void input_close(input_t *input);
@@ -0,0 +1,452 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "job.h"
+
+// Jobs in order of creation
+static job_t *job_head = NULL;
+static job_t *job_tail = NULL;
+
+// signalfd receiving SIGCHLD and the epoll instance watching it
+static int job_signalFd = -1;
+static int job_epollFd = -1;
+
+// Number of background jobs with processes still running
+static int job_numBackground = 0;
+
+// Called after children were reaped, see job_setReapHandler()
+static void (*job_reapHandler)() = NULL;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Process table, maps the pid of every running child to its job. Open
+/// addressing with linear probing, entries are removed by shifting later
+/// entries of the same run back so no tombstones are needed.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct job_slot_t {
+    pid_t pid; // 0 if the slot is empty
+    job_t *job;
+    int index; // index of the process in the job
+} job_slot_t;
+
+static job_slot_t *job_slots = NULL;
+static size_t job_numSlots = 0; // always a power of two
+static size_t job_numPids = 0;
+
+static size_t job_slotOf(pid_t pid)
+{
+    // Multiplicative hash, pids are mostly sequential
+    return ((unsigned long)pid * 2654435761UL) & (job_numSlots - 1);
+}
+
+static int job_putPid(pid_t pid, job_t *job, int index)
+{
+    // Keep the table at most half full
+    if ((job_numPids + 1) * 2 > job_numSlots) {
+        size_t oldNumSlots = job_numSlots;
+        job_slot_t *oldSlots = job_slots;
+
+        size_t numSlots = (oldNumSlots > 0) ? oldNumSlots * 2 : 64;
+        job_slot_t *slots =
+            (job_slot_t *)calloc(numSlots, sizeof(job_slot_t));
+        if (slots == NULL) {
+            return -1;
+        }
+        job_slots = slots;
+        job_numSlots = numSlots;
+
+        for (size_t i = 0; i < oldNumSlots; ++i) {
+            if (oldSlots[i].pid != 0) {
+                size_t j = job_slotOf(oldSlots[i].pid);
+                while (job_slots[j].pid != 0) {
+                    j = (j + 1) & (job_numSlots - 1);
+                }
+                job_slots[j] = oldSlots[i];
+            }
+        }
+        free(oldSlots);
+    }
+
+    size_t i = job_slotOf(pid);
+    while (job_slots[i].pid != 0) {
+        i = (i + 1) & (job_numSlots - 1);
+    }
+    job_slots[i].pid = pid;
+    job_slots[i].job = job;
+    job_slots[i].index = index;
+    ++job_numPids;
+
+    return 0;
+}
+
+// Remove a pid from the table, returns its slot (copied) or an empty slot
+static job_slot_t job_takePid(pid_t pid)
+{
+    job_slot_t found = {0, NULL, 0};
+    if (job_numSlots == 0) {
+        return found;
+    }
+
+    size_t i = job_slotOf(pid);
+    while (job_slots[i].pid != 0 && job_slots[i].pid != pid) {
+        i = (i + 1) & (job_numSlots - 1);
+    }
+    if (job_slots[i].pid == 0) {
+        return found;
+    }
+    found = job_slots[i];
+
+    // Shift back entries that probed past the removed slot
+    size_t hole = i;
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & (job_numSlots - 1);
+        if (job_slots[j].pid == 0) {
+            break;
+        }
+        // The entry can fill the hole unless its home slot is cyclically in
+        // (hole, j]
+        size_t home = job_slotOf(job_slots[j].pid);
+        int between = (hole <= j) ? (home > hole && home <= j)
+                                  : (home > hole || home <= j);
+        if (!between) {
+            job_slots[hole] = job_slots[j];
+            hole = j;
+        }
+    }
+    job_slots[hole].pid = 0;
+    --job_numPids;
+
+    return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Jobs.
+////////////////////////////////////////////////////////////////////////////////
+
+int job_init()
+{
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &sigset, NULL) != 0) {
+        return -1;
+    }
+
+    job_signalFd = signalfd(-1, &sigset, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (job_signalFd == -1) {
+        return -1;
+    }
+
+    job_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (job_epollFd == -1) {
+        close(job_signalFd);
+        job_signalFd = -1;
+        return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = job_signalFd;
+    if (epoll_ctl(job_epollFd, EPOLL_CTL_ADD, job_signalFd, &event) != 0) {
+        job_shutdown();
+        return -1;
+    }
+
+    return 0;
+}
+
+static void job_free(job_t *job)
+{
+    free(job->processes);
+    free(job->text);
+    free(job);
+}
+
+// Remove a job from the table, its processes are forgotten
+static void job_remove(job_t *job)
+{
+    if (job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        job_head = job->next;
+    }
+    if (job->next != NULL) {
+        job->next->prev = job->prev;
+    } else {
+        job_tail = job->prev;
+    }
+
+    for (int i = 0; i < job->numProcesses; ++i) {
+        if (job->processes[i].running) {
+            job_takePid(job->processes[i].pid);
+        }
+    }
+    if (job->background && job->numRunning > 0) {
+        --job_numBackground;
+    }
+
+    job_free(job);
+}
+
+void job_shutdown()
+{
+    while (job_head != NULL) {
+        job_remove(job_head);
+    }
+    free(job_slots);
+    job_slots = NULL;
+    job_numSlots = 0;
+    job_numPids = 0;
+
+    if (job_epollFd != -1) {
+        close(job_epollFd);
+        job_epollFd = -1;
+    }
+    if (job_signalFd != -1) {
+        close(job_signalFd);
+        job_signalFd = -1;
+    }
+}
+
+// Join the arguments of the commands into the job's command line
+static char *job_text(command_t *commands, int numCommands)
+{
+    size_t len = 1;
+    for (int i = 0; i < numCommands; ++i) {
+        for (int j = 0; commands[i].argv[j] != NULL; ++j) {
+            len += strlen(commands[i].argv[j]) + 1;
+        }
+        len += 2; // "| "
+    }
+
+    char *text = (char *)malloc(len);
+    if (text == NULL) {
+        return NULL;
+    }
+
+    char *it = text;
+    for (int i = 0; i < numCommands; ++i) {
+        if (i > 0) {
+            it = stpcpy(it, "| ");
+        }
+        for (int j = 0; commands[i].argv[j] != NULL; ++j) {
+            it = stpcpy(it, commands[i].argv[j]);
+            *it++ = ' ';
+        }
+    }
+    // Drop the trailing space
+    if (it > text) {
+        --it;
+    }
+    *it = '\0';
+
+    return text;
+}
+
+job_t *job_create(command_t *commands, int numCommands, int background)
+{
+    job_t *job = (job_t *)malloc(sizeof(job_t));
+    if (job == NULL) {
+        return NULL;
+    }
+    memset(job, 0, sizeof(job_t));
+
+    job->background = background;
+    if (background) {
+        job->text = job_text(commands, numCommands);
+        if (job->text == NULL) {
+            free(job);
+            return NULL;
+        }
+    }
+
+    // Number jobs like other shells: one more than the last job
+    job->id = (job_tail != NULL) ? job_tail->id + 1 : 1;
+    job->prev = job_tail;
+    if (job_tail != NULL) {
+        job_tail->next = job;
+    } else {
+        job_head = job;
+    }
+    job_tail = job;
+
+    return job;
+}
+
+int job_addProcess(job_t *job, pid_t pid)
+{
+    if (job->numProcesses == job->capacity) {
+        int newCapacity = (job->capacity > 0) ? job->capacity * 2 : 4;
+        job_process_t *processes = (job_process_t *)realloc(
+            job->processes, sizeof(job_process_t) * newCapacity);
+        if (processes == NULL) {
+            return -1;
+        }
+        job->processes = processes;
+        job->capacity = newCapacity;
+    }
+
+    if (job_putPid(pid, job, job->numProcesses) != 0) {
+        return -1;
+    }
+
+    job_process_t *process = &job->processes[job->numProcesses++];
+    process->pid = pid;
+    process->running = 1;
+    process->status = 0;
+    memset(&process->usage, 0, sizeof(process->usage));
+    if (job->background && job->numRunning == 0) {
+        ++job_numBackground;
+    }
+    ++job->numRunning;
+
+    return 0;
+}
+
+void job_reap()
+{
+    // Drain pending SIGCHLD notifications, several exits can be merged into
+    // one so they are only used to wake up
+    struct signalfd_siginfo info[16];
+    while (read(job_signalFd, info, sizeof(info)) > 0) {
+    }
+
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    int numReaped = 0;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        ++numReaped;
+        job_slot_t slot = job_takePid(pid);
+        if (slot.job == NULL) {
+            // Not tracked (e.g. out of memory when it was started)
+            continue;
+        }
+
+        job_process_t *process = &slot.job->processes[slot.index];
+        process->running = 0;
+        process->usage = usage;
+        if (WIFEXITED(status)) {
+            process->status = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            process->status = 128 + WTERMSIG(status);
+        }
+        if (--slot.job->numRunning == 0 && slot.job->background) {
+            --job_numBackground;
+        }
+    }
+
+    if (numReaped > 0 && job_reapHandler != NULL) {
+        (*job_reapHandler)();
+    }
+}
+
+void job_waitAny()
+{
+    job_reap();
+    if (job_numPids == 0) {
+        return;
+    }
+
+    struct epoll_event event;
+    while (epoll_wait(job_epollFd, &event, 1, -1) == -1 && errno == EINTR) {
+    }
+
+    job_reap();
+}
+
+int job_numRunningBackground()
+{
+    return job_numBackground;
+}
+
+void job_setReapHandler(void (*handler)())
+{
+    job_reapHandler = handler;
+}
+
+int job_waitRunning(job_t *job, int interruptible)
+{
+    job_reap();
+
+    while (job->numRunning > 0) {
+        struct epoll_event event;
+        int numEvents = epoll_wait(job_epollFd, &event, 1, -1);
+        if (numEvents == -1 && errno == EINTR && interruptible) {
+            return -1;
+        }
+
+        job_reap();
+    }
+
+    return 0;
+}
+
+int job_wait(job_t *job, int interruptible)
+{
+    if (job_waitRunning(job, interruptible) != 0) {
+        return -1;
+    }
+
+    int status = (job->numProcesses > 0)
+                     ? job->processes[job->numProcesses - 1].status
+                     : 0;
+    job_remove(job);
+
+    return status;
+}
+
+job_t *job_find(int id)
+{
+    for (job_t *job = job_head; job != NULL; job = job->next) {
+        if (job->id == id) {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+job_t *job_first()
+{
+    return job_head;
+}
+
+void job_print(FILE *stream, int doneOnly)
+{
+    job_reap();
+
+    job_t *job = job_head;
+    while (job != NULL) {
+        job_t *next = job->next;
+
+        if (job->background) {
+            if (job->numRunning > 0) {
+                if (!doneOnly) {
+                    fprintf(stream, "[%d]  Running\t%s\n", job->id, job->text);
+                }
+            } else {
+                int status = (job->numProcesses > 0)
+                                 ? job->processes[job->numProcesses - 1].status
+                                 : 0;
+                if (status == 0) {
+                    fprintf(stream, "[%d]  Done\t%s\n", job->id, job->text);
+                } else {
+                    fprintf(stream, "[%d]  Exit %d\t%s\n", job->id, status,
+                            job->text);
+                }
+                job_remove(job);
+            }
+        }
+
+        job = next;
+    }
+}
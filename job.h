@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Job table (see the 'jobs' and 'wait' builtins).
+///
+/// A job is the set of processes started for one pipeline (or single
+/// command). SIGCHLD is blocked in the shell and delivered through a signalfd
+/// watched with epoll, finished children are reaped with wait4() and their
+/// status and resource usage recorded in the job they belong to. Waiting for
+/// a job waits for exactly its processes, however many other children are
+/// running.
+////////////////////////////////////////////////////////////////////////////////
+
+// Forward declaration
+struct command_t;
+
+// Process started for a job
+typedef struct job_process_t {
+    pid_t pid;
+    int running;         // 1 until the process is reaped
+    int status;          // exit status once reaped (128 + signal if killed)
+    struct rusage usage; // resources used, once reaped
+} job_process_t;
+
+typedef struct job_t {
+    int id;                   // number used by 'jobs' and 'wait'
+    int background;           // 1 if the shell doesn't wait for the job
+    job_process_t *processes; // processes in pipeline order
+    int numProcesses;
+    int capacity;             // number of elements allocated for processes
+    int numRunning;           // number of processes not yet reaped
+    char *text;               // command line of the job, for 'jobs'
+    struct job_t *prev;       // previous job in order of creation
+    struct job_t *next;       // next job in order of creation
+} job_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Block SIGCHLD and set up its signalfd. Must be called before any children
+/// are started.
+///
+/// @return   int, 0 if successful, -1 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int job_init();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release the job table. Children still running are left running.
+////////////////////////////////////////////////////////////////////////////////
+void job_shutdown();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Add a job to the table.
+///
+/// @param   commands      command_t *, commands of the pipeline, for 'jobs'.
+/// @param   numCommands   int, number of commands in the pipeline.
+/// @param   background    int, 1 if the job runs in the background.
+/// @return                job_t *, new job, NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+job_t *job_create(struct command_t *commands, int numCommands, int background);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Add a started process to a job.
+///
+/// @param   job   job_t *, job the process belongs to.
+/// @param   pid   pid_t, process id of the child.
+/// @return        int, 0 if successful, -1 if out of memory (the process is
+///                then reaped without being tracked).
+////////////////////////////////////////////////////////////////////////////////
+int job_addProcess(job_t *job, pid_t pid);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Wait until all processes of a job have finished, leaving the job in the
+/// table so their status and resource usage can be read.
+///
+/// @param   job             job_t *, job to wait for.
+/// @param   interruptible   int, 1 to stop waiting when a signal is caught.
+/// @return                  int, 0 if successful, -1 if interrupted.
+////////////////////////////////////////////////////////////////////////////////
+int job_waitRunning(job_t *job, int interruptible);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Wait until all processes of a job have finished and remove the job.
+///
+/// @param   job             job_t *, job to wait for.
+/// @param   interruptible   int, 1 to stop waiting when a signal is caught
+///                          (the job then stays in the table).
+/// @return                  int, exit status of the last process of the job,
+///                          -1 if interrupted.
+////////////////////////////////////////////////////////////////////////////////
+int job_wait(job_t *job, int interruptible);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Reap children that have finished, without blocking.
+////////////////////////////////////////////////////////////////////////////////
+void job_reap();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Wait until a child finishes (or a signal is caught) and reap it, returns
+/// at once if there are no children.
+////////////////////////////////////////////////////////////////////////////////
+void job_waitAny();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   int, number of background jobs with processes still running.
+////////////////////////////////////////////////////////////////////////////////
+int job_numRunningBackground();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Set a function called after job_reap() reaped children, e.g. to start jobs
+/// waiting for others to finish.
+///
+/// @param   handler   void (*)(), function to call, NULL for none.
+////////////////////////////////////////////////////////////////////////////////
+void job_setReapHandler(void (*handler)());
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   id   int, job number.
+/// @return       job_t *, job with the given number, NULL if there is none.
+////////////////////////////////////////////////////////////////////////////////
+job_t *job_find(int id);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   job_t *, oldest job in the table, NULL if there are none.
+////////////////////////////////////////////////////////////////////////////////
+job_t *job_first();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the background jobs and whether they are running. Finished jobs are
+/// removed once printed.
+///
+/// @param   stream     FILE *, stream to print to.
+/// @param   doneOnly   int, 1 to only print (and remove) finished jobs.
+////////////////////////////////////////////////////////////////////////////////
+void job_print(FILE *stream, int doneOnly);
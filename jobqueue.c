@@ -0,0 +1,308 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "jobqueue.h"
+
+// Stdio and working directory of queued pipelines
+typedef struct jobqueue_context_t {
+    int refs;     // number of queued pipelines using the context
+    int fds[2];   // copies of stdin and stdout, -1 if unavailable
+    dev_t dev[2]; // identity of the files, to recognize the same context
+    ino_t ino[2];
+    char *cwd; // working directory, NULL if unavailable
+} jobqueue_context_t;
+
+// Not computed until needed, -1 until then
+static int jobqueue_limit = -1;
+
+// Pipelines in order of queueing
+static jobqueue_entry_t *jobqueue_head = NULL;
+static jobqueue_entry_t *jobqueue_tail = NULL;
+static int jobqueue_length = 0;
+
+// Context of the last pipeline queued, reused while it stays the same
+static jobqueue_context_t *jobqueue_lastContext = NULL;
+
+// Totals for jobqueue_print()
+static unsigned long jobqueue_numStarted = 0;
+static unsigned long jobqueue_numQueued = 0;
+
+int jobqueue_getLimit()
+{
+    if (jobqueue_limit == -1) {
+        // One job per CPU the shell may run on
+        cpu_set_t cpus;
+        jobqueue_limit = 1;
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 &&
+            CPU_COUNT(&cpus) > 0) {
+            jobqueue_limit = CPU_COUNT(&cpus);
+        }
+    }
+
+    return jobqueue_limit;
+}
+
+void jobqueue_setLimit(int limit)
+{
+    jobqueue_limit = limit;
+}
+
+static void jobqueue_release(jobqueue_context_t *context)
+{
+    if (--context->refs > 0) {
+        return;
+    }
+
+    if (jobqueue_lastContext == context) {
+        jobqueue_lastContext = NULL;
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (context->fds[i] != -1) {
+            close(context->fds[i]);
+        }
+    }
+    free(context->cwd);
+    free(context);
+}
+
+// Returns the context of a pipeline queued now, shared with the last pipeline
+// queued if it's the same, NULL if out of memory or file descriptors
+static jobqueue_context_t *jobqueue_context()
+{
+    struct stat fdStat[2];
+    for (int i = 0; i < 2; ++i) {
+        if (fstat(i, &fdStat[i]) != 0) {
+            fdStat[i].st_dev = 0;
+            fdStat[i].st_ino = 0;
+        }
+    }
+    char *cwd = getcwd(NULL, 0);
+
+    jobqueue_context_t *context = jobqueue_lastContext;
+    int sameCwd = (cwd == NULL || context == NULL || context->cwd == NULL)
+                      ? (context != NULL && cwd == context->cwd)
+                      : strcmp(cwd, context->cwd) == 0;
+    if (context != NULL && sameCwd && context->dev[0] == fdStat[0].st_dev &&
+        context->ino[0] == fdStat[0].st_ino &&
+        context->dev[1] == fdStat[1].st_dev &&
+        context->ino[1] == fdStat[1].st_ino) {
+        free(cwd);
+        ++context->refs;
+        return context;
+    }
+
+    context = (jobqueue_context_t *)malloc(sizeof(jobqueue_context_t));
+    if (context == NULL) {
+        free(cwd);
+        return NULL;
+    }
+    context->refs = 1;
+    context->cwd = cwd;
+    for (int i = 0; i < 2; ++i) {
+        context->fds[i] = fcntl(i, F_DUPFD_CLOEXEC, 0);
+        context->dev[i] = fdStat[i].st_dev;
+        context->ino[i] = fdStat[i].st_ino;
+    }
+    if ((context->fds[0] == -1 && fdStat[0].st_ino != 0) ||
+        (context->fds[1] == -1 && fdStat[1].st_ino != 0)) {
+        jobqueue_release(context);
+        return NULL;
+    }
+
+    if (jobqueue_lastContext != NULL) {
+        jobqueue_release(jobqueue_lastContext);
+    }
+    jobqueue_lastContext = context;
+    // Referenced as the last context too
+    ++context->refs;
+
+    return context;
+}
+
+// Copy the commands into a single allocation after the entry
+static jobqueue_entry_t *jobqueue_copy(command_t *commands, int numCommands)
+{
+    size_t size = sizeof(jobqueue_entry_t) + sizeof(command_t) * numCommands;
+    for (int i = 0; i < numCommands; ++i) {
+        size += strlen(commands[i].sep) + 1;
+        int argc = 0;
+        for (; commands[i].argv[argc] != NULL; ++argc) {
+            size += strlen(commands[i].argv[argc]) + 1;
+        }
+        size += sizeof(char *) * (argc + 1);
+        if (commands[i].stdin_file != NULL) {
+            size += strlen(commands[i].stdin_file) + 1;
+        }
+        if (commands[i].stdout_file != NULL) {
+            size += strlen(commands[i].stdout_file) + 1;
+        }
+    }
+
+    jobqueue_entry_t *entry = (jobqueue_entry_t *)malloc(size);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->commands = (command_t *)(entry + 1);
+    entry->numCommands = numCommands;
+    entry->context = NULL;
+    entry->next = NULL;
+
+    // The argv arrays, then the strings, keep the pointers aligned
+    char **argv = (char **)(entry->commands + numCommands);
+    for (int i = 0; i < numCommands; ++i) {
+        int argc = 0;
+        while (commands[i].argv[argc] != NULL) {
+            ++argc;
+        }
+        entry->commands[i] = commands[i];
+        entry->commands[i].argv = argv;
+        argv += argc + 1;
+    }
+
+    char *it = (char *)argv;
+    for (int i = 0; i < numCommands; ++i) {
+        command_t *copy = &entry->commands[i];
+        copy->sep = it;
+        it = stpcpy(it, commands[i].sep) + 1;
+        int argc = 0;
+        for (; commands[i].argv[argc] != NULL; ++argc) {
+            copy->argv[argc] = it;
+            it = stpcpy(it, commands[i].argv[argc]) + 1;
+        }
+        copy->argv[argc] = NULL;
+        if (commands[i].stdin_file != NULL) {
+            copy->stdin_file = it;
+            it = stpcpy(it, commands[i].stdin_file) + 1;
+        }
+        if (commands[i].stdout_file != NULL) {
+            copy->stdout_file = it;
+            it = stpcpy(it, commands[i].stdout_file) + 1;
+        }
+    }
+
+    return entry;
+}
+
+int jobqueue_push(command_t *commands, int numCommands)
+{
+    jobqueue_entry_t *entry = jobqueue_copy(commands, numCommands);
+    if (entry == NULL) {
+        return -1;
+    }
+    entry->context = jobqueue_context();
+    if (entry->context == NULL) {
+        free(entry);
+        return -1;
+    }
+
+    if (jobqueue_tail != NULL) {
+        jobqueue_tail->next = entry;
+    } else {
+        jobqueue_head = entry;
+    }
+    jobqueue_tail = entry;
+    ++jobqueue_length;
+    ++jobqueue_numQueued;
+
+    return 0;
+}
+
+jobqueue_entry_t *jobqueue_pop()
+{
+    jobqueue_entry_t *entry = jobqueue_head;
+    if (entry != NULL) {
+        jobqueue_head = entry->next;
+        if (jobqueue_head == NULL) {
+            jobqueue_tail = NULL;
+        }
+        --jobqueue_length;
+    }
+
+    return entry;
+}
+
+void jobqueue_enter(const jobqueue_entry_t *entry, int *saved)
+{
+    jobqueue_context_t *context = entry->context;
+    for (int i = 0; i < 2; ++i) {
+        saved[i] = -1;
+        if (context->fds[i] != -1) {
+            saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 0);
+            dup2(context->fds[i], i);
+        }
+    }
+
+    saved[2] = -1;
+    if (context->cwd != NULL) {
+        saved[2] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (chdir(context->cwd) != 0 && saved[2] != -1) {
+            close(saved[2]);
+            saved[2] = -1;
+        }
+    }
+}
+
+void jobqueue_leave(int *saved)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (saved[i] != -1) {
+            dup2(saved[i], i);
+            close(saved[i]);
+        }
+    }
+    if (saved[2] != -1) {
+        if (fchdir(saved[2]) != 0) {
+            perror("sane: fchdir");
+        }
+        close(saved[2]);
+    }
+}
+
+void jobqueue_free(jobqueue_entry_t *entry)
+{
+    if (entry->context != NULL) {
+        jobqueue_release(entry->context);
+    }
+    free(entry);
+}
+
+int jobqueue_numPending()
+{
+    return jobqueue_length;
+}
+
+void jobqueue_print(FILE *stream, int numRunning)
+{
+    if (jobqueue_getLimit() > 0) {
+        fprintf(stream, "limit %d\n", jobqueue_getLimit());
+    } else {
+        fprintf(stream, "limit none\n");
+    }
+    fprintf(stream, "running %d\n", numRunning);
+    fprintf(stream, "pending %d\n", jobqueue_length);
+    fprintf(stream, "started %lu\n", jobqueue_numStarted);
+    fprintf(stream, "queued %lu\n", jobqueue_numQueued);
+}
+
+void jobqueue_countStarted()
+{
+    ++jobqueue_numStarted;
+}
+
+void jobqueue_clear()
+{
+    jobqueue_entry_t *entry;
+    while ((entry = jobqueue_pop()) != NULL) {
+        jobqueue_free(entry);
+    }
+    if (jobqueue_lastContext != NULL) {
+        jobqueue_release(jobqueue_lastContext);
+    }
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Queue of background pipelines waiting to start (see the 'sched' builtin).
+///
+/// At most 'limit' background jobs run at the same time, by default one per
+/// CPU the shell may run on. Pipelines started with '&' past the limit are
+/// queued and started in order as running jobs finish, so a line or script
+/// starting thousands of jobs doesn't fork them all at once.
+///
+/// A queued pipeline is a copy of its commands, with the stdin, stdout and
+/// working directory it was queued with, which it gets back when it starts.
+/// Consecutive pipelines queued with the same stdio and directory share them.
+////////////////////////////////////////////////////////////////////////////////
+
+// Forward declarations
+struct command_t;
+struct jobqueue_context_t;
+
+typedef struct jobqueue_entry_t {
+    // Copy of the pipeline, its arguments are in the same allocation
+    struct command_t *commands;
+    int numCommands;
+    struct jobqueue_context_t *context; // stdio and working directory
+    struct jobqueue_entry_t *next;
+} jobqueue_entry_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   int, maximum number of background jobs running at the same time,
+///           0 if unlimited.
+////////////////////////////////////////////////////////////////////////////////
+int jobqueue_getLimit();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   limit   int, maximum number of background jobs running at the
+///                  same time, 0 for no limit.
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_setLimit(int limit);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Queue a pipeline, with the current stdin, stdout and working directory.
+///
+/// @param   commands      command_t *, commands of the pipeline, the last one
+///                        followed by '&'.
+/// @param   numCommands   int, number of commands in the pipeline.
+/// @return                int, 0 if successful, -1 otherwise (out of memory
+///                        or file descriptors).
+////////////////////////////////////////////////////////////////////////////////
+int jobqueue_push(struct command_t *commands, int numCommands);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   jobqueue_entry_t *, oldest queued pipeline, removed from the
+///           queue, NULL if the queue is empty. Release it with
+///           jobqueue_free().
+////////////////////////////////////////////////////////////////////////////////
+jobqueue_entry_t *jobqueue_pop();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Switch to the stdin, stdout and working directory of a queued pipeline.
+///
+/// @param   entry   jobqueue_entry_t *, pipeline about to be started.
+/// @param   saved   int *, receives the 3 descriptors needed to switch back
+///                  with jobqueue_leave().
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_enter(const jobqueue_entry_t *entry, int *saved);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Switch back to the stdin, stdout and working directory saved by
+/// jobqueue_enter().
+///
+/// @param   saved   int *, descriptors set by jobqueue_enter().
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_leave(int *saved);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release a pipeline returned by jobqueue_pop().
+///
+/// @param   entry   jobqueue_entry_t *, pipeline to release.
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_free(jobqueue_entry_t *entry);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   int, number of queued pipelines.
+////////////////////////////////////////////////////////////////////////////////
+int jobqueue_numPending();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the limit, the number of running and queued jobs and how many jobs
+/// were started and queued so far.
+///
+/// @param   stream       FILE *, stream to print to.
+/// @param   numRunning   int, number of background jobs running.
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_print(FILE *stream, int numRunning);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Count a background job started, for jobqueue_print().
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_countStarted();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Drop the queued pipelines without starting them.
+////////////////////////////////////////////////////////////////////////////////
+void jobqueue_clear();
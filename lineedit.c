@@ -0,0 +1,659 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "complete.h"
+#include "history.h"
+#include "lineedit.h"
+
+#define LINEEDIT_CTRL(c) ((c) & 0x1f)
+#define LINEEDIT_ESCAPE 27
+#define LINEEDIT_BACKSPACE 127
+// Keys of escape sequences, past the range of bytes
+#define LINEEDIT_UP 1000
+#define LINEEDIT_DOWN 1001
+#define LINEEDIT_RIGHT 1002
+#define LINEEDIT_LEFT 1003
+#define LINEEDIT_HOME 1004
+#define LINEEDIT_END 1005
+#define LINEEDIT_DELETE 1006
+// Returned by the key handlers when the line is done
+#define LINEEDIT_DONE -3
+
+// Most candidates listed by a second Tab
+#define LINEEDIT_MAX_LISTED 256
+// Characters escaped when completion inserts them
+#define LINEEDIT_SPECIAL " \t\\'\"*?[|&;<>"
+// Longest text searched for with Ctrl-R
+#define LINEEDIT_MAX_QUERY 256
+
+// Line being edited
+static char *lineedit_buffer = NULL;
+static size_t lineedit_length = 0;
+static size_t lineedit_capacity = 0;
+static size_t lineedit_cursor = 0;
+static const char *lineedit_prompt = "";
+
+static complete_t lineedit_completion;
+
+// Offsets of the history entries went through with Up, the last one is shown
+static off_t *lineedit_browsed = NULL;
+static size_t lineedit_numBrowsed = 0;
+static size_t lineedit_browseCapacity = 0;
+// Line typed before going through the history
+static char *lineedit_draft = NULL;
+
+int lineedit_isSupported()
+{
+    const char *term = getenv("TERM");
+
+    return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) &&
+           (term == NULL || strcmp(term, "dumb") != 0);
+}
+
+static void lineedit_write(const char *text, size_t length)
+{
+    while (length > 0) {
+        ssize_t numWritten = write(STDOUT_FILENO, text, length);
+        if (numWritten < 0 && errno == EINTR) {
+            continue;
+        } else if (numWritten <= 0) {
+            return;
+        }
+        text += numWritten;
+        length -= numWritten;
+    }
+}
+
+static void lineedit_puts(const char *text)
+{
+    lineedit_write(text, strlen(text));
+}
+
+// Returns the next byte of input, -1 at end of input, -2 on error
+static int lineedit_readByte()
+{
+    // A byte at a time, what follows the line is left to the commands it runs
+    unsigned char c;
+    ssize_t numRead;
+    while ((numRead = read(STDIN_FILENO, &c, 1)) < 0 && errno == EINTR) {
+    }
+
+    return numRead == 1 ? c : (numRead == 0 ? -1 : -2);
+}
+
+// Returns the next key, escape sequences are returned as LINEEDIT_UP...
+static int lineedit_readKey()
+{
+    int c = lineedit_readByte();
+    if (c != LINEEDIT_ESCAPE) {
+        return c;
+    }
+
+    int kind = lineedit_readByte();
+    if (kind != '[' && kind != 'O') {
+        return kind < 0 ? kind : LINEEDIT_ESCAPE;
+    }
+    int key = lineedit_readByte();
+    int number = 0;
+    while (key >= '0' && key <= '9') {
+        number = number * 10 + key - '0';
+        key = lineedit_readByte();
+    }
+
+    switch (key) {
+    case 'A':
+        return LINEEDIT_UP;
+    case 'B':
+        return LINEEDIT_DOWN;
+    case 'C':
+        return LINEEDIT_RIGHT;
+    case 'D':
+        return LINEEDIT_LEFT;
+    case 'H':
+        return LINEEDIT_HOME;
+    case 'F':
+        return LINEEDIT_END;
+    case '~':
+        if (number == 1 || number == 7) {
+            return LINEEDIT_HOME;
+        } else if (number == 4 || number == 8) {
+            return LINEEDIT_END;
+        } else if (number == 3) {
+            return LINEEDIT_DELETE;
+        }
+        return LINEEDIT_ESCAPE;
+    default:
+        return key < 0 ? key : LINEEDIT_ESCAPE;
+    }
+}
+
+// Number of characters (not bytes) in the text
+static size_t lineedit_width(const char *text, size_t length)
+{
+    size_t width = 0;
+    for (size_t i = 0; i < length; ++i) {
+        // Continuation bytes of UTF-8 sequences
+        if ((text[i] & 0xc0) != 0x80) {
+            ++width;
+        }
+    }
+
+    return width;
+}
+
+// Draw the prompt and the line again, with the cursor in place
+static void lineedit_refresh()
+{
+    lineedit_puts("\r");
+    lineedit_puts(lineedit_prompt);
+    lineedit_puts(" ");
+    lineedit_write(lineedit_buffer, lineedit_length);
+    lineedit_puts("\x1b[K");
+
+    size_t back = lineedit_width(lineedit_buffer + lineedit_cursor,
+                                 lineedit_length - lineedit_cursor);
+    if (back > 0) {
+        char move[32];
+        snprintf(move, sizeof(move), "\x1b[%zuD", back);
+        lineedit_puts(move);
+    }
+}
+
+// Make room for a line of 'length' bytes, returns 0 if successful
+static int lineedit_reserve(size_t length)
+{
+    if (length + 1 > lineedit_capacity) {
+        size_t capacity = (length + 1) * 2;
+        char *buffer = (char *)realloc(lineedit_buffer, capacity);
+        if (buffer == NULL) {
+            return -1;
+        }
+        lineedit_buffer = buffer;
+        lineedit_capacity = capacity;
+    }
+
+    return 0;
+}
+
+// Insert text at the cursor, returns 0 if successful
+static int lineedit_insert(const char *text, size_t length)
+{
+    if (lineedit_reserve(lineedit_length + length) != 0) {
+        return -1;
+    }
+
+    int atEnd = lineedit_cursor == lineedit_length;
+    memmove(lineedit_buffer + lineedit_cursor + length,
+            lineedit_buffer + lineedit_cursor,
+            lineedit_length - lineedit_cursor);
+    memcpy(lineedit_buffer + lineedit_cursor, text, length);
+    lineedit_length += length;
+    lineedit_cursor += length;
+
+    // Typing at the end of the line only needs the text echoed
+    if (atEnd) {
+        lineedit_write(text, length);
+    } else {
+        lineedit_refresh();
+    }
+
+    return 0;
+}
+
+// Delete the bytes from 'start' to 'end'
+static void lineedit_delete(size_t start, size_t end)
+{
+    memmove(lineedit_buffer + start, lineedit_buffer + end,
+            lineedit_length - end);
+    lineedit_length -= end - start;
+    if (lineedit_cursor > end) {
+        lineedit_cursor -= end - start;
+    } else if (lineedit_cursor > start) {
+        lineedit_cursor = start;
+    }
+    lineedit_refresh();
+}
+
+// Replace the line, with the cursor at its end. Returns 0 if successful.
+static int lineedit_set(const char *text, size_t length)
+{
+    if (lineedit_reserve(length) != 0) {
+        return -1;
+    }
+    memmove(lineedit_buffer, text, length);
+    lineedit_length = length;
+    lineedit_cursor = length;
+    lineedit_refresh();
+
+    return 0;
+}
+
+// Offset of the start of the character before or after the cursor
+static size_t lineedit_previous(size_t offset)
+{
+    while (offset > 0 && (lineedit_buffer[--offset] & 0xc0) == 0x80) {
+    }
+
+    return offset;
+}
+
+static size_t lineedit_next(size_t offset)
+{
+    while (offset < lineedit_length &&
+           (lineedit_buffer[++offset] & 0xc0) == 0x80) {
+    }
+
+    return offset < lineedit_length ? offset : lineedit_length;
+}
+
+// List the candidates below the line, in columns
+static void lineedit_list(const complete_t *completion)
+{
+    size_t numListed = completion->numMatches;
+    if (numListed > LINEEDIT_MAX_LISTED) {
+        numListed = LINEEDIT_MAX_LISTED;
+    }
+
+    // Paths are listed by their last component
+    const char *names[numListed];
+    size_t width = 0;
+    for (size_t i = 0; i < numListed; ++i) {
+        const char *slash = strrchr(completion->matches[i], '/');
+        names[i] = (completion->paths && slash != NULL && slash[1] != '\0')
+                       ? slash + 1
+                       : completion->matches[i];
+        size_t nameWidth = lineedit_width(names[i], strlen(names[i])) + 2;
+        width = nameWidth > width ? nameWidth : width;
+    }
+
+    struct winsize size;
+    size_t columns = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0) {
+        columns = size.ws_col;
+    }
+    size_t perRow = columns / width > 0 ? columns / width : 1;
+    size_t numRows = (numListed + perRow - 1) / perRow;
+
+    lineedit_puts("\r\n");
+    for (size_t row = 0; row < numRows; ++row) {
+        for (size_t i = row; i < numListed; i += numRows) {
+            lineedit_puts(names[i]);
+            size_t padding = width - lineedit_width(names[i], strlen(names[i]));
+            for (size_t k = 0; k < padding && i + numRows < numListed; ++k) {
+                lineedit_puts(" ");
+            }
+        }
+        lineedit_puts("\r\n");
+    }
+    if (numListed < completion->numMatches) {
+        char more[64];
+        snprintf(more, sizeof(more), "(%zu more)\r\n",
+                 completion->numMatches - numListed);
+        lineedit_puts(more);
+    }
+    lineedit_refresh();
+}
+
+// Complete the word before the cursor, 'list' is 1 to list the candidates if
+// the word can't be completed further. Returns 0 if successful.
+static int lineedit_complete(int list)
+{
+    lineedit_buffer[lineedit_length] = '\0';
+    complete_t *completion = &lineedit_completion;
+    if (complete_find(completion, lineedit_buffer, lineedit_cursor) != 0) {
+        return -1;
+    }
+    if (completion->numMatches == 0) {
+        lineedit_puts("\a");
+        return 0;
+    }
+
+    // The candidates are sorted, the first and last differ the most
+    const char *first = completion->matches[0];
+    const char *last = completion->matches[completion->numMatches - 1];
+    size_t common = 0;
+    while (first[common] != '\0' && first[common] == last[common]) {
+        ++common;
+    }
+
+    char replacement[common * 2 + 2];
+    size_t length = 0;
+    for (size_t i = 0; i < common; ++i) {
+        if (strchr(LINEEDIT_SPECIAL, first[i]) != NULL) {
+            replacement[length++] = '\\';
+        }
+        replacement[length++] = first[i];
+    }
+    if (completion->numMatches == 1) {
+        struct stat fileStat;
+        int isDir = completion->paths && stat(first, &fileStat) == 0 &&
+                    S_ISDIR(fileStat.st_mode);
+        replacement[length++] = isDir ? '/' : ' ';
+    }
+
+    size_t start = completion->start;
+    size_t wordLen = lineedit_cursor - start;
+    if (length != wordLen ||
+        memcmp(replacement, lineedit_buffer + start, length) != 0) {
+        // Replaced as a whole, a path may come back with '~' expanded
+        size_t end = lineedit_cursor;
+        memmove(lineedit_buffer + start, lineedit_buffer + end,
+                lineedit_length - end);
+        lineedit_length -= wordLen;
+        lineedit_cursor = start;
+        if (lineedit_reserve(lineedit_length + length) != 0) {
+            return -1;
+        }
+        memmove(lineedit_buffer + start + length, lineedit_buffer + start,
+                lineedit_length - start);
+        memcpy(lineedit_buffer + start, replacement, length);
+        lineedit_length += length;
+        lineedit_cursor += length;
+        lineedit_refresh();
+    } else if (list) {
+        lineedit_list(completion);
+    } else {
+        lineedit_puts("\a");
+    }
+
+    return 0;
+}
+
+// Show the previous (Up) or next (Down) entry of the history. Returns 0 if
+// successful.
+static int lineedit_browse(int older)
+{
+    const char *entry;
+    size_t entryLen;
+    if (older) {
+        off_t before = lineedit_numBrowsed > 0
+                           ? lineedit_browsed[lineedit_numBrowsed - 1]
+                           : -1;
+        off_t found = history_search("", before, &entry, &entryLen);
+        if (found < 0) {
+            lineedit_puts("\a");
+            return 0;
+        }
+
+        if (lineedit_numBrowsed == lineedit_browseCapacity) {
+            size_t capacity = lineedit_browseCapacity * 2 + 16;
+            off_t *browsed = (off_t *)realloc(lineedit_browsed,
+                                              sizeof(off_t) * capacity);
+            if (browsed == NULL) {
+                return -1;
+            }
+            lineedit_browsed = browsed;
+            lineedit_browseCapacity = capacity;
+        }
+        if (lineedit_numBrowsed == 0) {
+            free(lineedit_draft);
+            lineedit_draft = strndup(lineedit_buffer, lineedit_length);
+            if (lineedit_draft == NULL) {
+                return -1;
+            }
+        }
+        lineedit_browsed[lineedit_numBrowsed++] = found;
+
+        return lineedit_set(entry, entryLen);
+    }
+
+    if (lineedit_numBrowsed == 0) {
+        lineedit_puts("\a");
+        return 0;
+    }
+    if (--lineedit_numBrowsed == 0) {
+        return lineedit_set(lineedit_draft, strlen(lineedit_draft));
+    }
+    // The entry starting at the offset is the last one before the next byte
+    off_t offset = lineedit_browsed[lineedit_numBrowsed - 1];
+    if (history_search("", offset + 1, &entry, &entryLen) != offset) {
+        return -1;
+    }
+
+    return lineedit_set(entry, entryLen);
+}
+
+// Draw the line being searched for with Ctrl-R
+static void lineedit_refreshSearch(const char *query, int failed)
+{
+    lineedit_puts("\r");
+    lineedit_puts(failed ? "(failed reverse-i-search)'"
+                         : "(reverse-i-search)'");
+    lineedit_puts(query);
+    lineedit_puts("': ");
+    lineedit_write(lineedit_buffer, lineedit_length);
+    lineedit_puts("\x1b[K");
+}
+
+// Search the history as the text is typed. Returns the key that ended the
+// search (to be handled as usual), 0 if the search was cancelled, -1 at end
+// of input, -2 on error.
+static int lineedit_search()
+{
+    char *original = strndup(lineedit_buffer, lineedit_length);
+    if (original == NULL) {
+        return -2;
+    }
+
+    char query[LINEEDIT_MAX_QUERY + 1] = "";
+    size_t queryLen = 0;
+    off_t found = -1;
+    int failed = 0;
+    int key;
+    lineedit_refreshSearch(query, failed);
+    while ((key = lineedit_readKey()) >= 0) {
+        off_t before = -1;
+        if (key == LINEEDIT_CTRL('R')) {
+            before = found;
+        } else if (key == LINEEDIT_BACKSPACE || key == LINEEDIT_CTRL('H')) {
+            if (queryLen > 0) {
+                query[--queryLen] = '\0';
+            }
+        } else if (key >= ' ' && key <= 255) {
+            if (queryLen < LINEEDIT_MAX_QUERY) {
+                query[queryLen++] = key;
+                query[queryLen] = '\0';
+            }
+        } else {
+            break;
+        }
+
+        // Typing searches again from the newest entry
+        const char *entry;
+        size_t entryLen;
+        off_t result = history_search(query, before, &entry, &entryLen);
+        failed = result < 0;
+        if (!failed) {
+            found = result;
+            lineedit_length = 0;
+            lineedit_cursor = 0;
+            if (lineedit_reserve(entryLen) != 0) {
+                key = -2;
+                break;
+            }
+            memcpy(lineedit_buffer, entry, entryLen);
+            lineedit_length = entryLen;
+            lineedit_cursor = entryLen;
+        }
+        lineedit_refreshSearch(query, failed);
+    }
+
+    if (key == LINEEDIT_CTRL('G')) {
+        lineedit_length = 0;
+        lineedit_cursor = 0;
+        if (lineedit_reserve(strlen(original)) == 0) {
+            lineedit_set(original, strlen(original));
+        }
+        key = 0;
+    }
+    free(original);
+    lineedit_refresh();
+
+    return key;
+}
+
+// Handle a key, returns 0 to go on editing, LINEEDIT_DONE when the line is
+// done, -1 at end of input, -2 on error
+static int lineedit_handle(int key, int lastKey)
+{
+    switch (key) {
+    case '\r':
+    case '\n':
+        lineedit_puts("\r\n");
+        return LINEEDIT_DONE;
+    case LINEEDIT_CTRL('C'):
+        lineedit_puts("^C\r\n");
+        lineedit_length = 0;
+        lineedit_cursor = 0;
+        return LINEEDIT_DONE;
+    case LINEEDIT_CTRL('D'):
+        if (lineedit_length == 0) {
+            lineedit_puts("\r\n");
+            return -1;
+        }
+        // Fall through, deletes the character under the cursor
+    case LINEEDIT_DELETE:
+        if (lineedit_cursor < lineedit_length) {
+            lineedit_delete(lineedit_cursor, lineedit_next(lineedit_cursor));
+        }
+        return 0;
+    case LINEEDIT_BACKSPACE:
+    case LINEEDIT_CTRL('H'):
+        if (lineedit_cursor > 0) {
+            lineedit_delete(lineedit_previous(lineedit_cursor),
+                            lineedit_cursor);
+        }
+        return 0;
+    case '\t':
+        return lineedit_complete(lastKey == '\t') == 0 ? 0 : -2;
+    case LINEEDIT_CTRL('R'):
+        key = lineedit_search();
+        return key > 0 ? lineedit_handle(key, 0) : key;
+    case LINEEDIT_UP:
+    case LINEEDIT_CTRL('P'):
+        return lineedit_browse(1) == 0 ? 0 : -2;
+    case LINEEDIT_DOWN:
+    case LINEEDIT_CTRL('N'):
+        return lineedit_browse(0) == 0 ? 0 : -2;
+    case LINEEDIT_LEFT:
+    case LINEEDIT_CTRL('B'):
+        lineedit_cursor = lineedit_previous(lineedit_cursor);
+        break;
+    case LINEEDIT_RIGHT:
+    case LINEEDIT_CTRL('F'):
+        lineedit_cursor = lineedit_next(lineedit_cursor);
+        break;
+    case LINEEDIT_HOME:
+    case LINEEDIT_CTRL('A'):
+        lineedit_cursor = 0;
+        break;
+    case LINEEDIT_END:
+    case LINEEDIT_CTRL('E'):
+        lineedit_cursor = lineedit_length;
+        break;
+    case LINEEDIT_CTRL('U'):
+        lineedit_delete(0, lineedit_cursor);
+        return 0;
+    case LINEEDIT_CTRL('K'):
+        lineedit_delete(lineedit_cursor, lineedit_length);
+        return 0;
+    case LINEEDIT_CTRL('W'): {
+        size_t start = lineedit_cursor;
+        while (start > 0 && lineedit_buffer[start - 1] == ' ') {
+            --start;
+        }
+        while (start > 0 && lineedit_buffer[start - 1] != ' ') {
+            --start;
+        }
+        lineedit_delete(start, lineedit_cursor);
+        return 0;
+    }
+    case LINEEDIT_CTRL('L'):
+        lineedit_puts("\x1b[H\x1b[2J");
+        break;
+    default:
+        // Other control characters and escape sequences are ignored
+        if (key >= ' ' && key <= 255 && key != LINEEDIT_BACKSPACE) {
+            char c = key;
+            return lineedit_insert(&c, 1) == 0 ? 0 : -2;
+        }
+        return 0;
+    }
+
+    lineedit_refresh();
+    return 0;
+}
+
+ssize_t lineedit_readLine(const char *prompt, char **line)
+{
+    if (lineedit_reserve(0) != 0) {
+        errno = ENOMEM;
+        return -2;
+    }
+    lineedit_length = 0;
+    lineedit_cursor = 0;
+    lineedit_prompt = prompt;
+    lineedit_numBrowsed = 0;
+
+    // Raw mode, without waiting for typeahead to be discarded or written
+    struct termios saved;
+    if (tcgetattr(STDIN_FILENO, &saved) != 0) {
+        return -2;
+    }
+    struct termios raw = saved;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0) {
+        return -2;
+    }
+
+    lineedit_puts(prompt);
+    lineedit_puts(" ");
+
+    int result = 0;
+    int lastKey = 0;
+    while (result == 0) {
+        int key = lineedit_readKey();
+        result = key < 0 ? key : lineedit_handle(key, lastKey);
+        lastKey = key;
+    }
+
+    int err = errno;
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    if (result != LINEEDIT_DONE) {
+        errno = (result == -2 && err == 0) ? ENOMEM : err;
+        return result;
+    }
+
+    lineedit_buffer[lineedit_length] = '\0';
+    *line = lineedit_buffer;
+
+    return lineedit_length;
+}
+
+void lineedit_clear()
+{
+    complete_free(&lineedit_completion);
+    free(lineedit_buffer);
+    lineedit_buffer = NULL;
+    lineedit_length = 0;
+    lineedit_capacity = 0;
+    lineedit_cursor = 0;
+    free(lineedit_browsed);
+    lineedit_browsed = NULL;
+    lineedit_numBrowsed = 0;
+    lineedit_browseCapacity = 0;
+    free(lineedit_draft);
+    lineedit_draft = NULL;
+}
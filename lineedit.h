@@ -0,0 +1,43 @@
+#include <sys/types.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Line editor for interactive shells, used when stdin and stdout are
+/// terminals (and TERM isn't 'dumb'). The terminal is in raw mode only while
+/// a line is edited, commands run with the terminal as the shell found it.
+///
+/// Keys:
+///  - Tab: complete the word before the cursor (see complete.h), a second Tab
+///    lists the candidates.
+///  - Ctrl-R: search the history (see history.h) for the text typed next,
+///    Ctrl-R again finds an older entry, Enter runs the entry, Ctrl-G cancels
+///    and other keys edit it.
+///  - Up, Down: previous and next entries of the history.
+///  - Left, Right, Home, End, Ctrl-B, Ctrl-F, Ctrl-A, Ctrl-E: move the cursor.
+///  - Backspace, Delete, Ctrl-D: delete a character, Ctrl-D at the start of an
+///    empty line ends the input.
+///  - Ctrl-U, Ctrl-K, Ctrl-W: delete up to the start or end of the line, or
+///    the word before the cursor.
+///  - Ctrl-C: discard the line, Ctrl-L: clear the screen.
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   int, 1 if lines should be read with lineedit_readLine(), i.e.
+///           stdin and stdout are terminals that can be edited on.
+////////////////////////////////////////////////////////////////////////////////
+int lineedit_isSupported();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the prompt and read a line.
+///
+/// @param   prompt   const char *, prompt to print, followed by a space.
+/// @param   line     char **, set to the line, without its newline, valid
+///                   until the next call.
+/// @return           ssize_t, length of the line, -1 at end of input, -2 if
+///                   reading failed (errno is set) or out of memory.
+////////////////////////////////////////////////////////////////////////////////
+ssize_t lineedit_readLine(const char *prompt, char **line);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release the line and completion buffers.
+////////////////////////////////////////////////////////////////////////////////
+void lineedit_clear();
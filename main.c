@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,75 +9,19 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-#include "command.h"
+#include "execindex.h"
+#include "history.h"
+#include "input.h"
+#include "job.h"
+#include "lineedit.h"
+#include "run.h"
 #include "sane.h"
-#include "token.h"
-
-// Allow at least 64 characters for each token
-#define INPUT_LINE_SIZE (64 * MAX_NUM_TOKENS)
-
-int sane_shouldQuit = 0;
+#include "server.h"
 
 void sane_handleSigkill(int signo)
 {
 }
 
-// SIGUSR1 is sent when "exit" inbuilt command is used
-void sane_handleSiguser1(int signo)
-{
-    sane_shouldQuit = 1;
-}
-
-// SIGCHLD is sent when a child process finishes
-void sane_handleSigchld(int signo)
-{
-    // TODO: Save errno? - waitpid may change errno
-    /* printf("Caught sigchld \n"); */
-    int more = 1;
-    pid_t pid;
-    int status;
-
-    // Continue claiming zombie processes until no more to claim
-    while (more) {
-        pid = waitpid(-1, &status, WNOHANG);
-        if (pid <= 0) {
-            more = 0;
-        }
-    }
-}
-
-void setupChildSignalHandler()
-{
-    struct sigaction act;
-    act.sa_flags = 0;
-    act.sa_handler = sane_handleSigchld;
-    // Initialize mask to contain all signals - all signals are blocked during
-    // the execution of the handler
-    sigfillset(&(act.sa_mask));
-
-    // Assign handler structure to SIGCHLD
-    if (sigaction(SIGCHLD, &act, NULL) != 0) {
-        perror("sane: sigaction");
-        exit(1);
-    }
-}
-
-void setupUser1SignalHandler()
-{
-    struct sigaction act;
-    act.sa_flags = 0;
-    act.sa_handler = sane_handleSiguser1;
-    // Initialize mask to contain all signals - all signals are blocked during
-    // the execution of the handler
-    sigfillset(&(act.sa_mask));
-
-    // Assign handler structure to SIGCHLD
-    if (sigaction(SIGUSR1, &act, NULL) != 0) {
-        perror("sane: sigaction");
-        exit(1);
-    }
-}
-
 void setupKillSignalHandler()
 {
     struct sigaction act;
@@ -103,83 +48,165 @@ void setupKillSignalHandler()
     }
 }
 
+// Builtins writing to a closed pipe get EPIPE instead of killing the shell,
+// children get the default action back when they are started
+void setupPipeSignalHandler()
+{
+    struct sigaction act;
+    act.sa_flags = 0;
+    act.sa_handler = SIG_IGN;
+    sigemptyset(&(act.sa_mask));
+
+    if (sigaction(SIGPIPE, &act, NULL) != 0) {
+        perror("sane: sigaction");
+        exit(1);
+    }
+}
+
 void setupSignalHandlers()
 {
-    setupChildSignalHandler();
-    setupUser1SignalHandler();
     setupKillSignalHandler();
+    setupPipeSignalHandler();
     // TODO setup_handler(int sig, fnptr handler)
 }
 
+// Name of the script being run, NULL when reading from stdin or '-c'
+static const char *scriptName = NULL;
+
+void reportError(const input_t *input, const char *message)
+{
+    if (scriptName != NULL) {
+        fprintf(stderr, "sane: %s: line %zu: %s\n", scriptName,
+                input->lineNum, message);
+    } else {
+        fprintf(stderr, "sane: %s\n", message);
+    }
+}
+
+// Exit status of the last line run, the shell's exit status when it isn't
+// interactive
+static int lastStatus = 0;
+
+// Run a single line of input
+void runLine(const input_t *input, const char *inputLine, size_t inputLen)
+{
+    if (inputLen == 0) {
+        return;
+    }
+
+    int error = sane_run(inputLine, &lastStatus);
+    if (error != 0) {
+        reportError(input, sane_runError(error));
+        // Syntax errors exit with 2 like other shells
+        lastStatus = (error == SANE_RUN_NO_MEMORY) ? 1 : 2;
+    }
+}
+
+// Open the input named on the command line: 'sane', 'sane script' or
+// 'sane -c command'. Returns 0 on success, -1 on failure.
+int openInput(int argc, char **argv, input_t *input, int *interactive)
+{
+    *interactive = 0;
+
+    if (argc == 1) {
+        // Only prompt when a user is typing the commands
+        *interactive = isatty(STDIN_FILENO);
+        if (input_openFd(input, STDIN_FILENO, 0) != 0) {
+            fprintf(stderr, "sane: out of memory\n");
+            return -1;
+        }
+    } else if (argc == 3 && strcmp(argv[1], "-c") == 0) {
+        if (input_openString(input, argv[2]) != 0) {
+            fprintf(stderr, "sane: out of memory\n");
+            return -1;
+        }
+    } else if (argc == 2 && argv[1][0] != '-') {
+        // Close on exec so commands run by the script don't inherit it
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "sane: %s: %s\n", argv[1], strerror(errno));
+            return -1;
+        }
+        if (input_openFd(input, fd, 1) != 0) {
+            close(fd);
+            fprintf(stderr, "sane: out of memory\n");
+            return -1;
+        }
+        scriptName = argv[1];
+    } else {
+        fprintf(stderr, "usage: sane [-c command | script | --server socket "
+                        "[workers]]\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    // 'sane --server socket [workers]', one worker per CPU by default
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--server") == 0) {
+        int numWorkers =
+            (argc == 4) ? atoi(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+        if (numWorkers < 1) {
+            fprintf(stderr, "sane: invalid number of workers\n");
+            return 2;
+        }
+        return server_main(argv[2], numWorkers);
+    }
+
+    input_t input;
+    int interactive;
+    if (openInput(argc, argv, &input, &interactive) != 0) {
+        return 2;
+    }
+
     // Initialize shell, check if ok
     if (sane_init() == 0) {
-        char *inputLine = (char *)malloc(INPUT_LINE_SIZE * sizeof(char));
-        char *inputPtr = NULL;
-
         setupSignalHandlers();
 
-        while (!(sane_shouldQuit)) {
-            memset(inputLine, 0, INPUT_LINE_SIZE);
-            printf("%s ", sane_getPrompt());
-
-            // Get input buffer from stdin, if getting input fails due to
-            // interruption from signal handler, try again.
-            do {
-                inputPtr = fgets(inputLine, INPUT_LINE_SIZE, stdin);
-            } while (inputPtr == NULL && errno == EINTR);
-
-            /* assert(inputPtr != NULL && "Couldn't get input!\n"); */
-
-            if (inputPtr != NULL) {
-                // Remove newline at end of input buffer
-                inputLine[strcspn(inputLine, "\n")] = 0;
-
-                char *token[MAX_NUM_TOKENS];
-                int numTokens = tokenise(inputLine, token);
-                if (numTokens == -1) {
-                    fprintf(stderr, "sane: number of tokens provided exceeds "
-                                    "MAX_NUM_TOKENS\n");
-                } else if (numTokens == -2) {
-                    fprintf(stderr, "sane: string not closed\n");
-                }
-
-                command_t command[MAX_NUM_COMMANDS];
-                // Reset command array
-                memset(command, 0, MAX_NUM_COMMANDS * sizeof(command_t));
-                int numCommands = separateCommands(token, numTokens, command);
-                if (numCommands == -1) {
-                    fprintf(stderr, "sane: command array is too small for "
-                                    "all commands\n");
-                } else if (numCommands == -2) {
-                    fprintf(stderr, "sane: at least two successive "
-                                    "commands are separated by more than "
-                                    "one command separator\n");
-                } else if (numCommands == -3) {
-                    fprintf(stderr, "sane: first token is command separator\n");
-                } else if (numCommands == -4) {
-                    fprintf(stderr, "sane: last command followed by "
-                                    "command separator '|'\n");
-                }
-
-                if (numCommands > 0) {
-                    sane_execute(numCommands, command);
+        // Terminals get the line editor, other input is read as it comes
+        int editing = interactive && lineedit_isSupported();
+        while (!sane_exitRequested()) {
+            if (interactive) {
+                // Report background jobs that finished since the last prompt
+                job_print(stdout, 1);
+            }
+            if (interactive && !editing) {
+                printf("%s ", sane_getPrompt());
+                fflush(stdout);
+            }
 
-                    freeCommands(command, numCommands);
+            char *inputLine;
+            ssize_t inputLen =
+                editing ? lineedit_readLine(sane_getPrompt(), &inputLine)
+                        : input_readLine(&input, &inputLine);
+            if (inputLen >= 0) {
+                // The line is recorded even if it fails, a history file
+                // that can't be written doesn't stop the shell
+                if (interactive) {
+                    history_add(inputLine, inputLen);
                 }
+                runLine(&input, inputLine, inputLen);
             } else {
-                // Quit on Ctrl-D
+                if (inputLen == -2) {
+                    perror("sane: read");
+                }
+                // Quit on Ctrl-D or end of script
                 break;
             }
         }
 
-        free(inputLine);
-        // Shutdown shell
+        // Shutdown shell, the completions point into its caches
+        lineedit_clear();
+        execindex_clear();
         sane_shutdown();
     } else {
         fprintf(stderr, "sane: initialization of shell failed\n");
     }
 
-    return 0;
+    input_close(&input);
+
+    // Scripts and '-c' report the status of their last command
+    return interactive ? 0 : lastStatus;
 }
@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "arena.h"
+#include "command.h"
+#include "parsecache.h"
+#include "strmap.h"
+#include "variable.h"
+#include "wildcard.h"
+
+// Maximum number of lines in the cache
+#define SANE_PARSE_CACHE_SIZE 256
+// Directories modified less than this many seconds before a line was parsed
+// could be modified again without their mtime changing, such lines aren't
+// cached
+#define SANE_PARSE_CACHE_RACY_SECONDS 2
+
+// Directory the parse of a line depends on
+typedef struct sane_parseCacheDep_t {
+    char *dir; // path of the directory, relative to the working directory
+    int missing; // 1 if the directory didn't exist
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+} sane_parseCacheDep_t;
+
+typedef struct sane_parseCacheEntry_t {
+    char *line;
+    command_t *commands;
+    int numCommands;
+    sane_parseCacheDep_t *deps;
+    int numDeps;
+    int variables; // 1 if the line has variables to expand
+    unsigned long generation; // variable_generation() when it was parsed
+    arena_t arena; // everything above is allocated from the arena
+    struct sane_parseCacheEntry_t *prev; // more recently used line
+    struct sane_parseCacheEntry_t *next; // less recently used line
+    int refs;     // number of lookups not yet released
+    int detached; // 1 if removed from the cache while still referenced
+} sane_parseCacheEntry_t;
+
+// Line -> sane_parseCacheEntry_t *
+static strmap_t sane_parseCacheMap;
+// Most and least recently used lines
+static sane_parseCacheEntry_t *sane_parseCacheHead = NULL;
+static sane_parseCacheEntry_t *sane_parseCacheTail = NULL;
+
+static unsigned long sane_parseCacheHits = 0;
+static unsigned long sane_parseCacheMisses = 0;
+
+static void sane_parseCacheUnlink(sane_parseCacheEntry_t *entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        sane_parseCacheHead = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        sane_parseCacheTail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void sane_parseCachePushFront(sane_parseCacheEntry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = sane_parseCacheHead;
+    if (sane_parseCacheHead != NULL) {
+        sane_parseCacheHead->prev = entry;
+    } else {
+        sane_parseCacheTail = entry;
+    }
+    sane_parseCacheHead = entry;
+}
+
+static void sane_parseCacheFree(sane_parseCacheEntry_t *entry)
+{
+    arena_destroy(&entry->arena);
+    free(entry);
+}
+
+// Remove a line from the cache, it is freed once no longer referenced
+static void sane_parseCacheDrop(sane_parseCacheEntry_t *entry)
+{
+    strmap_remove(&sane_parseCacheMap, entry->line);
+    sane_parseCacheUnlink(entry);
+
+    if (entry->refs > 0) {
+        entry->detached = 1;
+    } else {
+        sane_parseCacheFree(entry);
+    }
+}
+
+// Returns 1 if the directory is still as it was when the line was parsed
+static int sane_parseCacheDepValid(const sane_parseCacheDep_t *dep)
+{
+    struct stat st;
+    if (stat(dep->dir, &st) != 0) {
+        return dep->missing;
+    }
+
+    return !dep->missing && st.st_dev == dep->dev && st.st_ino == dep->ino &&
+           st.st_mtim.tv_sec == dep->mtime.tv_sec &&
+           st.st_mtim.tv_nsec == dep->mtime.tv_nsec;
+}
+
+sane_parseCacheEntry_t *
+sane_parseCacheLookup(const char *line, command_t **commands, int *numCommands)
+{
+    sane_parseCacheEntry_t *entry =
+        (sane_parseCacheEntry_t *)strmap_get(&sane_parseCacheMap, line);
+    if (entry == NULL) {
+        ++sane_parseCacheMisses;
+        return NULL;
+    }
+
+    // Variables may have been set or unset since
+    if (entry->variables && entry->generation != variable_generation()) {
+        sane_parseCacheDrop(entry);
+        ++sane_parseCacheMisses;
+        return NULL;
+    }
+    for (int i = 0; i < entry->numDeps; ++i) {
+        if (!sane_parseCacheDepValid(&entry->deps[i])) {
+            sane_parseCacheDrop(entry);
+            ++sane_parseCacheMisses;
+            return NULL;
+        }
+    }
+
+    sane_parseCacheUnlink(entry);
+    sane_parseCachePushFront(entry);
+
+    ++sane_parseCacheHits;
+    ++entry->refs;
+    *commands = entry->commands;
+    *numCommands = entry->numCommands;
+
+    return entry;
+}
+
+void sane_parseCacheRelease(sane_parseCacheEntry_t *entry)
+{
+    if (--entry->refs == 0 && entry->detached) {
+        sane_parseCacheFree(entry);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the directory whose contents the expansion of a token depends on, and
+/// add it to the line's dependencies.
+///
+/// @return   int, 0 if successful, -1 if the line can't be cached.
+////////////////////////////////////////////////////////////////////////////////
+static int sane_parseCacheAddDep(sane_parseCacheEntry_t *entry,
+                                 const char *token,
+                                 int *capacity)
+{
+    // '~' is expanded using HOME
+    if (token[0] == '~') {
+        return -1;
+    }
+    // The directory a wildcard is expanded in may come from a variable
+    if (strchr(token, '$') != NULL && wildcard_hasMagic(token)) {
+        return -1;
+    }
+
+    // Tokens without wildcards expand to themselves (e.g. '[' of 'test')
+    if (!wildcard_hasMagic(token)) {
+        return 0;
+    }
+    const char *slash = strrchr(token, '/');
+
+    char *dir;
+    if (slash == NULL) {
+        dir = arena_strdup(&entry->arena, ".");
+    } else if (slash == token) {
+        dir = arena_strdup(&entry->arena, "/");
+    } else {
+        size_t len = slash - token;
+        dir = (char *)arena_alloc(&entry->arena, len + 1);
+        if (dir != NULL) {
+            memcpy(dir, token, len);
+            dir[len] = '\0';
+        }
+    }
+    if (dir == NULL) {
+        return -1;
+    }
+
+    // Expanding wildcards in directory names reads more than one directory
+    if (wildcard_hasMagic(dir)) {
+        return -1;
+    }
+
+    for (int i = 0; i < entry->numDeps; ++i) {
+        if (strcmp(entry->deps[i].dir, dir) == 0) {
+            return 0;
+        }
+    }
+
+    if (entry->numDeps == *capacity) {
+        int newCapacity = (*capacity > 0) ? *capacity * 2 : 4;
+        size_t depSize = sizeof(sane_parseCacheDep_t);
+        sane_parseCacheDep_t *deps = (sane_parseCacheDep_t *)arena_realloc(
+            &entry->arena, entry->deps, depSize * *capacity,
+            depSize * newCapacity);
+        if (deps == NULL) {
+            return -1;
+        }
+        entry->deps = deps;
+        *capacity = newCapacity;
+    }
+
+    sane_parseCacheDep_t *dep = &entry->deps[entry->numDeps++];
+    memset(dep, 0, sizeof(sane_parseCacheDep_t));
+    dep->dir = dir;
+
+    struct stat st;
+    if (stat(dir, &st) != 0) {
+        dep->missing = 1;
+        return 0;
+    }
+
+    // A directory modified in the same tick as a later modification has the
+    // same mtime, the change would go unnoticed
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec - st.st_mtim.tv_sec < SANE_PARSE_CACHE_RACY_SECONDS) {
+        return -1;
+    }
+
+    dep->dev = st.st_dev;
+    dep->ino = st.st_ino;
+    dep->mtime = st.st_mtim;
+
+    return 0;
+}
+
+// Copy a command into the entry's arena. Returns 0 if successful, -1 if out of
+// memory.
+static int sane_parseCacheCopyCommand(sane_parseCacheEntry_t *entry,
+                                      command_t *dst,
+                                      const command_t *src)
+{
+    arena_t *arena = &entry->arena;
+
+    dst->first = src->first;
+    dst->last = src->last;
+    // The separator points into the line's tokens
+    if (strcmp(src->sep, SEP_PIPE) == 0) {
+        dst->sep = SEP_PIPE;
+    } else if (strcmp(src->sep, SEP_CON) == 0) {
+        dst->sep = SEP_CON;
+    } else {
+        dst->sep = SEP_SEQ;
+    }
+
+    int argc = 0;
+    while (src->argv[argc] != NULL) {
+        ++argc;
+    }
+    dst->argv = (char **)arena_alloc(arena, sizeof(char *) * (argc + 1));
+    if (dst->argv == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < argc; ++i) {
+        dst->argv[i] = arena_strdup(arena, src->argv[i]);
+        if (dst->argv[i] == NULL) {
+            return -1;
+        }
+    }
+    dst->argv[argc] = NULL;
+
+    dst->numExpanded = src->numExpanded;
+    dst->numTrailing = src->numTrailing;
+
+    dst->stdin_file = NULL;
+    if (src->stdin_file != NULL &&
+        (dst->stdin_file = arena_strdup(arena, src->stdin_file)) == NULL) {
+        return -1;
+    }
+    dst->stdout_file = NULL;
+    if (src->stdout_file != NULL &&
+        (dst->stdout_file = arena_strdup(arena, src->stdout_file)) == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void sane_parseCacheInsert(const char *line,
+                           char *token[],
+                           int numTokens,
+                           command_t *commands,
+                           int numCommands)
+{
+    sane_parseCacheEntry_t *entry =
+        (sane_parseCacheEntry_t *)malloc(sizeof(sane_parseCacheEntry_t));
+    if (entry == NULL) {
+        return;
+    }
+    memset(entry, 0, sizeof(sane_parseCacheEntry_t));
+    arena_init(&entry->arena);
+    entry->generation = variable_generation();
+
+    int depCapacity = 0;
+    for (int i = 0; i < numTokens; ++i) {
+        // Variables are expanded in double quotes too
+        if (strchr(token[i], '$') != NULL) {
+            entry->variables = 1;
+        }
+        // Quoted arguments aren't expanded, redirection file names always are
+        if ((token[i][0] == '"' || token[i][0] == '\'') &&
+            (i == 0 || (strcmp(token[i - 1], REDIR_IN) != 0 &&
+                        strcmp(token[i - 1], REDIR_OUT) != 0))) {
+            continue;
+        }
+        if (sane_parseCacheAddDep(entry, token[i], &depCapacity) != 0) {
+            sane_parseCacheFree(entry);
+            return;
+        }
+    }
+
+    entry->line = arena_strdup(&entry->arena, line);
+    entry->commands = (command_t *)arena_alloc(
+        &entry->arena, sizeof(command_t) * numCommands);
+    if (entry->line == NULL || entry->commands == NULL) {
+        sane_parseCacheFree(entry);
+        return;
+    }
+    entry->numCommands = numCommands;
+    for (int i = 0; i < numCommands; ++i) {
+        if (sane_parseCacheCopyCommand(entry, &entry->commands[i],
+                                       &commands[i]) != 0) {
+            sane_parseCacheFree(entry);
+            return;
+        }
+    }
+
+    // Replace an out of date copy of the line, make room for the line
+    sane_parseCacheEntry_t *previous =
+        (sane_parseCacheEntry_t *)strmap_get(&sane_parseCacheMap, line);
+    if (previous != NULL) {
+        sane_parseCacheDrop(previous);
+    } else if (sane_parseCacheMap.count >= SANE_PARSE_CACHE_SIZE) {
+        sane_parseCacheDrop(sane_parseCacheTail);
+    }
+
+    if (strmap_put(&sane_parseCacheMap, entry->line, entry, NULL) != 0) {
+        sane_parseCacheFree(entry);
+        return;
+    }
+    sane_parseCachePushFront(entry);
+}
+
+void sane_parseCacheClear()
+{
+    while (sane_parseCacheHead != NULL) {
+        sane_parseCacheDrop(sane_parseCacheHead);
+    }
+
+    strmap_destroy(&sane_parseCacheMap, NULL);
+
+    sane_parseCacheHits = 0;
+    sane_parseCacheMisses = 0;
+}
+
+void sane_parseCachePrint(FILE *stream)
+{
+    fprintf(stream, "lines\t%zu/%d\n", sane_parseCacheMap.count,
+            SANE_PARSE_CACHE_SIZE);
+    fprintf(stream, "hits\t%lu\n", sane_parseCacheHits);
+    fprintf(stream, "misses\t%lu\n", sane_parseCacheMisses);
+}
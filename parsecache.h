@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse cache (see the 'cache' builtin).
+///
+/// Maps an input line to the commands it was parsed into, so that a line that
+/// is run again skips tokenise() and separateCommands(). The least recently
+/// used line is dropped once the cache is full.
+///
+/// Arguments and redirections that went through wildcard expansion depend on
+/// the contents of a directory. The directory is recorded with the line, and
+/// the line is parsed again if the directory changed (mtime, inode) since.
+/// Lines with variables (see variable.h) are parsed again once a variable was
+/// set or unset.
+////////////////////////////////////////////////////////////////////////////////
+
+// Forward declaration
+struct command_t;
+struct sane_parseCacheEntry_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the commands of a previously parsed line.
+///
+/// @param   line          const char *, input line.
+/// @param   commands      command_t **, set to the cached commands.
+/// @param   numCommands   int *, set to the number of cached commands.
+/// @return                sane_parseCacheEntry_t *, handle of the cached line
+///                        to pass to sane_parseCacheRelease() once the
+///                        commands have been executed, NULL if the line isn't
+///                        cached or is out of date.
+////////////////////////////////////////////////////////////////////////////////
+struct sane_parseCacheEntry_t *
+sane_parseCacheLookup(const char *line,
+                      struct command_t **commands,
+                      int *numCommands);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release a line found with sane_parseCacheLookup(). Its commands must not be
+/// used afterwards.
+///
+/// @param   entry   sane_parseCacheEntry_t *, handle of the cached line.
+////////////////////////////////////////////////////////////////////////////////
+void sane_parseCacheRelease(struct sane_parseCacheEntry_t *entry);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Add a parsed line to the cache. The commands are copied. Lines whose parse
+/// can't be validated later (e.g. '~' expansion, wildcards in directory names
+/// or a directory modified too recently to tell later changes apart) are not
+/// added.
+///
+/// @param   line          const char *, input line, as it was before
+///                        tokenise().
+/// @param   token         char *[], tokens of the line.
+/// @param   numTokens     int, number of tokens.
+/// @param   commands      command_t *, commands the line was parsed into.
+/// @param   numCommands   int, number of commands.
+////////////////////////////////////////////////////////////////////////////////
+void sane_parseCacheInsert(const char *line,
+                           char *token[],
+                           int numTokens,
+                           struct command_t *commands,
+                           int numCommands);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove all lines from the cache and reset the hit and miss counts.
+////////////////////////////////////////////////////////////////////////////////
+void sane_parseCacheClear();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the number of cached lines, hits and misses.
+///
+/// @param   stream   FILE *, stream to print to.
+////////////////////////////////////////////////////////////////////////////////
+void sane_parseCachePrint(FILE *stream);
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pathhash.h"
+#include "strmap.h"
+#include "variable.h"
+
+// Cached location of a command
+typedef struct sane_hashEntry_t {
+    char *path;        // absolute path of the command
+    unsigned int hits; // number of times the path was looked up
+} sane_hashEntry_t;
+
+// Command name -> sane_hashEntry_t *
+static strmap_t sane_hashMap;
+// Value of PATH the cached entries were found with
+static char *sane_hashPathVar = NULL;
+// Last command found in a relative directory of PATH, not cached
+static char *sane_hashRelative = NULL;
+
+static void sane_hashFreeEntry(void *value)
+{
+    sane_hashEntry_t *entry = (sane_hashEntry_t *)value;
+
+    free(entry->path);
+    free(entry);
+}
+
+void sane_hashClear()
+{
+    strmap_destroy(&sane_hashMap, &sane_hashFreeEntry);
+    free(sane_hashRelative);
+    sane_hashRelative = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Empty the cache if PATH changed since the cached entries were found.
+///
+/// @return   const char *, current value of PATH.
+////////////////////////////////////////////////////////////////////////////////
+static const char *sane_hashCheckPath()
+{
+    // The shell's PATH variable, commands are started with its environment
+    const char *path = variable_get("PATH");
+    if (path == NULL) {
+        // Same default as execvp()
+        path = "/bin:/usr/bin";
+    }
+
+    if (sane_hashPathVar == NULL || strcmp(sane_hashPathVar, path) != 0) {
+        sane_hashClear();
+
+        free(sane_hashPathVar);
+        sane_hashPathVar = strdup(path);
+    }
+
+    return path;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Search each directory in PATH for an executable regular file called name.
+///
+/// @param   relative   int *, set to 1 if the file was found in a relative
+///                     directory of PATH (including the empty entry, meaning
+///                     the current directory). Such a result depends on the
+///                     working directory and must not be cached.
+/// @return             char *, dynamically allocated path, NULL if not found.
+////////////////////////////////////////////////////////////////////////////////
+static char *sane_hashSearch(const char *path, const char *name, int *relative)
+{
+    size_t nameLen = strlen(name);
+    const char *dir = path;
+
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dirLen = (end != NULL) ? (size_t)(end - dir) : strlen(dir);
+        if (dirLen == 0) {
+            dir = ".";
+            dirLen = 1;
+        }
+
+        // + 2 for '/' and NULL-terminator
+        char *candidate = (char *)malloc(dirLen + nameLen + 2);
+        if (candidate == NULL) {
+            return NULL;
+        }
+        memcpy(candidate, dir, dirLen);
+        candidate[dirLen] = '/';
+        memcpy(candidate + dirLen + 1, name, nameLen + 1);
+
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate, X_OK) == 0) {
+            *relative = (candidate[0] != '/');
+            return candidate;
+        }
+        free(candidate);
+
+        if (end == NULL) {
+            break;
+        }
+        dir = end + 1;
+    }
+
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param    uncached   int *, set to 1 if the command was found but can not be
+///                      cached, its path is then in sane_hashRelative.
+/// @return   sane_hashEntry_t *, cache entry of the command, NULL if the
+///           command could not be found or can not be cached.
+////////////////////////////////////////////////////////////////////////////////
+static sane_hashEntry_t *sane_hashFind(const char *name, int *uncached)
+{
+    const char *path = sane_hashCheckPath();
+
+    sane_hashEntry_t *entry =
+        (sane_hashEntry_t *)strmap_get(&sane_hashMap, name);
+    if (entry == NULL) {
+        int relative = 0;
+        char *found = sane_hashSearch(path, name, &relative);
+        if (found == NULL) {
+            return NULL;
+        }
+        if (relative) {
+            free(sane_hashRelative);
+            sane_hashRelative = found;
+            *uncached = 1;
+            return NULL;
+        }
+
+        entry = (sane_hashEntry_t *)malloc(sizeof(sane_hashEntry_t));
+        if (entry == NULL) {
+            free(found);
+            return NULL;
+        }
+        entry->path = found;
+        entry->hits = 0;
+
+        if (strmap_put(&sane_hashMap, name, entry, NULL) != 0) {
+            sane_hashFreeEntry(entry);
+            return NULL;
+        }
+    }
+
+    return entry;
+}
+
+const char *sane_hashLookup(const char *name)
+{
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    int uncached = 0;
+    sane_hashEntry_t *entry = sane_hashFind(name, &uncached);
+    if (entry == NULL) {
+        return uncached ? sane_hashRelative : NULL;
+    }
+    ++entry->hits;
+
+    return entry->path;
+}
+
+int sane_hashAdd(const char *name)
+{
+    if (strchr(name, '/') != NULL) {
+        return -1;
+    }
+
+    int uncached = 0;
+    return (sane_hashFind(name, &uncached) != NULL) ? 0 : -1;
+}
+
+int sane_hashForget(const char *name)
+{
+    sane_hashEntry_t *entry =
+        (sane_hashEntry_t *)strmap_remove(&sane_hashMap, name);
+    if (entry == NULL) {
+        return -1;
+    }
+    sane_hashFreeEntry(entry);
+
+    return 0;
+}
+
+void sane_hashPrint(FILE *stream)
+{
+    if (sane_hashMap.count == 0) {
+        fprintf(stream, "hash: hash table empty\n");
+        return;
+    }
+
+    fprintf(stream, "hits\tcommand\n");
+
+    size_t it = 0;
+    const char *name;
+    void *value;
+    while (strmap_next(&sane_hashMap, &it, &name, &value)) {
+        sane_hashEntry_t *entry = (sane_hashEntry_t *)value;
+        fprintf(stream, "%4u\t%s\n", entry->hits, entry->path);
+    }
+}
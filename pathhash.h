@@ -0,0 +1,50 @@
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Command location cache (see the 'hash' builtin).
+///
+/// Maps the name of an external command to the absolute path found by
+/// searching PATH, so that launching a command is a single execve() instead of
+/// one failed execve() for each PATH directory before the right one. The cache
+/// is emptied whenever PATH changes.
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the path of the given command, searching PATH if it is not cached yet.
+///
+/// @param   name   const char *, name of the command (argv[0]).
+/// @return         const char *, path to execute, NULL if the command could
+///                 not be found. Names containing a '/' are returned as is.
+///                 Commands found in a relative PATH directory are returned
+///                 relative to the working directory, and aren't cached.
+///                 Only valid until the next call to a sane_hash function.
+////////////////////////////////////////////////////////////////////////////////
+const char *sane_hashLookup(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Add a command to the cache without executing it.
+///
+/// @param   name   const char *, name of the command.
+/// @return         int, 0 if successful, -1 if the command could not be found.
+////////////////////////////////////////////////////////////////////////////////
+int sane_hashAdd(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove a command from the cache, e.g. because the cached binary is gone.
+///
+/// @param   name   const char *, name of the command.
+/// @return         int, 0 if the command was cached, -1 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int sane_hashForget(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove all commands from the cache.
+////////////////////////////////////////////////////////////////////////////////
+void sane_hashClear();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the cached commands and the number of times each was used.
+///
+/// @param   stream   FILE *, stream to print to.
+////////////////////////////////////////////////////////////////////////////////
+void sane_hashPrint(FILE *stream);
@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pipeconf.h"
+
+static pipeconf_t pipeconf_settings = {0};
+
+pipeconf_t *pipeconf_global()
+{
+    return &pipeconf_settings;
+}
+
+// Parse a size such as '65536', '256k' or '1M', returns -1 if invalid
+static long pipeconf_parseSize(const char *text)
+{
+    char *end;
+    errno = 0;
+    long size = strtol(text, &end, 10);
+    if (errno != 0 || end == text || size < 0) {
+        return -1;
+    }
+
+    if (*end == 'k' || *end == 'K') {
+        size *= 1024;
+        ++end;
+    } else if (*end == 'm' || *end == 'M') {
+        size *= 1024 * 1024;
+        ++end;
+    }
+
+    return (*end == '\0' && size <= 1L << 30) ? size : -1;
+}
+
+// Parse a list of CPUs such as '0-3,6' into conf, returns 0 if successful, -1
+// if invalid
+static int pipeconf_parseCpus(const char *text, pipeconf_t *conf)
+{
+    CPU_ZERO(&conf->cpus);
+    conf->numCpus = 0;
+    if (strcmp(text, "all") == 0) {
+        return 0;
+    }
+
+    const char *p = text;
+    while (1) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &conf->cpus);
+        }
+
+        if (*end == '\0') {
+            break;
+        } else if (*end != ',') {
+            return -1;
+        }
+        p = end + 1;
+    }
+
+    // Only CPUs the shell may run on can be used
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        CPU_AND(&conf->cpus, &conf->cpus, &allowed);
+    }
+    conf->numCpus = CPU_COUNT(&conf->cpus);
+
+    return conf->numCpus > 0 ? 0 : -1;
+}
+
+int pipeconf_parse(int argc, char **argv, pipeconf_t *conf)
+{
+    int i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "--") == 0) {
+            return i + 1;
+        }
+
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            fprintf(stderr, "pipeconf: %s: missing value\n", argv[i]);
+            return -1;
+        }
+
+        if (strcmp(argv[i], "-s") == 0) {
+            long size = pipeconf_parseSize(value);
+            if (size < 0) {
+                fprintf(stderr, "pipeconf: %s: invalid size\n", value);
+                return -1;
+            }
+            conf->size = size;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            if (pipeconf_parseCpus(value, conf) != 0) {
+                fprintf(stderr, "pipeconf: %s: invalid CPU list\n", value);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-a") == 0 &&
+                   (strcmp(value, "on") == 0 || strcmp(value, "off") == 0)) {
+            conf->adaptive = strcmp(value, "on") == 0;
+        } else {
+            fprintf(stderr, "usage: pipeconf [-s size] [-c cpus] "
+                            "[-a on|off] [command...]\n");
+            return -1;
+        }
+        i += 2;
+    }
+
+    return i;
+}
+
+void pipeconf_print(FILE *stream, const pipeconf_t *conf)
+{
+    if (conf->size > 0) {
+        fprintf(stream, "size %d\n", conf->size);
+    } else {
+        fprintf(stream, "size default\n");
+    }
+
+    fprintf(stream, "cpus ");
+    if (conf->numCpus == 0) {
+        fprintf(stream, "all");
+    }
+    // Print runs of CPUs as ranges
+    const char *sep = "";
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &conf->cpus)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &conf->cpus)) {
+            ++last;
+        }
+        if (last == cpu) {
+            fprintf(stream, "%s%d", sep, cpu);
+        } else {
+            fprintf(stream, "%s%d-%d", sep, cpu, last);
+        }
+        sep = ",";
+        cpu = last;
+    }
+    fprintf(stream, "\n");
+
+    fprintf(stream, "adaptive %s\n", conf->adaptive ? "on" : "off");
+}
+
+int pipeconf_pipe(int fds[2], const pipeconf_t *conf)
+{
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return -1;
+    }
+
+    // The kernel rounds the size up to a power of two pages and refuses sizes
+    // over /proc/sys/fs/pipe-max-size, the pipe keeps its default then
+    if (conf->size > 0) {
+        fcntl(fds[1], F_SETPIPE_SZ, conf->size);
+    }
+
+    return 0;
+}
+
+void pipeconf_pin(const pipeconf_t *conf, pid_t pid, int stage)
+{
+    if (conf->numCpus == 0) {
+        return;
+    }
+
+    // Stage n runs on the n-th CPU of the list, wrapping around
+    int n = stage % conf->numCpus;
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &conf->cpus) || n-- > 0) {
+        ++cpu;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    sched_setaffinity(pid, sizeof(cpus), &cpus);
+}
@@ -0,0 +1,74 @@
+#include <sched.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Settings for the pipes and processes of pipelines (see the 'pipeconf'
+/// builtin):
+///
+///     pipeconf [-s size] [-c cpus] [-a on|off] [command...]
+///
+/// Without a command the settings apply to the pipelines that follow,
+/// otherwise only to the pipeline the command starts:
+///
+///     pipeconf -s 1M -c 2-3 zcat log.gz | parse | aggregate
+///
+///  - size: capacity of the pipes (F_SETPIPE_SZ) in bytes, with an optional k
+///    or M suffix, 0 for the kernel's default.
+///  - cpus: list of CPUs (e.g. '0-3,6'), the stages of a pipeline are pinned
+///    to them in turn, 'all' to let them run anywhere. CPUs the shell may
+///    not run on are left out.
+///  - adaptive: builtins writing to a pipe that stays full grow it, up to
+///    /proc/sys/fs/pipe-max-size.
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct pipeconf_t {
+    int size;       // pipe capacity in bytes, 0 for the kernel's default
+    cpu_set_t cpus; // CPUs the stages are pinned to
+    int numCpus;    // number of CPUs in cpus, 0 if stages aren't pinned
+    int adaptive;   // 1 if builtins grow pipes that stay full
+} pipeconf_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   pipeconf_t *, settings used by pipelines not started with
+///           'pipeconf options command...'.
+////////////////////////////////////////////////////////////////////////////////
+pipeconf_t *pipeconf_global();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse the options of 'pipeconf' into conf. Errors are printed to stderr.
+///
+/// @param   argc   int, number of arguments, including 'pipeconf'.
+/// @param   argv   char **, arguments.
+/// @param   conf   pipeconf_t *, settings to change.
+/// @return         int, index of the first argument after the options (argc
+///                 if there is no command), -1 if the options are invalid.
+////////////////////////////////////////////////////////////////////////////////
+int pipeconf_parse(int argc, char **argv, pipeconf_t *conf);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the settings, one 'name value' pair per line.
+///
+/// @param   stream   FILE *, stream to print to.
+/// @param   conf     const pipeconf_t *, settings to print.
+////////////////////////////////////////////////////////////////////////////////
+void pipeconf_print(FILE *stream, const pipeconf_t *conf);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Create a close-on-exec pipe with the configured capacity.
+///
+/// @param   fds    int [2], read and write ends out, like pipe().
+/// @param   conf   const pipeconf_t *, settings to use.
+/// @return         int, 0 if successful, -1 otherwise (errno is set). A
+///                 capacity the kernel refuses isn't an error.
+////////////////////////////////////////////////////////////////////////////////
+int pipeconf_pipe(int fds[2], const pipeconf_t *conf);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Pin a stage of a pipeline to its CPU, does nothing if stages aren't pinned.
+///
+/// @param   conf    const pipeconf_t *, settings to use.
+/// @param   pid     pid_t, process running the stage.
+/// @param   stage   int, index of the stage in its pipeline.
+////////////////////////////////////////////////////////////////////////////////
+void pipeconf_pin(const pipeconf_t *conf, pid_t pid, int stage);
@@ -0,0 +1,25 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Example of a builtin loaded at run time:
+///
+///     enable -f ./bin/emit.so emit
+///     emit requests 1
+///
+/// prints a metric in the Graphite plaintext format ("name value timestamp"),
+/// without starting a process for every sample.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int sane_builtin_emit(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: emit metric value\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%s %s %ld\n", argv[1], argv[2], (long)time(NULL));
+
+    return EXIT_SUCCESS;
+}
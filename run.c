@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "command.h"
+#include "parsecache.h"
+#include "run.h"
+#include "sane.h"
+#include "token.h"
+#include "trace.h"
+#include "wildcard.h"
+
+// Token, command and arena storage, grown on demand and reused for every line
+static char **sane_runToken = NULL;
+static int sane_runTokenCapacity = 0;
+static command_t *sane_runCommand = NULL;
+static int sane_runCommandCapacity = 0;
+// Memory for the commands of a single line, an all zero arena is empty
+static arena_t sane_runArena;
+
+// Copy of the line being parsed, tokenise() modifies the line
+static char *sane_runLine = NULL;
+static size_t sane_runLineSize = 0;
+
+// Description of the last redirection error, naming the token that caused it,
+// and the error it describes (0 if none)
+static char sane_runMessage[256];
+static int sane_runMessageError = 0;
+
+// memfd capturing the output of sane_runCapture(), created by the first call
+static int sane_runOutputFd = -1;
+
+// Name the token causing a redirection error in sane_runMessage, the tokens
+// of the line are still in sane_runToken
+static void sane_runDescribe(int error, int numTokens)
+{
+    sane_runMessageError = 0;
+
+    for (int i = 0; i < numTokens; ++i) {
+        if (strcmp(sane_runToken[i], REDIR_IN) != 0 &&
+            strcmp(sane_runToken[i], REDIR_OUT) != 0) {
+            continue;
+        }
+
+        const char *next = (i + 1 < numTokens) ? sane_runToken[i + 1] : NULL;
+        int noFile = next == NULL || strcmp(next, SEP_PIPE) == 0 ||
+                     strcmp(next, SEP_CON) == 0 || strcmp(next, SEP_SEQ) == 0;
+        char **paths;
+        if (error == SANE_RUN_REDIRECTION_FILE && noFile) {
+            snprintf(sane_runMessage, sizeof(sane_runMessage),
+                     "syntax error, expected path after token '%s'",
+                     sane_runToken[i]);
+        } else if (error == SANE_RUN_AMBIGUOUS_REDIRECT && !noFile &&
+                   wildcard_expand(next, 0, &paths) > 1) {
+            snprintf(sane_runMessage, sizeof(sane_runMessage),
+                     "%s: ambiguous redirect", next);
+        } else {
+            continue;
+        }
+
+        sane_runMessageError = error;
+        return;
+    }
+}
+
+// Parse and execute the line, see sane_run()
+static int sane_runParse(const char *line, int *status)
+{
+    // Reuse the commands of a line that was run before
+    TRACE_START(lookup);
+    command_t *cached;
+    int numCached;
+    struct sane_parseCacheEntry_t *entry =
+        sane_parseCacheLookup(line, &cached, &numCached);
+    TRACE_END(lookup, "parseCacheLookup", entry != NULL ? "hit" : "miss");
+    if (entry != NULL) {
+        TRACE_START(execute);
+        *status = sane_execute(numCached, cached);
+        TRACE_END(execute, "execute", cached[0].argv[0]);
+        sane_parseCacheRelease(entry);
+        return 0;
+    }
+
+    size_t lineLen = strlen(line);
+    if (lineLen + 1 > sane_runLineSize) {
+        char *copy = (char *)realloc(sane_runLine, lineLen + 1);
+        if (copy == NULL) {
+            return SANE_RUN_NO_MEMORY;
+        }
+        sane_runLine = copy;
+        sane_runLineSize = lineLen + 1;
+    }
+    memcpy(sane_runLine, line, lineLen + 1);
+
+    TRACE_START(tokens);
+    int numTokens =
+        tokenise(sane_runLine, &sane_runToken, &sane_runTokenCapacity);
+    TRACE_END(tokens, "tokenise", NULL);
+    if (numTokens == -1) {
+        return SANE_RUN_NO_MEMORY;
+    } else if (numTokens == -2) {
+        return SANE_RUN_UNCLOSED_STRING;
+    }
+
+    TRACE_START(separate);
+    int numCommands =
+        separateCommands(sane_runToken, numTokens, &sane_runCommand,
+                         &sane_runCommandCapacity, &sane_runArena);
+    TRACE_END(separate, "separateCommands", NULL);
+    if (numCommands < 0) {
+        // The parse errors follow separateCommands()' error codes
+        int error = numCommands == -1 ? SANE_RUN_NO_MEMORY : numCommands - 1;
+        if (error == SANE_RUN_REDIRECTION_FILE ||
+            error == SANE_RUN_AMBIGUOUS_REDIRECT) {
+            sane_runDescribe(error, numTokens);
+        }
+        return error;
+    } else if (numCommands == 0) {
+        return 0;
+    }
+
+    TRACE_START(insert);
+    sane_parseCacheInsert(line, sane_runToken, numTokens, sane_runCommand,
+                          numCommands);
+    TRACE_END(insert, "parseCacheInsert", NULL);
+
+    TRACE_START(execute);
+    *status = sane_execute(numCommands, sane_runCommand);
+    TRACE_END(execute, "execute", sane_runCommand[0].argv[0]);
+
+    TRACE_START(free);
+    freeCommands(sane_runCommand, numCommands, &sane_runArena);
+    TRACE_END(free, "freeCommands", NULL);
+
+    return 0;
+}
+
+int sane_run(const char *line, int *status)
+{
+    TRACE_START(span);
+    int result = sane_runParse(line, status);
+    TRACE_END(span, "line", NULL);
+
+    return result;
+}
+
+// Copy the first 'size' - 1 bytes of the capture to 'output'. Returns the
+// length of the capture, -1 on error.
+static ssize_t sane_runReadOutput(char *output, size_t size)
+{
+    struct stat outputStat;
+    if (fstat(sane_runOutputFd, &outputStat) != 0) {
+        return -1;
+    }
+
+    size_t length = outputStat.st_size;
+    size_t numCopied = 0;
+    while (numCopied + 1 < size && numCopied < length) {
+        ssize_t numRead = pread(sane_runOutputFd, output + numCopied,
+                                size - 1 - numCopied, numCopied);
+        if (numRead <= 0) {
+            break;
+        }
+        numCopied += numRead;
+    }
+    if (size > 0) {
+        output[numCopied] = '\0';
+    }
+
+    return length;
+}
+
+int sane_runCapture(const char *line,
+                    int *status,
+                    char *output,
+                    size_t size,
+                    size_t *outputLen)
+{
+    // Children write to the memfd directly, so the output doesn't pass
+    // through a pipe the shell would have to drain while the line runs
+    if (sane_runOutputFd == -1) {
+        sane_runOutputFd = memfd_create("sane_run", MFD_CLOEXEC);
+        if (sane_runOutputFd == -1) {
+            return SANE_RUN_CAPTURE;
+        }
+    } else if (ftruncate(sane_runOutputFd, 0) != 0 ||
+               lseek(sane_runOutputFd, 0, SEEK_SET) != 0) {
+        return SANE_RUN_CAPTURE;
+    }
+
+    fflush(stdout);
+    int stdoutCopy = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (stdoutCopy == -1) {
+        return SANE_RUN_CAPTURE;
+    }
+    if (dup2(sane_runOutputFd, STDOUT_FILENO) == -1) {
+        close(stdoutCopy);
+        return SANE_RUN_CAPTURE;
+    }
+
+    int result = sane_run(line, status);
+
+    // Builtins print through stdio
+    fflush(stdout);
+    dup2(stdoutCopy, STDOUT_FILENO);
+    close(stdoutCopy);
+
+    ssize_t length = sane_runReadOutput(output, size);
+    if (length < 0) {
+        return SANE_RUN_CAPTURE;
+    }
+    if (outputLen != NULL) {
+        *outputLen = length;
+    }
+
+    return result;
+}
+
+const char *sane_runError(int error)
+{
+    if (error == sane_runMessageError) {
+        return sane_runMessage;
+    }
+
+    switch (error) {
+    case SANE_RUN_NO_MEMORY:
+        return "out of memory";
+    case SANE_RUN_UNCLOSED_STRING:
+        return "string not closed";
+    case SANE_RUN_SUCCESSIVE_SEPARATORS:
+        return "at least two successive commands are separated by more than "
+               "one command separator";
+    case SANE_RUN_FIRST_SEPARATOR:
+        return "first token is command separator";
+    case SANE_RUN_LAST_PIPE:
+        return "last command followed by command separator '|'";
+    case SANE_RUN_REDIRECTION_FILE:
+        return "syntax error, expected path after redirection";
+    case SANE_RUN_AMBIGUOUS_REDIRECT:
+        return "ambiguous redirect";
+    case SANE_RUN_CAPTURE:
+        return "could not capture the output";
+    default:
+        return "unknown error";
+    }
+}
+
+void sane_runClear()
+{
+    arena_destroy(&sane_runArena);
+    free(sane_runCommand);
+    sane_runCommand = NULL;
+    sane_runCommandCapacity = 0;
+    free(sane_runToken);
+    sane_runToken = NULL;
+    sane_runTokenCapacity = 0;
+    free(sane_runLine);
+    sane_runLine = NULL;
+    sane_runLineSize = 0;
+
+    if (sane_runOutputFd != -1) {
+        close(sane_runOutputFd);
+        sane_runOutputFd = -1;
+    }
+}
@@ -0,0 +1,78 @@
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse and run lines of commands, the shell's API for programs linking
+/// libsane instead of running commands through system() or popen(), which
+/// start /bin/sh only to parse the line:
+///
+///     int status;
+///     char output[4096];
+///     size_t outputLen;
+///     sane_init();
+///     if (sane_runCapture("ls *.c | wc -l", &status, output, sizeof(output),
+///                         &outputLen) == 0) {
+///         ...
+///     }
+///     sane_shutdown();
+///
+/// sane_init() blocks SIGCHLD in the calling thread, the shell reaps its
+/// children through a signalfd. Builtins writing to a closed pipe get EPIPE
+/// only if the program ignores SIGPIPE, as the shell does.
+////////////////////////////////////////////////////////////////////////////////
+
+// Errors returned by sane_run() and sane_runCapture()
+#define SANE_RUN_NO_MEMORY -1
+#define SANE_RUN_UNCLOSED_STRING -2
+#define SANE_RUN_SUCCESSIVE_SEPARATORS -3
+#define SANE_RUN_FIRST_SEPARATOR -4
+#define SANE_RUN_LAST_PIPE -5
+#define SANE_RUN_REDIRECTION_FILE -6
+#define SANE_RUN_AMBIGUOUS_REDIRECT -7
+#define SANE_RUN_CAPTURE -8
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse and execute a line of commands.
+///
+/// @pre 'sane_init()' has been called.
+///
+/// @param   line     const char *, line to run, without the newline.
+/// @param   status   int *, set to the exit status of the line's last command.
+///                   Left unchanged if the line has no commands or can't be
+///                   parsed.
+/// @return           int, 0 if the line was run (or had no commands),
+///                   SANE_RUN_* if it couldn't be parsed, see sane_runError().
+////////////////////////////////////////////////////////////////////////////////
+int sane_run(const char *line, int *status);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run a line like sane_run() with its standard output captured, stdout of
+/// the shell is restored afterwards. Commands the line starts in the
+/// background keep writing to the capture, which is reset by the next call.
+///
+/// @param   line        const char *, line to run, without the newline.
+/// @param   status      int *, as for sane_run().
+/// @param   output      char *, buffer receiving the output, NUL terminated
+///                      (if 'size' isn't 0) and truncated to fit.
+/// @param   size        size_t, size of the buffer.
+/// @param   outputLen   size_t *, set to the length of the whole output, which
+///                      was truncated if it's at least 'size'. May be NULL.
+/// @return              int, as for sane_run(), SANE_RUN_CAPTURE if stdout
+///                      couldn't be redirected (the line isn't run).
+////////////////////////////////////////////////////////////////////////////////
+int sane_runCapture(const char *line,
+                    int *status,
+                    char *output,
+                    size_t size,
+                    size_t *outputLen);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   error   int, SANE_RUN_* error.
+/// @return          const char *, description of the error, naming the token
+///                  causing it for redirection errors of the last line run.
+////////////////////////////////////////////////////////////////////////////////
+const char *sane_runError(int error);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Free the memory kept between lines, called by sane_shutdown().
+////////////////////////////////////////////////////////////////////////////////
+void sane_runClear();
@@ -4,9 +4,14 @@
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,10 +19,35 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "argbatch.h"
+#include "builtin.h"
 #include "command.h"
+#include "fastcopy.h"
+#include "history.h"
+#include "job.h"
+#include "jobqueue.h"
+#include "parsecache.h"
+#include "pathhash.h"
+#include "pipeconf.h"
+#include "run.h"
 #include "sane.h"
+#include "timing.h"
+#include "trace.h"
+#include "utilities.h"
+#include "variable.h"
+#include "wildcard.h"
 
 static char *sane_promptString = NULL;
+// Exit status of the last builtin executed
+static int sane_builtinStatus = 0;
+// Set by the 'exit' builtin
+static int sane_exitFlag = 0;
+
+// See the builtin table below
+int sane_registerBuiltins();
+// See the job queue below
+void sane_dispatchJobs();
+void sane_drainJobs();
 
 const char *sane_getPrompt()
 {
@@ -45,6 +75,21 @@ int sane_init()
         result = 1;
     }
 
+    if (trace_init() != 0) {
+        result = 1;
+    }
+
+    if (result == 0 && sane_registerBuiltins() != 0) {
+        result = 1;
+    }
+
+    // Children are reaped through the job table
+    if (result == 0 && job_init() != 0) {
+        result = 1;
+    }
+    // Queued background pipelines start as running ones finish
+    job_setReapHandler(&sane_dispatchJobs);
+
     return result;
 }
 
@@ -53,6 +98,20 @@ void sane_shutdown()
     if (sane_promptString != NULL) {
         free(sane_promptString);
     }
+
+    sane_drainJobs();
+
+    sane_runClear();
+    history_clear();
+    variable_clear();
+    sane_builtinClear();
+    sane_hashClear();
+    sane_parseCacheClear();
+    wildcard_clear();
+
+    job_shutdown();
+
+    trace_shutdown();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -65,6 +124,18 @@ int sane_help(int argc, char **argv);
 int sane_prompt(int argc, char **argv);
 int sane_pwd(int argc, char **argv);
 int sane_cd(int argc, char **argv);
+int sane_spawn(int argc, char **argv);
+int sane_hash(int argc, char **argv);
+int sane_cache(int argc, char **argv);
+int sane_jobs(int argc, char **argv);
+int sane_wait(int argc, char **argv);
+int sane_enable(int argc, char **argv);
+int sane_pipeconf(int argc, char **argv);
+int sane_sched(int argc, char **argv);
+int sane_batch(int argc, char **argv);
+int sane_history(int argc, char **argv);
+int sane_export(int argc, char **argv);
+int sane_unset(int argc, char **argv);
 
 int sane_help(int argc, char **argv)
 {
@@ -89,9 +160,16 @@ int sane_help(int argc, char **argv)
     return EXIT_SUCCESS;
 }
 
+int sane_exitRequested()
+{
+    return sane_exitFlag;
+}
+
 int sane_exit(int argc, char **argv)
 {
-    kill(getpid(), SIGUSR1);
+    // A flag rather than a signal, which would kill a program using the
+    // shell as a library
+    sane_exitFlag = 1;
 
     return EXIT_SUCCESS;
 }
@@ -141,11 +219,130 @@ int sane_pwd(int argc, char **argv)
     return EXIT_SUCCESS;
 }
 
+int sane_hash(int argc, char **argv)
+{
+    int result = EXIT_SUCCESS;
+
+    if (argc == 1) {
+        sane_hashPrint(stdout);
+    } else if (strcmp(argv[1], "-r") == 0) {
+        sane_hashClear();
+    } else if (strcmp(argv[1], "-d") == 0) {
+        for (int i = 2; i < argc; ++i) {
+            if (sane_hashForget(argv[i]) != 0) {
+                fprintf(stderr, "hash: %s: not found\n", argv[i]);
+                result = EXIT_FAILURE;
+            }
+        }
+    } else if (argv[1][0] == '-') {
+        fprintf(stderr, "usage: hash [-r] [-d name ...] [name ...]\n");
+        result = EXIT_FAILURE;
+    } else {
+        for (int i = 1; i < argc; ++i) {
+            if (sane_hashAdd(argv[i]) != 0) {
+                fprintf(stderr, "hash: %s: not found\n", argv[i]);
+                result = EXIT_FAILURE;
+            }
+        }
+    }
+
+    return result;
+}
+
+int sane_cache(int argc, char **argv)
+{
+    if (argc == 1) {
+        sane_parseCachePrint(stdout);
+    } else if (argc == 2 && strcmp(argv[1], "-r") == 0) {
+        sane_parseCacheClear();
+        wildcard_clear();
+    } else {
+        fprintf(stderr, "usage: cache [-r]\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int sane_jobs(int argc, char **argv)
+{
+    if (argc != 1) {
+        fprintf(stderr, "usage: jobs\n");
+        return EXIT_FAILURE;
+    }
+
+    job_print(stdout, 0);
+
+    return EXIT_SUCCESS;
+}
+
+// Returns the oldest background job, starting queued pipelines if none is
+// left, NULL if there are no background jobs
+job_t *sane_firstBackground()
+{
+    for (int dispatched = 0; dispatched < 2; ++dispatched) {
+        // The pipeline running 'wait' is the only other job
+        for (job_t *job = job_first(); job != NULL; job = job->next) {
+            if (job->background) {
+                return job;
+            }
+        }
+        if (jobqueue_numPending() == 0) {
+            break;
+        }
+        sane_dispatchJobs();
+    }
+
+    return NULL;
+}
+
+int sane_wait(int argc, char **argv)
+{
+    int status = EXIT_SUCCESS;
+
+    if (argc == 1) {
+        // Wait for all background jobs, queued ones start as the running
+        // ones finish
+        job_t *job;
+        while ((job = sane_firstBackground()) != NULL) {
+            if (job_wait(job, 1) == -1) {
+                return 128 + SIGINT;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        // Accept both 'wait 1' and 'wait %1'
+        const char *it = (argv[i][0] == '%') ? argv[i] + 1 : argv[i];
+        char *end;
+        long id = strtol(it, &end, 10);
+        job_t *job = (*it != '\0' && *end == '\0') ? job_find(id) : NULL;
+        if (job == NULL || !job->background) {
+            fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        status = job_wait(job, 1);
+        if (status == -1) {
+            return 128 + SIGINT;
+        }
+    }
+
+    return status;
+}
+
 int sane_cd(int argc, char **argv)
 {
     if (argc == 1) {
         // No arguments given to cd, go home
-        if (chdir(getenv("HOME")) == -1) {
+        const char *home = variable_get("HOME");
+        if (home == NULL) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return EXIT_FAILURE;
+        }
+        if (chdir(home) == -1) {
             perror("cd");
             return EXIT_FAILURE;
         }
@@ -159,17 +356,125 @@ int sane_cd(int argc, char **argv)
     return EXIT_SUCCESS;
 }
 
-// Strings used to call built-in functions and function pointer
-// (note order matches in both arrays)
-char *sane_builtinStr[] = {"help", "exit", "prompt", "pwd", "cd"};
+// Compiled in builtins, registered by sane_init() (see 'enable')
+static sane_builtin_t sane_builtins[] = {
+    {"help", &sane_help},
+    {"exit", &sane_exit},
+    {"prompt", &sane_prompt},
+    {"pwd", &sane_pwd},
+    {"cd", &sane_cd},
+    {"spawn", &sane_spawn},
+    {"hash", &sane_hash},
+    {"cache", &sane_cache},
+    {"jobs", &sane_jobs},
+    {"wait", &sane_wait},
+    {"enable", &sane_enable},
+    {"pipeconf", &sane_pipeconf},
+    {"sched", &sane_sched},
+    {"batch", &sane_batch},
+    {"history", &sane_history},
+    {"export", &sane_export},
+    {"unset", &sane_unset},
+    {"cat", &sane_cat, &sane_catAccepts},
+    {"tee", &sane_tee, &sane_teeAccepts},
+    {"cp", &sane_cp, &sane_cpAccepts},
+    {"echo", &sane_echo},
+    {"printf", &sane_printf},
+    {"true", &sane_true},
+    {"false", &sane_false},
+    {"test", &sane_test},
+    {"[", &sane_test},
+};
+
+// Return the number of compiled in builtins.
+int sane_numBuiltins()
+{
+    return sizeof(sane_builtins) / sizeof(sane_builtin_t);
+}
+
+// Add the compiled in builtins to the registry, returns 0 if successful
+int sane_registerBuiltins()
+{
+    for (int i = 0; i < sane_numBuiltins(); ++i) {
+        if (sane_builtinRegister(&sane_builtins[i]) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
 
-int (*sane_builtinFuncs[])(int, char **) = {&sane_help, &sane_exit,
-                                            &sane_prompt, &sane_pwd, &sane_cd};
+int sane_enable(int argc, char **argv)
+{
+    int status = EXIT_SUCCESS;
 
-// Return the number of shell built-in functions.
-int sane_numBuiltins()
+    if (argc == 1) {
+        sane_builtinPrint(stdout);
+    } else if (argc >= 4 && strcmp(argv[1], "-f") == 0) {
+        for (int i = 3; i < argc; ++i) {
+            if (sane_builtinLoad(argv[2], argv[i]) != 0) {
+                status = EXIT_FAILURE;
+            }
+        }
+    } else if (strcmp(argv[1], "-n") == 0) {
+        for (int i = 2; i < argc; ++i) {
+            if (sane_builtinRemove(argv[i]) != 0) {
+                fprintf(stderr, "enable: %s: not a builtin\n", argv[i]);
+                status = EXIT_FAILURE;
+            }
+        }
+    } else if (strcmp(argv[1], "-d") == 0) {
+        for (int i = 2; i < argc; ++i) {
+            sane_builtin_t *builtin = sane_builtinFind(argv[i]);
+            if (builtin == NULL || builtin->handle == NULL) {
+                fprintf(stderr, "enable: %s: not dynamically loaded\n",
+                        argv[i]);
+                status = EXIT_FAILURE;
+                continue;
+            }
+            sane_builtinRemove(argv[i]);
+        }
+    } else if (argv[1][0] == '-') {
+        fprintf(stderr, "usage: enable [-n | -d] [name ...]\n"
+                        "       enable -f library name ...\n");
+        status = EXIT_FAILURE;
+    } else {
+        // Enable compiled in builtins again
+        for (int i = 1; i < argc; ++i) {
+            int j = 0;
+            while (j < sane_numBuiltins() &&
+                   strcmp(sane_builtins[j].name, argv[i]) != 0) {
+                ++j;
+            }
+            if (j == sane_numBuiltins()) {
+                fprintf(stderr, "enable: %s: not a builtin\n", argv[i]);
+                status = EXIT_FAILURE;
+            } else if (sane_builtinRegister(&sane_builtins[j]) != 0) {
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    return status;
+}
+
+// Return the builtin that runs the given command, NULL if it's an external
+// command (including utilities such as 'cat' given options they don't
+// handle).
+sane_builtin_t *sane_findBuiltin(command_t *command)
 {
-    return sizeof(sane_builtinStr) / sizeof(char *);
+    sane_builtin_t *builtin = sane_builtinFind(command->argv[0]);
+    if (builtin != NULL && builtin->accepts != NULL) {
+        int argc = 0;
+        while (command->argv[argc] != NULL) {
+            ++argc;
+        }
+        if (!(*builtin->accepts)(argc, command->argv)) {
+            return NULL;
+        }
+    }
+
+    return builtin;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -177,38 +482,616 @@ int sane_numBuiltins()
 ////////////////////////////////////////////////////////////////////////////////
 
 ////////////////////////////////////////////////////////////////////////////////
-/// For 'n' commands we need 'n - 1' pipe structures, which are made up of 2
-/// file descriptors each.
+/// The pipes of a pipeline are created one at a time as its commands are
+/// started, so the shell holds at most three pipe fds however long the
+/// pipeline is: the read end of the pipe into the command being started and
+/// both ends of the pipe out of it. Pipes are close-on-exec, external commands
+/// only keep the ends dup2()'d onto their stdin and stdout.
 ////////////////////////////////////////////////////////////////////////////////
-#define MAX_NUM_PIPES ((MAX_NUM_COMMANDS - 1) * 2)
 
-// Where we store our pipes
-int sane_pipes[MAX_NUM_PIPES];
-// Number of pipes currently open
-unsigned int sane_numPipes = 0;
+#define SANE_PIPE_IN 0   // read end of the pipe into the command
+#define SANE_PIPE_NEXT 1 // read end of the pipe out of the command
+#define SANE_PIPE_OUT 2  // write end of the pipe out of the command
+#define SANE_NUM_PIPE_FDS 3
+
+// Pipe fds held by the shell, -1 if closed
+static int sane_pipes[SANE_NUM_PIPE_FDS] = {-1, -1, -1};
+
+// Close one of the pipe fds held by the shell, e.g. SANE_PIPE_IN
+void sane_pipesCloseEnd(int end)
+{
+    if (sane_pipes[end] >= 0) {
+        close(sane_pipes[end]);
+        sane_pipes[end] = -1;
+    }
+}
 
-// Close all open pipes, sets sane_numPipes = 0
+// Close all pipe fds held by the shell
 void sane_pipesClose()
 {
-    // There are two file descriptors for each 'pipe' structure
-    for (int i = 0; i < sane_numPipes * 2; ++i) {
-        close(sane_pipes[i]);
+    for (int i = 0; i < SANE_NUM_PIPE_FDS; ++i) {
+        sane_pipesCloseEnd(i);
     }
-    sane_numPipes = 0;
 }
 
-// Set all pipe fds to -1, make sure you close all open pipe fds first!
-void sane_pipesReset()
+// Move on to the next command of a pipeline: the read end of the pipe out of
+// the previous command becomes its input and, unless it's the last command, a
+// pipe is created for its output with the given settings. Returns 0 if
+// successful, -1 if the pipe could not be created.
+int sane_pipesNext(int last, const pipeconf_t *conf)
 {
+    sane_pipesCloseEnd(SANE_PIPE_IN);
+    sane_pipesCloseEnd(SANE_PIPE_OUT);
+    sane_pipes[SANE_PIPE_IN] = sane_pipes[SANE_PIPE_NEXT];
+    sane_pipes[SANE_PIPE_NEXT] = -1;
+
+    if (!last) {
+        int fds[2];
+        if (pipeconf_pipe(fds, conf) != 0) {
+            perror("sane pipe");
+            return -1;
+        }
+        sane_pipes[SANE_PIPE_NEXT] = fds[0];
+        sane_pipes[SANE_PIPE_OUT] = fds[1];
+    }
+
+    return 0;
 }
 
-// Create num pipes, sets sane_numPipes to num too.
-void sane_pipesCreate(unsigned int num)
+int sane_pipeconf(int argc, char **argv)
 {
-    for (int i = 0; i < num; ++i) {
-        pipe(sane_pipes + (i * 2));
+    if (argc == 1) {
+        pipeconf_print(stdout, pipeconf_global());
+        return EXIT_SUCCESS;
+    }
+
+    pipeconf_t conf = *pipeconf_global();
+    int first = pipeconf_parse(argc, argv, &conf);
+    if (first < 0) {
+        return EXIT_FAILURE;
+    } else if (first < argc) {
+        // sane_pipeconfPrefix() handles commands at the start of a pipeline
+        fprintf(stderr, "pipeconf: a command must start its pipeline\n");
+        return EXIT_FAILURE;
     }
-    sane_numPipes = num;
+    *pipeconf_global() = conf;
+
+    return EXIT_SUCCESS;
+}
+
+// 'pipeconf options command...' runs the command, and the rest of its
+// pipeline, with its own settings. Sets 'conf' to the settings of the pipeline
+// started by 'command' and removes the prefix from it (the command may be
+// cached, pass a copy). Returns 0 if successful, -1 if the options of the
+// prefix are invalid.
+int sane_pipeconfPrefix(command_t *command, pipeconf_t *conf)
+{
+    *conf = *pipeconf_global();
+    if (strcmp(command->argv[0], "pipeconf") != 0) {
+        return 0;
+    }
+
+    int argc = 0;
+    while (command->argv[argc] != NULL) {
+        ++argc;
+    }
+    int first = pipeconf_parse(argc, command->argv, conf);
+    if (first < 0) {
+        return -1;
+    } else if (first == argc) {
+        // Changes the settings of the pipelines that follow
+        *conf = *pipeconf_global();
+        return 0;
+    }
+    command->argv += first;
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Job queue, background pipelines past the concurrency limit wait in
+/// jobqueue.h's queue and are started from job_reap() as running jobs finish.
+////////////////////////////////////////////////////////////////////////////////
+
+// Set while queued pipelines are being started
+static int sane_dispatching = 0;
+
+// Start queued pipelines while fewer background jobs than the limit run. Does
+// nothing while a pipeline is being started, its pipes are in use.
+void sane_dispatchJobs()
+{
+    if (sane_dispatching || sane_pipes[SANE_PIPE_IN] != -1 ||
+        sane_pipes[SANE_PIPE_NEXT] != -1 || sane_pipes[SANE_PIPE_OUT] != -1) {
+        return;
+    }
+
+    sane_dispatching = 1;
+    int limit = jobqueue_getLimit();
+    while (jobqueue_numPending() > 0 &&
+           (limit == 0 || job_numRunningBackground() < limit)) {
+        jobqueue_entry_t *entry = jobqueue_pop();
+        int saved[3];
+        jobqueue_enter(entry, saved);
+        sane_execute(entry->numCommands, entry->commands);
+        jobqueue_leave(saved);
+        jobqueue_free(entry);
+    }
+    sane_dispatching = 0;
+}
+
+// Start all queued pipelines, waiting for running jobs to make room for them
+void sane_drainJobs()
+{
+    while (jobqueue_numPending() > 0) {
+        sane_dispatchJobs();
+        if (jobqueue_numPending() > 0) {
+            job_waitAny();
+        }
+    }
+    jobqueue_clear();
+}
+
+// Returns 1 if a background pipeline started now must be queued
+int sane_mustQueue()
+{
+    int limit = jobqueue_getLimit();
+    if (jobqueue_numPending() == 0 &&
+        (limit == 0 || job_numRunningBackground() < limit)) {
+        return 0;
+    }
+
+    // The number of running jobs is only updated when children are reaped,
+    // which also starts queued pipelines
+    job_reap();
+
+    return jobqueue_numPending() > 0 ||
+           (limit != 0 && job_numRunningBackground() >= limit);
+}
+
+int sane_sched(int argc, char **argv)
+{
+    if (argc == 1) {
+        job_reap();
+        jobqueue_print(stdout, job_numRunningBackground());
+        return EXIT_SUCCESS;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "-j") == 0) {
+        char *end;
+        long limit = strtol(argv[2], &end, 10);
+        if (argv[2][0] != '\0' && *end == '\0' && limit >= 0 &&
+            limit <= INT_MAX) {
+            jobqueue_setLimit(limit);
+            // Pipelines queued under a lower limit may start now
+            sane_dispatchJobs();
+            return EXIT_SUCCESS;
+        }
+    }
+
+    fprintf(stderr, "usage: sched [-j limit]\n");
+    return EXIT_FAILURE;
+}
+
+// 'history [-n count] [text]' prints the last entries of the history
+// containing the text, 'history -s words...' appends the words as an entry
+int sane_history(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "-s") == 0) {
+        size_t length = 0;
+        for (int i = 2; i < argc; ++i) {
+            length += strlen(argv[i]) + 1;
+        }
+        char *line = (char *)malloc(length + 1);
+        if (line == NULL) {
+            fprintf(stderr, "history: out of memory\n");
+            return EXIT_FAILURE;
+        }
+        char *it = line;
+        for (int i = 2; i < argc; ++i) {
+            if (i > 2) {
+                *it++ = ' ';
+            }
+            it = stpcpy(it, argv[i]);
+        }
+
+        int result = history_add(line, it - line);
+        free(line);
+        if (result != 0) {
+            fprintf(stderr, "history: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int count = 16;
+    int first = 1;
+    if (argc >= 3 && strcmp(argv[1], "-n") == 0) {
+        char *end;
+        long value = strtol(argv[2], &end, 10);
+        if (argv[2][0] == '\0' || *end != '\0' || value < 1 ||
+            value > INT_MAX) {
+            fprintf(stderr, "history: invalid count '%s'\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        count = value;
+        first = 3;
+    }
+    if (argc > first + 1 || (first < argc && argv[first][0] == '-')) {
+        fprintf(stderr, "usage: history [-n count] [text] | -s words...\n");
+        return EXIT_FAILURE;
+    }
+
+    if (history_print(stdout, first < argc ? argv[first] : "", count) != 0) {
+        fprintf(stderr, "history: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int sane_export(int argc, char **argv)
+{
+    int exported = VARIABLE_EXPORT;
+    int first = 1;
+    if (argc >= 2 && strcmp(argv[1], "-n") == 0) {
+        exported = VARIABLE_LOCAL;
+        first = 2;
+    }
+    if (argc == 1) {
+        variable_print(stdout);
+        return EXIT_SUCCESS;
+    } else if (first == argc) {
+        fprintf(stderr, "usage: export [-n] [name[=value]...]\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = first; i < argc; ++i) {
+        // 'name=value' sets the variable, 'name' only exports it
+        char *equal = strchr(argv[i], '=');
+        size_t nameLen = equal != NULL ? (size_t)(equal - argv[i])
+                                       : strlen(argv[i]);
+        if (!variable_isName(argv[i], nameLen)) {
+            fprintf(stderr, "export: '%s' is not a valid name\n", argv[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        char name[nameLen + 1];
+        memcpy(name, argv[i], nameLen);
+        name[nameLen] = '\0';
+        if (variable_set(name, equal != NULL ? equal + 1 : NULL, exported) !=
+            0) {
+            fprintf(stderr, "export: out of memory\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+int sane_unset(int argc, char **argv)
+{
+    int status = EXIT_SUCCESS;
+    for (int i = 1; i < argc; ++i) {
+        if (!variable_isName(argv[i], strlen(argv[i]))) {
+            fprintf(stderr, "unset: '%s' is not a valid name\n", argv[i]);
+            status = EXIT_FAILURE;
+        } else if (variable_unset(argv[i]) != 0) {
+            fprintf(stderr, "unset: out of memory\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+// 'time [-j] command...' reports the resources used by the command and the
+// rest of its pipeline (see timing.h). Removes the prefix from the command
+// (which may be cached, pass a copy). Returns TIMING_TEXT or TIMING_JSON if
+// the command is timed, 0 otherwise.
+int sane_timePrefix(command_t *command)
+{
+    char **argv = command->argv;
+    if (strcmp(argv[0], "time") != 0) {
+        return 0;
+    }
+
+    int format = TIMING_TEXT;
+    int first = 1;
+    if (argv[1] != NULL && strcmp(argv[1], "-j") == 0) {
+        format = TIMING_JSON;
+        first = 2;
+    }
+    // Without a command it's the 'time' command
+    if (argv[first] == NULL) {
+        return 0;
+    }
+    command->argv += first;
+
+    return format;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Process spawning
+////////////////////////////////////////////////////////////////////////////////
+
+// Backends used to start external commands
+#define SANE_SPAWN_POSIX 0 // posix_spawn(), no copy of the shell's page tables
+#define SANE_SPAWN_FORK 1  // fork() + execve(), kept as a fallback
+
+static int sane_spawnBackend = SANE_SPAWN_POSIX;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Open the redirection files of the given command in the shell process.
+///
+/// @note: redirection overrides piping, similar to bash shell.
+///
+/// @param   command   command_t *, command to open redirection files for.
+/// @param   fdIn      int, file descriptor to use as stdin if not redirected.
+/// @param   fdOut     int, file descriptor to use as stdout if not redirected.
+/// @param   in        int *, file descriptor to use as stdin out.
+/// @param   out       int *, file descriptor to use as stdout out.
+/// @return            int, 0 if successful, -1 if a file could not be opened.
+////////////////////////////////////////////////////////////////////////////////
+int sane_openRedirections(command_t *command,
+                          int fdIn,
+                          int fdOut,
+                          int *in,
+                          int *out)
+{
+    *in = fdIn;
+    *out = fdOut;
+
+    if (command->stdin_file != NULL) {
+        // Open for reading only
+        *in = open(command->stdin_file, O_RDONLY | O_CLOEXEC);
+        if (*in < 0) {
+            perror("sane open");
+            return -1;
+        }
+    }
+    if (command->stdout_file != NULL) {
+        // Open for writing, truncate file to 0 (clear it), create file if it
+        // does not exist, with read and write permissions for owner of file
+        // and group
+        *out = open(command->stdout_file,
+                    O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC,
+                    S_IRUSR | S_IRGRP | S_IWGRP | S_IWUSR);
+        if (*out < 0) {
+            perror("sane open");
+            if (*in != fdIn) {
+                close(*in);
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Start an external command with posix_spawn(). glibc implements it with
+/// clone(CLONE_VM | CLONE_VFORK), so unlike fork() the cost does not grow with
+/// the size of the shell's address space.
+///
+/// @param   path   const char *, path to execute, from sane_hashLookup().
+/// @return pid of the child process, -1 on error.
+////////////////////////////////////////////////////////////////////////////////
+pid_t sane_launchSpawn(command_t *command, const char *path, int in, int out)
+{
+    pid_t pid = -1;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // Children start with no signals blocked, the shell may have SIGCHLD
+    // blocked while launching. SIGPIPE is ignored by the shell (for its cat
+    // and tee builtins) but must kill children writing to a closed pipe.
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    posix_spawnattr_setsigmask(&attr, &sigset);
+    sigaddset(&sigset, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigset);
+    posix_spawnattr_setflags(&attr,
+                             POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    if (in != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    }
+    if (out != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    }
+    // The environment of commands is made of the exported variables
+    char **envp = variable_envp();
+    int err = envp != NULL ? posix_spawn(&pid, path, &actions, &attr,
+                                         command->argv, envp)
+                           : ENOMEM;
+    if (err == ENOENT && path != command->argv[0]) {
+        // Cached binary disappeared, search PATH again
+        sane_hashForget(command->argv[0]);
+        path = sane_hashLookup(command->argv[0]);
+        if (path != NULL) {
+            err = posix_spawn(&pid, path, &actions, &attr, command->argv,
+                              envp);
+        }
+    }
+    if (err != 0) {
+        fprintf(stderr, "sane exec: %s\n", strerror(err));
+        pid = -1;
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    return pid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Start an external command with fork() and execve().
+///
+/// @param   path   const char *, path to execute, from sane_hashLookup().
+/// @return pid of the child process, -1 on error.
+////////////////////////////////////////////////////////////////////////////////
+pid_t sane_launchFork(command_t *command, const char *path, int in, int out)
+{
+    char **envp = variable_envp();
+    if (envp == NULL) {
+        fprintf(stderr, "sane exec: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child
+        sigset_t sigset;
+        sigemptyset(&sigset);
+        sigprocmask(SIG_SETMASK, &sigset, NULL);
+        signal(SIGPIPE, SIG_DFL);
+
+        //  Handle redirection and piping
+        if (in != STDIN_FILENO) {
+            dup2(in, STDIN_FILENO);
+        }
+        if (out != STDOUT_FILENO) {
+            dup2(out, STDOUT_FILENO);
+        }
+
+        // Execute command, searching PATH again if the cached binary
+        // disappeared
+        execve(path, command->argv, envp);
+        if (errno == ENOENT && path != command->argv[0]) {
+            sane_hashForget(command->argv[0]);
+            path = sane_hashLookup(command->argv[0]);
+            if (path != NULL) {
+                execve(path, command->argv, envp);
+            }
+        }
+        perror("sane exec");
+        exit(EXIT_FAILURE);
+    } else if (pid < 0) {
+        // Error
+        perror("sane fork");
+    }
+
+    return pid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run a builtin in a forked copy of the shell, so it runs at the same time as
+/// the rest of its pipeline or in the background. Changes it makes to the
+/// shell's state (e.g. 'cd') are lost when it exits, like in other shells.
+///
+/// @return pid of the child process, -1 on error.
+////////////////////////////////////////////////////////////////////////////////
+pid_t sane_launchSubshell(command_t *command,
+                          sane_builtin_t *builtin,
+                          int in,
+                          int out)
+{
+    // Whatever is buffered would be written by both processes
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child, the builtin's writes to a closed pipe kill it like they
+        // would kill the external command
+        sigset_t sigset;
+        sigemptyset(&sigset);
+        sigprocmask(SIG_SETMASK, &sigset, NULL);
+        signal(SIGPIPE, SIG_DFL);
+
+        if (in != STDIN_FILENO) {
+            dup2(in, STDIN_FILENO);
+        }
+        if (out != STDOUT_FILENO) {
+            dup2(out, STDOUT_FILENO);
+        }
+
+        // Readers only see the end of their input once every write end is
+        // closed
+        sane_pipesClose();
+
+        int argc = 0;
+        while (command->argv[argc] != NULL) {
+            ++argc;
+        }
+
+        int status = (*builtin->func)(argc, command->argv);
+        fflush(stdout);
+        _exit(status);
+    } else if (pid < 0) {
+        perror("sane fork");
+    }
+
+    return pid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run an external command too long to exec once per batch of its arguments
+/// (see argbatch.h), in a forked copy of the shell that waits for the
+/// batches.
+///
+/// @param   path   const char *, path to execute, from sane_hashLookup().
+/// @return pid of the child process, -1 on error.
+////////////////////////////////////////////////////////////////////////////////
+pid_t sane_launchBatches(command_t *command, const char *path, int in, int out)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child, the batches start with its signal mask and dispositions
+        sigset_t sigset;
+        sigemptyset(&sigset);
+        sigprocmask(SIG_SETMASK, &sigset, NULL);
+        signal(SIGPIPE, SIG_DFL);
+
+        if (in != STDIN_FILENO) {
+            dup2(in, STDIN_FILENO);
+        }
+        if (out != STDOUT_FILENO) {
+            dup2(out, STDOUT_FILENO);
+        }
+
+        // Readers only see the end of their input once every write end is
+        // closed
+        sane_pipesClose();
+
+        _exit(argbatch_run(argbatch_global(), path, command));
+    } else if (pid < 0) {
+        perror("sane fork");
+    }
+
+    return pid;
+}
+
+int sane_batch(int argc, char **argv)
+{
+    if (argc == 1) {
+        argbatch_print(stdout, argbatch_global());
+        return EXIT_SUCCESS;
+    }
+
+    return argbatch_parse(argc, argv, argbatch_global()) == 0 ? EXIT_SUCCESS
+                                                              : EXIT_FAILURE;
+}
+
+int sane_spawn(int argc, char **argv)
+{
+    if (argc == 1) {
+        printf("%s\n",
+               sane_spawnBackend == SANE_SPAWN_POSIX ? "posix" : "fork");
+    } else if (argc == 2 && strcmp(argv[1], "posix") == 0) {
+        sane_spawnBackend = SANE_SPAWN_POSIX;
+    } else if (argc == 2 && strcmp(argv[1], "fork") == 0) {
+        sane_spawnBackend = SANE_SPAWN_FORK;
+    } else {
+        fprintf(stderr, "usage: spawn [posix|fork]\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -216,121 +1099,103 @@ void sane_pipesCreate(unsigned int num)
 ////////////////////////////////////////////////////////////////////////////////
 
 ////////////////////////////////////////////////////////////////////////////////
+/// @param   builtin   sane_builtin_t *, builtin to run (see
+///                    sane_findBuiltin()), NULL to start an external command.
+/// @param   inShell   int, 1 to run the builtin in the shell process until it's
+///                    done, 0 to run it in a subshell.
 /// @return If executed by main process, returns 0. If executed by child
 /// process, returns the pid of that child process. In case of error, returns
 /// -1.
 ////////////////////////////////////////////////////////////////////////////////
-pid_t sane_launch(command_t *command, int fdIn, int fdOut)
+pid_t sane_launch(command_t *command,
+                  sane_builtin_t *builtin,
+                  int inShell,
+                  int fdIn,
+                  int fdOut)
 {
     pid_t pid = -1;
 
     if (command != NULL) {
-        // Determine if command is built-in
-        int builtInIt = 0;
-        for (; builtInIt < sane_numBuiltins(); ++builtInIt) {
-            if (strcmp(command->argv[0], sane_builtinStr[builtInIt]) == 0) {
-                break;
+        if (builtin != NULL && !inShell) {
+            int in, out;
+            if (sane_openRedirections(command, fdIn, fdOut, &in, &out) != 0) {
+                return -1;
             }
-        }
 
-        // Reached end of builtins, command is not a builtin
-        if (builtInIt == sane_numBuiltins()) {
-            // Spawn a child to execute command
-            pid = fork();
-            if (pid == 0) {
-                // Child
-                //  Handle redirection and piping
-                if (command->stdin_file == NULL) {
-                    // If no redirection, use pipe
-                    if (fdIn != STDIN_FILENO) {
-                        dup2(fdIn, STDIN_FILENO);
-                        close(fdIn);
-                    }
-                } else {
-                    // Else use redirection
-                    // @note: redirection overrides piping, similar to bash
-                    // shell
-                    int in = open(command->stdin_file,
-                                  O_RDONLY); // Open for reading only
-
-                    if (in > 0) {
-                        dup2(in, STDIN_FILENO);
-                        // Close unneeded file descriptor
-                        close(in);
-                    } else {
-                        perror("sane open");
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                if (command->stdout_file == NULL) {
-                    if (fdOut != STDOUT_FILENO) {
-                        dup2(fdOut, STDOUT_FILENO);
-                        close(fdOut);
-                    }
-                } else {
-                    int out = open(
-                        command->stdout_file, O_WRONLY | O_TRUNC | O_CREAT,
-                        S_IRUSR | S_IRGRP | S_IWGRP |
-                            S_IWUSR); // Open for writing, truncate file to 0
-                                      // (clear it), create file if it does not
-                                      // exist, with read and write permissions
-                                      // for owner of file and group
-                    dup2(out, STDOUT_FILENO);
-                    // Close unneeded file descriptor
-                    close(out);
-                }
+            TRACE_START(subshell);
+            pid = sane_launchSubshell(command, builtin, in, out);
+            TRACE_END(subshell, "subshell", command->argv[0]);
+
+            // Close redirection files, the child has its own copy
+            if (in != fdIn) {
+                close(in);
+            }
+            if (out != fdOut) {
+                close(out);
+            }
+        } else if (builtin == NULL) {
+            const char *path = sane_hashLookup(command->argv[0]);
+            if (path == NULL) {
+                fprintf(stderr, "sane exec: %s\n", strerror(ENOENT));
+                return -1;
+            }
 
-                // Close any open pipes in child
-                sane_pipesClose();
+            // stdout is fully buffered when it isn't a terminal, output of
+            // earlier builtins must come before the command's output
+            fflush(stdout);
 
-                // Else, execute command
-                if (execvp(command->argv[0], command->argv) == -1) {
-                    perror("sane exec");
-                }
-                exit(EXIT_FAILURE);
-            } else if (pid < 0) {
-                // Error
-                perror("sane fork");
+            int in, out;
+            if (sane_openRedirections(command, fdIn, fdOut, &in, &out) != 0) {
+                return -1;
+            }
+
+            TRACE_START(spawn);
+            if (argbatch_needed(argbatch_global(), command)) {
+                pid = sane_launchBatches(command, path, in, out);
+            } else if (sane_spawnBackend == SANE_SPAWN_POSIX) {
+                pid = sane_launchSpawn(command, path, in, out);
+            } else {
+                pid = sane_launchFork(command, path, in, out);
+            }
+            TRACE_END(spawn, "spawn", command->argv[0]);
+
+            // Close redirection files, the child has its own copy
+            if (in != fdIn) {
+                close(in);
+            }
+            if (out != fdOut) {
+                close(out);
             }
         } else {
+            // Redirection files are opened like for external commands, a
+            // missing file fails the command rather than the shell
+            int in, out;
+            if (sane_openRedirections(command, fdIn, fdOut, &in, &out) != 0) {
+                return -1;
+            }
+
             pid = 0;
-            //  Handle redirection and piping
-            if (command->stdin_file == NULL) {
-                // If no redirection, use pipe
-                if (fdIn != STDIN_FILENO) {
-                    dup2(fdIn, STDIN_FILENO);
-                    close(fdIn);
-                }
-            } else {
-                // Else use redirection
-                // @note: redirection overrides piping, similar to bash
-                // shell
-                int in = open(command->stdin_file,
-                              O_RDONLY); // Open for reading only
-                if (in > 0) {
-                    dup2(in, STDIN_FILENO);
-                    // Close unneeded file descriptor
-                    close(in);
-                } else {
-                    perror("sane open");
-                    exit(EXIT_FAILURE);
-                }
+            // stdout is fully buffered when it isn't a terminal, so output
+            // must be flushed before stdout is rewired and restored
+            int rewireStdout = out != STDOUT_FILENO;
+            if (rewireStdout) {
+                fflush(stdout);
             }
-            if (command->stdout_file == NULL) {
-                if (fdOut != STDOUT_FILENO) {
-                    dup2(fdOut, STDOUT_FILENO);
-                    close(fdOut);
-                }
-            } else {
-                int out =
-                    open(command->stdout_file, O_WRONLY | O_TRUNC | O_CREAT,
-                         S_IRUSR | S_IRGRP | S_IWGRP |
-                             S_IWUSR); // Open for writing, truncate file to 0
-                                       // (clear it), create file if it does not
-                                       // exist, with read and write permissions
-                                       // for owner of file and group
+
+            //  Handle redirection and piping, the pipe fds themselves are
+            //  closed by sane_execute()
+            if (in != STDIN_FILENO) {
+                dup2(in, STDIN_FILENO);
+            }
+            if (out != STDOUT_FILENO) {
                 dup2(out, STDOUT_FILENO);
-                // Close unneeded file descriptor
+            }
+
+            // Close redirection files, stdin and stdout are copies
+            if (in != fdIn) {
+                close(in);
+            }
+            if (out != fdOut) {
                 close(out);
             }
 
@@ -340,167 +1205,242 @@ pid_t sane_launch(command_t *command, int fdIn, int fdOut)
             }
 
             // Execute command
-            (*sane_builtinFuncs[builtInIt])(argc, command->argv);
+            TRACE_START(run);
+            sane_builtinStatus =
+                (*builtin->func)(argc, command->argv);
+            TRACE_END(run, "builtin", command->argv[0]);
+            if (rewireStdout) {
+                fflush(stdout);
+            }
         }
     }
 
     return pid;
 }
 
-void sane_execute(int numCommands, command_t *commands)
+int sane_execute(int numCommands, command_t *commands)
 {
     int i = 0;
 
-    int stdinCopy = dup(0);
-    int stdoutCopy = dup(1);
-
-    while (i < numCommands) {
-        if (strcmp(commands[i].sep, SEP_SEQ) == 0) {
-            // Don't catch SIGCHLD (child terminated) signals during this
-            // critical section, otherwise the SIGCHLD signal handler will
-            // reap
-            // the process created and the below call to waitpid will fail
-            sigset_t sigset;
-            sigemptyset(&sigset);
-            sigaddset(&sigset, SIGCHLD);
-
-            sigprocmask(SIG_SETMASK, &sigset, NULL);
-
-            {
-                pid_t pid =
-                    sane_launch(&commands[i], STDIN_FILENO, STDOUT_FILENO);
-
-                // Wait for child process to finish
-                int status;
-                do {
-                    waitpid(pid, &status, WUNTRACED);
-                } while (!WIFEXITED(status) && !WIFSIGNALED(status));
-            }
-
-            // Allow SIGCHLD signals to be processed again, signals received
-            // during critical section will now be processed.
-            sigprocmask(SIG_UNBLOCK, &sigset, NULL);
-
-            ++i;
-        } else if (strcmp(commands[i].sep, SEP_CON) == 0) {
-            sane_launch(&commands[i], STDIN_FILENO, STDOUT_FILENO);
-
-            // Don't wait for child process to finish
-            ++i;
-        }
-        // Piped command
-        else if (strcmp(commands[i].sep, SEP_PIPE) == 0) {
-            // Whether or not main process should wait on job to finish (false
-            // if separator of last command is SEP_CON)
-            int shouldWait = 1;
-
-            //
-            // Execute sequences of pipe commands at once for example, in:
-            //
-            // 'whoami ; cat out.txt | sort | less ; echo "Hello"'
-            //           |_________________________|
-            // this section ^ would be considered a sequence of piped
-            // commands.
-
-            // Find out how many contiguous pipes to execute
-            int numPipedCommands = 0;
-            for (int j = i; j < numCommands; ++j) {
-                if (strcmp(commands[j].sep, SEP_PIPE) == 0) {
-                    ++numPipedCommands;
-                } else {
-                    if (strcmp(commands[j].sep, SEP_CON) == 0) {
-                        shouldWait = 0; // Don't wait for concurrent job
-                    }
-                    break;
+    // Builtins rewire stdin and stdout of the shell for redirection and
+    // pipes, keep copies to restore them. Plain lines skip the extra syscalls.
+    int stdinCopy = -1;
+    int stdoutCopy = -1;
+    for (int j = 0; j < numCommands; ++j) {
+        if (commands[j].stdin_file != NULL ||
+            commands[j].stdout_file != NULL ||
+            strcmp(commands[j].sep, SEP_PIPE) == 0) {
+            stdinCopy = fcntl(0, F_DUPFD_CLOEXEC, 0);
+            stdoutCopy = fcntl(1, F_DUPFD_CLOEXEC, 0);
+            break;
+        }
+    }
+
+    // Exit status of the last command
+    int status = 0;
+
+    // Commands after 'exit' aren't run
+    while (i < numCommands && !sane_exitFlag) {
+        // Whether or not main process should wait on job to finish (false
+        // if separator of last command is SEP_CON)
+        int shouldWait = 1;
+
+        //
+        // Execute sequences of pipe commands at once for example, in:
+        //
+        // 'whoami ; cat out.txt | sort | less ; echo "Hello"'
+        //           |_________________________|
+        // this section ^ would be considered a sequence of piped
+        // commands. A command on its own is a pipeline of one command.
+
+        // Find out how many contiguous pipes to execute
+        int numPipedCommands = 0;
+        for (int j = i; j < numCommands; ++j) {
+            if (strcmp(commands[j].sep, SEP_PIPE) == 0) {
+                ++numPipedCommands;
+            } else {
+                if (strcmp(commands[j].sep, SEP_CON) == 0) {
+                    shouldWait = 0; // Don't wait for concurrent job
                 }
+                break;
             }
+        }
 
-            // Also include last element in pipe sequence (which will not
-            // contain a pipe seperator [see 'less' in above example])
-            ++numPipedCommands;
-
-            // For n commands we need n-1 pipes
-            sane_pipesCreate(numPipedCommands - 1);
-
-            int numCommandsToWaitFor = numPipedCommands;
-            for (int k = 0; k < numPipedCommands; ++k) {
-                pid_t pid = -1;
-
-                if (k == 0) {
-                    // First command in sequence:
-                    //  - Use stdin for in, pipe for out (first write pipe)
-                    pid = sane_launch(&commands[i + k], STDIN_FILENO,
-                                      sane_pipes[1]);
-
-                } else if (k == numPipedCommands - 1) {
-                    // Last command in sequence:
-                    //  - Use pipe (last read pipe) for in, stdout for out
-                    pid = sane_launch(&commands[i + k],
-                                      sane_pipes[((sane_numPipes * 2) - 1) - 1],
-                                      STDOUT_FILENO);
-                } else {
-                    // 'k'th command in sequence:
-                    //  - Use pipe from previous command for in, pipe for
-                    //  this
-                    //  command for out
-                    pid = sane_launch(&commands[i + k],
-                                      sane_pipes[((k - 1) * 2) + 0],
-                                      sane_pipes[(k * 2) + 1]);
+        // Also include last element in pipe sequence (which will not
+        // contain a pipe seperator [see 'less' in above example])
+        ++numPipedCommands;
+
+        // Background pipelines past the concurrency limit are queued, they
+        // start in order as running jobs finish (see 'sched')
+        if (!shouldWait && !sane_dispatching && sane_mustQueue()) {
+            if (jobqueue_push(&commands[i], numPipedCommands) == 0) {
+                status = 0;
+                i += numPipedCommands;
+                continue;
+            }
+            // Out of memory or file descriptors, start it once there's room
+            while (sane_mustQueue()) {
+                sane_dispatchJobs();
+                if (sane_mustQueue()) {
+                    job_waitAny();
                 }
+            }
+        }
+
+        // 'time' and 'pipeconf' in front of the first command apply to the
+        // whole pipeline
+        command_t first = commands[i];
+        int timed = sane_timePrefix(&first);
+        pipeconf_t conf;
+        if (sane_pipeconfPrefix(&first, &conf) != 0) {
+            status = EXIT_FAILURE;
+            i += numPipedCommands;
+            continue;
+        }
+
+        // Created with the first process of the pipeline, builtins run in
+        // the shell have no job
+        job_t *job = NULL;
+
+        // The shell can only report on pipelines it waits for
+        timing_stage_t *stages = NULL;
+        if (timed && shouldWait) {
+            stages = (timing_stage_t *)calloc(numPipedCommands,
+                                              sizeof(timing_stage_t));
+            if (stages == NULL) {
+                fprintf(stderr, "sane: out of memory\n");
+            }
+        }
+        int numStages = 0;
+        double start = (stages != NULL) ? timing_now() : 0;
+
+        // All stages run at the same time, builtins in subshells. The last
+        // one runs in the shell once the others have started if it's a
+        // builtin (e.g. '... | tee out') and the shell waits for the
+        // pipeline anyway.
+        pid_t lastPid = -1;
+        for (int k = 0; k < numPipedCommands; ++k) {
+            command_t *command = (k == 0) ? &first : &commands[i + k];
+            sane_builtin_t *builtin = sane_findBuiltin(command);
+            int last = k == numPipedCommands - 1;
+            int inShell = builtin != NULL && last && shouldWait;
+
+            // Builtins in subshells grow the pipes they write to if asked
+            // to, the shell's own stdout is left alone
+            fastcopy_setGrowPipes(conf.adaptive && !inShell);
+
+            // The commands started so far keep running, they see the end of
+            // the pipeline
+            if (sane_pipesNext(last, &conf) != 0) {
+                status = 1;
+                break;
+            }
 
-                // A builtin command was executed
+            // The first command reads stdin and the last one writes stdout,
+            // the others use the pipes on either side
+            int in = (k == 0) ? STDIN_FILENO : sane_pipes[SANE_PIPE_IN];
+            int out = last ? STDOUT_FILENO : sane_pipes[SANE_PIPE_OUT];
+
+            struct rusage usage;
+            if (stages != NULL && inShell) {
+                getrusage(RUSAGE_SELF, &usage);
+            }
+
+            pid_t pid = sane_launch(command, builtin, inShell, in, out);
+            if (pid > 0) {
+                pipeconf_pin(&conf, pid, k);
+            }
+
+            if (stages != NULL) {
+                stages[k].command = command->argv[0];
+                stages[k].pid = pid;
                 if (pid == 0) {
-                    // Done executing command inbuilt command, rewire stdin and
-                    // stdout in
-                    // main process
+                    timing_usageSince(&stages[k].usage, &usage);
+                    stages[k].status = sane_builtinStatus;
+                } else if (pid < 0) {
+                    stages[k].status = 127;
+                }
+                numStages = k + 1;
+            }
+
+            // A builtin command was executed
+            if (pid == 0) {
+                // Done executing command inbuilt command, its redirections
+                // only apply to itself, rewire stdin and stdout in main
+                // process
+                if (stdinCopy != -1) {
                     dup2(stdinCopy, 0);
                     dup2(stdoutCopy, 1);
-                    // close(stdinCopy);
-                    // close(stdoutCopy);
-
-                    // No need to wait for builtin command
-                    --numCommandsToWaitFor;
                 }
+            } else if (pid > 0) {
+                if (job == NULL) {
+                    job = job_create(&commands[i], numPipedCommands,
+                                     !shouldWait);
+                    if (job != NULL && !shouldWait) {
+                        jobqueue_countStarted();
+                    }
+                }
+                if (job == NULL || job_addProcess(job, pid) != 0) {
+                    fprintf(stderr, "sane: out of memory\n");
+                }
+            }
+
+            // The status of the pipeline is the status of its last command,
+            // builtins run in the shell have no child to wait for and failed
+            // launches have nothing to wait for
+            if (last) {
+                lastPid = pid;
+                status = (pid == 0) ? sane_builtinStatus : 127;
             }
+        }
 
-            // Close all pipes
-            sane_pipesClose();
-            // Reset all pipes
-            sane_pipesReset();
-
-            if (shouldWait) {
-                // Don't catch SIGCHLD (child terminated) signals during this
-                // critical section, otherwise the SIGCHLD signal handler will
-                // reap
-                // the process created and the below call to waitpid will fail
-                sigset_t sigset;
-                sigemptyset(&sigset);
-                sigaddset(&sigset, SIGCHLD);
-
-                // Wait for each forked child to finish
-                sigprocmask(SIG_SETMASK, &sigset, NULL);
-
-                {
-                    // TODO: wait on a list of pids
-                    int status;
-                    for (int k = 0; k < numCommandsToWaitFor; ++k) {
-                        wait(&status);
+        // Close the pipe fds of the last command started
+        sane_pipesClose();
+        fastcopy_setGrowPipes(0);
+
+        // Wait for exactly the processes of this pipeline, the status of the
+        // pipeline is the status of its last command if it's a process
+        if (job != NULL && shouldWait) {
+            TRACE_START(wait);
+            if (stages != NULL) {
+                job_waitRunning(job, 0);
+                for (int p = 0; p < job->numProcesses; ++p) {
+                    for (int k = 0; k < numStages; ++k) {
+                        if (stages[k].pid == job->processes[p].pid) {
+                            stages[k].status = job->processes[p].status;
+                            stages[k].usage = job->processes[p].usage;
+                        }
                     }
                 }
+            }
 
-                // Allow SIGCHLD signals to be processed again, signals received
-                // during critical section will now be processed.
-                sigprocmask(SIG_UNBLOCK, &sigset, NULL);
+            int jobStatus = job_wait(job, 0);
+            TRACE_END(wait, "wait", commands[i].argv[0]);
+            if (lastPid > 0) {
+                status = jobStatus;
             }
+        }
+        if (!shouldWait) {
+            status = 0;
+        }
 
-            i += numPipedCommands;
+        if (stages != NULL) {
+            timing_print(stderr, timed, timing_now() - start, status, stages,
+                         numStages);
+            free(stages);
         }
+
+        i += numPipedCommands;
     }
 
     // Done executing commands, rewire stdin and stdout in main
     // process
-    dup2(stdinCopy, 0);
-    dup2(stdoutCopy, 1);
-    close(stdinCopy);
-    close(stdoutCopy);
+    if (stdinCopy != -1) {
+        dup2(stdinCopy, 0);
+        dup2(stdoutCopy, 1);
+        close(stdinCopy);
+        close(stdoutCopy);
+    }
+
+    return status;
 }
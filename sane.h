@@ -24,8 +24,11 @@ void sane_shutdown();
 ///
 /// @param   numCommands   int, number of commands in the command array.
 /// @param   commands      command_t, command array.
+/// @return                int, exit status of the last command (127 if it
+///                        couldn't be launched, 0 if it runs in the
+///                        background).
 ////////////////////////////////////////////////////////////////////////////////
-void sane_execute(int numCommands, struct command_t *commands);
+int sane_execute(int numCommands, struct command_t *commands);
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Get the shell's prompt.
@@ -35,3 +38,11 @@ void sane_execute(int numCommands, struct command_t *commands);
 /// @return   const char *, shell's prompt.
 ////////////////////////////////////////////////////////////////////////////////
 const char *sane_getPrompt();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Whether the 'exit' builtin was run, the program running the shell stops
+/// reading lines once it has.
+///
+/// @return   int, 1 if 'exit' was run, 0 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int sane_exitRequested();
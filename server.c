@@ -0,0 +1,334 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "run.h"
+#include "sane.h"
+#include "server.h"
+
+// Set by SIGINT and SIGTERM in the server process
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_handleStop(int signo)
+{
+    server_stop = 1;
+}
+
+// Fill in the address of the socket, returns 0 if successful, -1 if the path
+// is too long
+static int server_address(const char *path, struct sockaddr_un *address)
+{
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+
+    return 0;
+}
+
+// Returns 1 if the socket at the address was left behind by a server that
+// isn't running any more. connect() also fails with ECONNREFUSED for files
+// that aren't sockets, those are never stale.
+static int server_isStale(const struct sockaddr_un *address)
+{
+    struct stat status;
+    if (lstat(address->sun_path, &status) != 0 || !S_ISSOCK(status.st_mode)) {
+        return 0;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return 0;
+    }
+
+    int stale = connect(fd, (const struct sockaddr *)address,
+                        sizeof(*address)) != 0 &&
+                errno == ECONNREFUSED;
+    close(fd);
+
+    return stale;
+}
+
+// Create the socket and listen on it, returns the socket, -1 on error
+static int server_listen(const char *path)
+{
+    struct sockaddr_un address;
+    if (server_address(path, &address) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // Only the owner may connect, whatever the umask
+    mode_t mask = umask(0177);
+    int result =
+        bind(fd, (const struct sockaddr *)&address, sizeof(address));
+    if (result != 0 && errno == EADDRINUSE && server_isStale(&address)) {
+        unlink(path);
+        result =
+            bind(fd, (const struct sockaddr *)&address, sizeof(address));
+    }
+    int err = errno;
+    umask(mask);
+    errno = err;
+    if (result != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Receive a request, the line is NUL terminated and 'fds' receives the
+// client's file descriptors. Returns the length of the line, 0 when the client
+// closed the connection, -1 on error (including malformed requests).
+static ssize_t server_receive(int connection, char *line, int *fds)
+{
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * SERVER_NUM_FDS)];
+    } control;
+    struct iovec iov = {line, SERVER_MAX_LINE};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    // The descriptors are only dup2()'d to stdio, commands mustn't inherit
+    // the originals
+    ssize_t length = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    if (length < 0) {
+        return -1;
+    }
+
+    int numFds = 0;
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET &&
+        header->cmsg_type == SCM_RIGHTS) {
+        numFds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(header), numFds * sizeof(int));
+    }
+
+    if (length == 0 || numFds != SERVER_NUM_FDS ||
+        (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+        for (int i = 0; i < numFds; ++i) {
+            close(fds[i]);
+        }
+        if (length == 0 && numFds == 0) {
+            return 0;
+        }
+        errno = EPROTO;
+        return -1;
+    }
+
+    line[length] = '\0';
+
+    return length;
+}
+
+// Run a line with the client's stdio and working directory, 'saved' are the
+// worker's own. Returns the exit status of the line.
+static int server_serve(const char *line, int *fds, const int *saved)
+{
+    fflush(stdout);
+    for (int i = 0; i < 3; ++i) {
+        dup2(fds[i], i);
+    }
+
+    int status = 0;
+    if (fchdir(fds[3]) != 0) {
+        fprintf(stderr, "sane: %s\n", strerror(errno));
+        status = 1;
+    } else {
+        int error = sane_run(line, &status);
+        if (error != 0) {
+            fprintf(stderr, "sane: %s\n", sane_runError(error));
+            // Syntax errors exit with 2 like other shells
+            status = (error == SANE_RUN_NO_MEMORY) ? 1 : 2;
+        }
+    }
+
+    // Builtins print through stdio
+    fflush(stdout);
+    for (int i = 0; i < 3; ++i) {
+        dup2(saved[i], i);
+    }
+    if (fchdir(saved[3]) != 0) {
+        perror("sane: fchdir");
+    }
+    for (int i = 0; i < SERVER_NUM_FDS; ++i) {
+        close(fds[i]);
+    }
+
+    return status;
+}
+
+// Serve connections until 'exit' is run, returns the worker's exit status
+static int server_work(int listener)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    // Builtins writing to a client that went away get EPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    if (sane_init() != 0) {
+        fprintf(stderr, "sane: initialization of shell failed\n");
+        return 1;
+    }
+
+    int saved[SERVER_NUM_FDS];
+    for (int i = 0; i < 3; ++i) {
+        saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 0);
+    }
+    saved[3] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    char *line = (char *)malloc(SERVER_MAX_LINE + 1);
+    if (line == NULL) {
+        fprintf(stderr, "sane: out of memory\n");
+        sane_shutdown();
+        return 1;
+    }
+
+    while (!sane_exitRequested()) {
+        int connection = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (connection == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("sane: accept");
+            break;
+        }
+        // Refuse clients of other users, in case the socket's mode was
+        // changed after it was created
+        struct ucred peer;
+        socklen_t peerLength = sizeof(peer);
+        if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &peer,
+                       &peerLength) != 0 ||
+            peer.uid != geteuid()) {
+            close(connection);
+            continue;
+        }
+
+        int fds[SERVER_NUM_FDS];
+        while (!sane_exitRequested() &&
+               server_receive(connection, line, fds) > 0) {
+            int status = server_serve(line, fds, saved);
+            if (send(connection, &status, sizeof(status), MSG_NOSIGNAL) !=
+                sizeof(status)) {
+                break;
+            }
+        }
+        close(connection);
+    }
+
+    free(line);
+    for (int i = 0; i < SERVER_NUM_FDS; ++i) {
+        if (saved[i] != -1) {
+            close(saved[i]);
+        }
+    }
+    sane_shutdown();
+
+    return 0;
+}
+
+int server_main(const char *path, int numWorkers)
+{
+    int listener = server_listen(path);
+    if (listener == -1) {
+        fprintf(stderr, "sane: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    // No SA_RESTART, waitpid() returns when the server is stopped
+    struct sigaction act;
+    act.sa_flags = 0;
+    act.sa_handler = server_handleStop;
+    sigemptyset(&(act.sa_mask));
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    pid_t *workers = (pid_t *)calloc(numWorkers, sizeof(pid_t));
+    if (workers == NULL) {
+        fprintf(stderr, "sane: out of memory\n");
+        close(listener);
+        unlink(path);
+        return 1;
+    }
+
+    int result = 0;
+    while (!server_stop && result == 0) {
+        // Start the workers that are missing, initially or after one quit
+        for (int i = 0; i < numWorkers && result == 0; ++i) {
+            if (workers[i] != 0) {
+                continue;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                free(workers);
+                exit(server_work(listener));
+            } else if (pid == -1) {
+                perror("sane: fork");
+                result = 1;
+            }
+            workers[i] = pid > 0 ? pid : 0;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno != EINTR) {
+                perror("sane: waitpid");
+                result = 1;
+            }
+            continue;
+        }
+        for (int i = 0; i < numWorkers; ++i) {
+            if (workers[i] == pid) {
+                workers[i] = 0;
+            }
+        }
+        // A worker that failed to start would fail again
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            result = 1;
+        }
+    }
+
+    for (int i = 0; i < numWorkers; ++i) {
+        if (workers[i] != 0) {
+            kill(workers[i], SIGTERM);
+        }
+    }
+    for (int i = 0; i < numWorkers; ++i) {
+        if (workers[i] != 0) {
+            waitpid(workers[i], NULL, 0);
+        }
+    }
+
+    free(workers);
+    close(listener);
+    unlink(path);
+
+    return result;
+}
@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Shell server, runs lines sent by local clients over a Unix domain socket
+/// (see 'sane --server' and bin/sane-client), so a program running many short
+/// commands doesn't start and initialize a shell for each of them:
+///
+///     sane --server /tmp/sane.sock &
+///     sane-client /tmp/sane.sock 'sort data.txt | uniq -c > counts.txt'
+///
+/// The server forks workers, each an initialized shell (builtins, command
+/// location and parse caches) accepting connections on the same socket. The
+/// protocol uses SOCK_SEQPACKET messages:
+///
+///  - request: the line, without a newline or NUL, with the client's stdin,
+///    stdout, stderr and working directory passed as SERVER_NUM_FDS file
+///    descriptors (SCM_RIGHTS). The line runs with them as its stdio and
+///    working directory.
+///  - reply: the exit status of the line, an int.
+///
+/// A connection may send any number of requests. Shell state other than the
+/// working directory (prompt, 'enable', 'pipeconf', background jobs) belongs
+/// to the worker and is shared by the clients it serves. A worker running
+/// 'exit' replies, then quits and is replaced by a new one.
+///
+/// Lines run as the user running the server, so only that user may use it: the
+/// socket is created with mode 0600 and connections from processes of other
+/// users are closed unanswered. An existing socket at the path is replaced only
+/// if no server accepts connections on it, any other file is left alone and
+/// the server fails to start.
+////////////////////////////////////////////////////////////////////////////////
+
+// File descriptors passed with each request: stdin, stdout, stderr and an
+// O_DIRECTORY descriptor of the working directory
+#define SERVER_NUM_FDS 4
+
+// Longest line a request may carry
+#define SERVER_MAX_LINE 65536
+
+////////////////////////////////////////////////////////////////////////////////
+/// Run the server until it receives SIGINT or SIGTERM, the socket is removed
+/// when it stops.
+///
+/// @param   path         const char *, path of the socket to create.
+/// @param   numWorkers   int, number of workers, at least 1.
+/// @return               int, exit status for the shell, 0 if the server was
+///                       stopped by a signal.
+////////////////////////////////////////////////////////////////////////////////
+int server_main(const char *path, int numWorkers);
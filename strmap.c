@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "strmap.h"
+
+// Initial number of slots of a map
+#define STRMAP_INITIAL_CAPACITY 16
+
+// Marks a slot whose key was removed, probing must continue past it
+static char strmap_tombstone[1];
+
+#define STRMAP_IS_LIVE(entry)                                                  \
+    ((entry)->key != NULL && (entry)->key != strmap_tombstone)
+
+void strmap_init(strmap_t *map)
+{
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->used = 0;
+}
+
+void strmap_destroy(strmap_t *map, void (*freeValue)(void *))
+{
+    for (size_t i = 0; i < map->capacity; ++i) {
+        if (STRMAP_IS_LIVE(&map->entries[i])) {
+            free(map->entries[i].key);
+            if (freeValue != NULL) {
+                freeValue(map->entries[i].value);
+            }
+        }
+    }
+    free(map->entries);
+
+    strmap_init(map);
+}
+
+unsigned long strmap_hash(const char *key)
+{
+    unsigned long hash = 14695981039346656037UL;
+
+    for (const unsigned char *it = (const unsigned char *)key; *it; ++it) {
+        hash ^= *it;
+        hash *= 1099511628211UL;
+    }
+
+    return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the slot of the given key.
+///
+/// @return   strmap_entry_t *, slot holding key, or NULL if key is not in the
+///           map.
+////////////////////////////////////////////////////////////////////////////////
+static strmap_entry_t *
+strmap_find(const strmap_t *map, const char *key, unsigned long hash)
+{
+    if (map->capacity == 0) {
+        return NULL;
+    }
+
+    size_t mask = map->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        strmap_entry_t *entry = &map->entries[i];
+
+        if (entry->key == NULL) {
+            return NULL;
+        }
+        if (entry->key != strmap_tombstone && entry->hash == hash &&
+            strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Rebuild the table with the given number of slots, dropping tombstones.
+///
+/// @return   int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static int strmap_resize(strmap_t *map, size_t capacity)
+{
+    strmap_entry_t *entries =
+        (strmap_entry_t *)calloc(capacity, sizeof(strmap_entry_t));
+    if (entries == NULL) {
+        return -1;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < map->capacity; ++i) {
+        strmap_entry_t *old = &map->entries[i];
+
+        if (STRMAP_IS_LIVE(old)) {
+            size_t j = old->hash & mask;
+            while (entries[j].key != NULL) {
+                j = (j + 1) & mask;
+            }
+            entries[j] = *old;
+        }
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+    map->used = map->count;
+
+    return 0;
+}
+
+void *strmap_get(const strmap_t *map, const char *key)
+{
+    strmap_entry_t *entry = strmap_find(map, key, strmap_hash(key));
+
+    return (entry != NULL) ? entry->value : NULL;
+}
+
+int strmap_put(strmap_t *map, const char *key, void *value, void **previous)
+{
+    unsigned long hash = strmap_hash(key);
+
+    strmap_entry_t *entry = strmap_find(map, key, hash);
+    if (entry != NULL) {
+        if (previous != NULL) {
+            *previous = entry->value;
+        }
+        entry->value = value;
+        return 0;
+    }
+
+    if (previous != NULL) {
+        *previous = NULL;
+    }
+
+    // Keep the table at most 3/4 full (tombstones included) so probe
+    // sequences stay short and always end at an empty slot
+    if ((map->used + 1) * 4 > map->capacity * 3) {
+        size_t capacity = (map->capacity == 0) ? STRMAP_INITIAL_CAPACITY
+                                               : map->capacity;
+        while ((map->count + 1) * 4 > capacity * 3 / 2) {
+            capacity *= 2;
+        }
+        if (strmap_resize(map, capacity) != 0) {
+            return -1;
+        }
+    }
+
+    size_t len = strlen(key) + 1; // + 1 for NULL-terminator
+    char *keyCopy = (char *)malloc(len);
+    if (keyCopy == NULL) {
+        return -1;
+    }
+    memcpy(keyCopy, key, len);
+
+    size_t mask = map->capacity - 1;
+    size_t i = hash & mask;
+    while (STRMAP_IS_LIVE(&map->entries[i])) {
+        i = (i + 1) & mask;
+    }
+
+    entry = &map->entries[i];
+    if (entry->key == NULL) {
+        ++map->used;
+    }
+    entry->key = keyCopy;
+    entry->hash = hash;
+    entry->value = value;
+    ++map->count;
+
+    return 0;
+}
+
+void *strmap_remove(strmap_t *map, const char *key)
+{
+    strmap_entry_t *entry = strmap_find(map, key, strmap_hash(key));
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    void *value = entry->value;
+    free(entry->key);
+    entry->key = strmap_tombstone;
+    entry->value = NULL;
+    --map->count;
+
+    return value;
+}
+
+int strmap_next(const strmap_t *map,
+                size_t *it,
+                const char **key,
+                void **value)
+{
+    for (; *it < map->capacity; ++(*it)) {
+        strmap_entry_t *entry = &map->entries[*it];
+
+        if (STRMAP_IS_LIVE(entry)) {
+            *key = entry->key;
+            *value = entry->value;
+            ++(*it);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// String keyed hash map using open addressing with linear probing.
+///
+/// Keys are copied into the map, values are owned by the caller.
+////////////////////////////////////////////////////////////////////////////////
+
+// Slot in the map's table
+typedef struct strmap_entry_t {
+    char *key; // NULL if the slot was never used, see strmap.c for tombstones
+    unsigned long hash; // cached hash of key
+    void *value;
+} strmap_entry_t;
+
+typedef struct strmap_t {
+    strmap_entry_t *entries; // table of slots, NULL until first insertion
+    size_t capacity;         // number of slots, always a power of two
+    size_t count;            // number of keys in the map
+    size_t used;             // number of keys plus removed (tombstone) slots
+} strmap_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Initialize an empty map, no memory is allocated until first insertion.
+///
+/// @param   map   strmap_t *, map to initialize.
+////////////////////////////////////////////////////////////////////////////////
+void strmap_init(strmap_t *map);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove all keys from the map and release the memory held by the map.
+///
+/// @param   map         strmap_t *, map to destroy.
+/// @param   freeValue   void (*)(void *), called for each value, may be NULL.
+////////////////////////////////////////////////////////////////////////////////
+void strmap_destroy(strmap_t *map, void (*freeValue)(void *));
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hash function used by the map (FNV-1a).
+///
+/// @param   key   const char *, NULL-terminated string to hash.
+/// @return        unsigned long, hash of key.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long strmap_hash(const char *key);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   map   const strmap_t *, map to search.
+/// @param   key   const char *, key to search for.
+/// @return        void *, value associated with key or NULL if not found.
+////////////////////////////////////////////////////////////////////////////////
+void *strmap_get(const strmap_t *map, const char *key);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Associate a value with a key, replacing any previous value.
+///
+/// @param   map        strmap_t *, map to insert into.
+/// @param   key        const char *, key, copied into the map.
+/// @param   value      void *, value to associate with key.
+/// @param   previous   void **, previous value out (NULL if key was not in
+///                     the map), may be NULL.
+/// @return             int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int strmap_put(strmap_t *map, const char *key, void *value, void **previous);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   map   strmap_t *, map to remove key from.
+/// @param   key   const char *, key to remove.
+/// @return        void *, value that was associated with key, NULL if not
+///                found.
+////////////////////////////////////////////////////////////////////////////////
+void *strmap_remove(strmap_t *map, const char *key);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Iterate over the keys of the map (in no particular order):
+///
+///     size_t it = 0;
+///     while (strmap_next(map, &it, &key, &value)) { ... }
+///
+/// @param   map     const strmap_t *, map to iterate over.
+/// @param   it      size_t *, iterator, set to 0 before the first call.
+/// @param   key     const char **, key out.
+/// @param   value   void **, value out.
+/// @return          int, 1 if a key was returned, 0 at the end of the map.
+////////////////////////////////////////////////////////////////////////////////
+int strmap_next(const strmap_t *map,
+                size_t *it,
+                const char **key,
+                void **value);
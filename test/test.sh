@@ -109,6 +109,10 @@ if { $verbose == "false" } {
     send_user "\[\-\-\-\-\-\-\-\-\-\-\] Test environment setup... "
 }
 
+# Lines typed in the tests go to a history of their own
+set env(SANE_HISTORY) "/tmp/sane_test_history"
+file delete $env(SANE_HISTORY)
+
 spawn ../bin/sane
 expect {
     timeout { send_user "FAIL: Startup failed\n"; exit 1; }
@@ -282,6 +286,11 @@ performTest\
     "'Helloophole World'"\
     $prompt\
     "Test a more complex example of ignoring the \" character inside an escaped \' string."
+performTest\
+    "echo abc\\"\
+    "\r\nabc\r\n"\
+    $prompt\
+    "Test that a \\ at the end of the line ends the argument and is dropped."
 
 endTestSuite
 
@@ -359,6 +368,141 @@ performTest\
     $prompt\
     "Test that relative directories work."
 # performTest "cd ; pwd" "$env(HOME)" $prompt "Test that cd with no arguments work."
+performTest\
+    "spawn fork ; spawn"\
+    "fork"\
+    $prompt\
+    "Test that the fork spawn backend can be selected."
+performTest\
+    "cat folder3/names.txt | sort | grep Betty"\
+    "Betty"\
+    $prompt\
+    "Test that pipelines work with the fork spawn backend."
+performTest\
+    "spawn posix ; spawn"\
+    "posix"\
+    $prompt\
+    "Test that the posix_spawn backend can be selected."
+performTest\
+    "hash -r ; hash cat ; hash"\
+    "0\t/*/cat"\
+    $prompt\
+    "Test that the hash builtin can pre-populate the command location cache."
+performTest\
+    "hash commandThatDoesNotExist"\
+    "hash: commandThatDoesNotExist: not found"\
+    $prompt\
+    "Test that the hash builtin complains if a command can not be found."
+performTest\
+    "cache -r ; cache"\
+    "lines\t0/256\r\nhits\t0\r\nmisses\t0"\
+    $prompt\
+    "Test that the cache builtin can clear the parse cache."
+performTest\
+    "cache"\
+    "lines\t1/256\r\nhits\t0\r\nmisses\t1"\
+    $prompt\
+    "Test that a new line is added to the parse cache."
+performTest\
+    "cache"\
+    "lines\t1/256\r\nhits\t1\r\nmisses\t1"\
+    $prompt\
+    "Test that a repeated line is found in the parse cache."
+performTest\
+    "sleep 1 & jobs"\
+    "Running\tsleep 1"\
+    $prompt\
+    "Test that the jobs builtin lists background jobs."
+performTest\
+    "wait ; jobs ; wait %99"\
+    "wait: %99: no such job"\
+    $prompt\
+    "Test that the wait builtin waits for all jobs and complains about unknown jobs."
+performTest\
+    "echo -n Bet ; echo ty > folder4/betty.txt ; cat folder4/betty.txt"\
+    "Betty"\
+    $prompt\
+    "Test that the echo builtin prints its arguments and can be redirected."
+performTest\
+    "printf %s-%d, a 1 b 2 | tr , ."\
+    "a-1.b-2."\
+    $prompt\
+    "Test that the printf builtin reuses its format and works in a pipeline."
+performTest\
+    "true ; false ; test -f folder3/names.txt ; \[ 1 -eq x \]"\
+    "test: x: integer expression expected"\
+    $prompt\
+    "Test that the test builtin reports invalid integers."
+performTest\
+    "time sort folder3/names.txt | head -1"\
+    "Aardvark\r\nreal *s\r\nstage*command\r\n0 *sort\r\n1 *head"\
+    $prompt\
+    "Test that time reports each stage of a pipeline."
+performTest\
+    "time -j false"\
+    "{\"real\":*,\"status\":1,\"stages\":*\"command\":\"false\",\"pid\":0,*}"\
+    $prompt\
+    "Test that time -j reports a builtin run in the shell as JSON."
+performTest\
+    "env SANE_TRACE=folder4/trace.json ../bin/sane -c 'ls folder2/foo?.c' ; grep -c glob folder4/trace.json ; rm folder4/trace.json"\
+    "folder2/foo2.c\r\n1"\
+    $prompt\
+    "Test that SANE_TRACE writes a trace of the shell's phases."
+performTest\
+    "../bin/sane -c 'echo before ; exit ; echo after' ; echo done"\
+    "before\r\ndone"\
+    $prompt\
+    "Test that exit stops the shell without running the rest of the line."
+performTest\
+    "sh -c '../bin/sane --server /tmp/sane_test.sock 1 & sleep 0.5 ; ../bin/sane-client /tmp/sane_test.sock \"ls folder2/foo?.c | wc -l\" ; ../bin/sane-client /tmp/sane_test.sock false ; echo \$? ; kill \$! ; wait'"\
+    "2\r\n1"\
+    $prompt\
+    "Test that sane --server runs lines sent by sane-client in its directory."
+performTest\
+    "../bin/sane -c 'sched -j 1 ; sleep 0.3 & echo second & sched ; wait'"\
+    "limit 1\r\nrunning 1\r\npending 1\r\nstarted 1\r\nqueued 1\r\nsecond"\
+    $prompt\
+    "Test that background jobs past the sched limit wait in the queue."
+performTest\
+    "../bin/sane -c 'batch on -s 100 ; /bin/echo folder2/*.c end'"\
+    "folder2/abc.c folder2/abc33.c folder2/foo1.c end\r\nfolder2/foo2.c folder2/foo33.c end"\
+    $prompt\
+    "Test that batch runs a command once per batch of its expanded arguments."
+performTest\
+    "env SANE_HISTORY=folder4/history ../bin/sane -c 'history -s ls folder1 ; history -s echo abc ; history -s ls folder2 ; history der ; history -n 1 c' ; rm folder4/history"\
+    "ls folder1\r\nls folder2\r\necho abc"\
+    $prompt\
+    "Test that history appends entries and searches them."
+performTest\
+    "echo fold\t2/ab\t33.cc"\
+    "\r\nfolder2/abc33.cc\r\n"\
+    $prompt\
+    "Test that Tab completes paths up to where the candidates differ."
+performTest\
+    "export GREETING=hi\\ there ; env | grep GREETING"\
+    "GREETING=hi there"\
+    $prompt\
+    "Test that export passes variables to commands."
+performTest\
+    "echo \$GREETING \"\${GREETING}!\" '\$GREETING' ; unset GREETING"\
+    "hi there hi there! \$GREETING"\
+    $prompt\
+    "Test that variables expand outside single quotes."
+performTest\
+    "echo start \$GREETING end"\
+    "start end"\
+    $prompt\
+    "Test that unset removes variables."
+performTest\
+    "enable -f ../bin/emit.so emit ; emit requests 1"\
+    "requests 1 *"\
+    $prompt\
+    "Test that enable loads a builtin from a shared library."
+performTest\
+    "enable -n pwd ; enable -d pwd ; enable pwd ; pwd"\
+    "enable: pwd: not dynamically loaded*/test"\
+    $prompt\
+    "Test that enable disables and enables compiled in builtins."
 
 endTestSuite
 
@@ -395,6 +539,16 @@ performTest\
     "[ ]*No such file or directory"\
     $prompt\
     "Make sure wildcard doesn't expand when inside string"
+performTest\
+    "echo folder2/\[ah\]foo folder2/*.\[!c\]"\
+    "folder2/afoo folder2/hfoo folder2/abc.x"\
+    $prompt\
+    "Test that bracket expressions work and matches are sorted."
+performTest\
+    "echo folder*/names.txt"\
+    "folder3/names.txt folder4/names.txt"\
+    $prompt\
+    "Test that wildcards work in directory names."
 # performTest\
 #     "ls folder2/*"\
 #     "folder2/abc.c[ ]*folder2/abc33.c[ ]*folder2/foo2.c[ ]*folder2/hfoo[ ]*folder2/abc.x[ ]*folder2/afoo[ ]*folder2/foo33.c[ ]*folder2/abc33.c[ ]*folder2/foo1.c[ ]*folder2/foo4[ ]*"\
@@ -468,6 +622,21 @@ performTest\
     "folder2/abc.c[ ]*folder2/abc.x[ ]*folder2/abc33.c[ ]*folder2/abc33.cc"\
     $prompt\
     "Test a command with a large number of parameters"
+performTest\
+    "../bin/sane -c \"cd folder3 ; pwd\""\
+    "*/test/folder3"\
+    $prompt\
+    "Test that a command line can be run with 'sane -c'."
+performTest\
+    "../bin/sane folder5/script.txt"\
+    "Betty\r\n*/test/folder3"\
+    $prompt\
+    "Test that a script file can be run."
+performTest\
+    "cat folder5/script.txt | ../bin/sane"\
+    "Betty\r\n*/test/folder3"\
+    $prompt\
+    "Test that a script can be piped into the shell."
 # performTest\
 #     "exit"\
 #     ""\
@@ -499,6 +668,11 @@ performTest\
     "Betty"\
     $prompt\
     "Test that standard input redirection works."
+performTest\
+    "cat < folder3/fileThatDoesNotExist"\
+    "sane open: No such file or directory"\
+    $prompt\
+    "Test that a missing input redirection file is reported."
 
 endTestSuite
 
@@ -531,5 +705,30 @@ performTest\
     "Hello World"\
     $prompt\
     "Test that a longer shell pipeline works."
+performTest\
+    "cat folder3/names.txt | tee folder4/names.txt | grep Betty ; cat folder4/names.txt"\
+    "Betty\r\nBetty\r\nAardvark\r\nHello World"\
+    $prompt\
+    "Test that tee copies its input to stdout and the files."
+performTest\
+    "cp folder3/names.txt folder4/names.txt ; sort folder4/names.txt"\
+    "Aardvark\r\nBetty\r\nHello World"\
+    $prompt\
+    "Test that cp copies a file."
+performTest\
+    "cat -n folder3/names.txt | grep Aardvark"\
+    "*2*Aardvark"\
+    $prompt\
+    "Test that options the cat builtin doesn't support run the cat command."
+performTest\
+    "printf %0200000d 0 | cat | tee -a folder4/betty.txt | wc -c ; echo Betty > folder4/betty.txt"\
+    "200000"\
+    $prompt\
+    "Test that builtins in a pipeline run at the same time as the other stages."
+performTest\
+    "pipeconf -s 1M -a on ; pipeconf -s 256k sort folder3/names.txt | head -1 ; pipeconf ; pipeconf -s 0 -a off"\
+    "Aardvark\r\nsize 1048576\r\ncpus all\r\nadaptive on"\
+    $prompt\
+    "Test that pipeconf changes the settings of the pipelines that follow or of one pipeline."
 
 endTestSuite
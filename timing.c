@@ -0,0 +1,90 @@
+#include <time.h>
+
+#include "timing.h"
+
+double timing_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double timing_seconds(const struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void timing_subtract(struct timeval *tv, const struct timeval *start)
+{
+    tv->tv_sec -= start->tv_sec;
+    tv->tv_usec -= start->tv_usec;
+    if (tv->tv_usec < 0) {
+        --tv->tv_sec;
+        tv->tv_usec += 1000000;
+    }
+}
+
+void timing_usageSince(struct rusage *usage, const struct rusage *start)
+{
+    getrusage(RUSAGE_SELF, usage);
+    timing_subtract(&usage->ru_utime, &start->ru_utime);
+    timing_subtract(&usage->ru_stime, &start->ru_stime);
+    usage->ru_nvcsw -= start->ru_nvcsw;
+    usage->ru_nivcsw -= start->ru_nivcsw;
+}
+
+void timing_printString(FILE *stream, const char *text)
+{
+    fputc('"', stream);
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0';
+         ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(stream, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(stream, "\\u%04x", *c);
+        } else {
+            fputc(*c, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+void timing_print(FILE *stream,
+                  int format,
+                  double real,
+                  int status,
+                  const timing_stage_t *stages,
+                  int numStages)
+{
+    if (format == TIMING_JSON) {
+        fprintf(stream, "{\"real\":%.6f,\"status\":%d,\"stages\":[", real,
+                status);
+        for (int i = 0; i < numStages; ++i) {
+            const struct rusage *usage = &stages[i].usage;
+            fprintf(stream, "%s{\"command\":", i > 0 ? "," : "");
+            timing_printString(stream, stages[i].command);
+            fprintf(stream,
+                    ",\"pid\":%d,\"status\":%d,\"user\":%.6f,\"sys\":%.6f,"
+                    "\"maxrss_kb\":%ld,\"vcsw\":%ld,\"ivcsw\":%ld}",
+                    (int)stages[i].pid, stages[i].status,
+                    timing_seconds(&usage->ru_utime),
+                    timing_seconds(&usage->ru_stime), usage->ru_maxrss,
+                    usage->ru_nvcsw, usage->ru_nivcsw);
+        }
+        fprintf(stream, "]}\n");
+        return;
+    }
+
+    fprintf(stream, "real %.3fs\n", real);
+    fprintf(stream, "%-5s %9s %9s %10s %7s %7s %6s  %s\n", "stage", "user",
+            "sys", "maxrss", "vcsw", "ivcsw", "status", "command");
+    for (int i = 0; i < numStages; ++i) {
+        const struct rusage *usage = &stages[i].usage;
+        fprintf(stream, "%-5d %8.3fs %8.3fs %8ldkB %7ld %7ld %6d  %s%s\n", i,
+                timing_seconds(&usage->ru_utime),
+                timing_seconds(&usage->ru_stime), usage->ru_maxrss,
+                usage->ru_nvcsw, usage->ru_nivcsw, stages[i].status,
+                stages[i].command, stages[i].pid == 0 ? " (shell)" : "");
+    }
+}
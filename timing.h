@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Reports of the 'time' keyword:
+///
+///     time [-j] pipeline
+///
+/// runs the pipeline and prints its wall time and, for each of its stages,
+/// the user and system CPU time, maximum resident set size and voluntary and
+/// involuntary context switches collected with wait4(). Builtins run in the
+/// shell report the shell's usage while they ran (and the shell's maximum
+/// resident set size). '-j' prints a single line of JSON instead:
+///
+///     {"real":0.01,"status":0,"stages":[{"command":"ls","pid":123,
+///      "status":0,"user":0.001,"sys":0.002,"maxrss_kb":2048,"vcsw":1,
+///      "ivcsw":0}, ...]}
+///
+/// 'pid' is 0 for builtins run in the shell and -1 for commands that could
+/// not be started.
+////////////////////////////////////////////////////////////////////////////////
+
+// Output formats
+#define TIMING_TEXT 1
+#define TIMING_JSON 2
+
+typedef struct timing_stage_t {
+    const char *command; // name of the command (argv[0])
+    pid_t pid;           // 0 if run in the shell, -1 if it wasn't started
+    int status;          // exit status
+    struct rusage usage; // resources used
+} timing_stage_t;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   double, seconds elapsed on the monotonic clock.
+////////////////////////////////////////////////////////////////////////////////
+double timing_now();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Resources used by the shell since 'start', for builtins run in the shell.
+///
+/// @param   usage   struct rusage *, resources used out.
+/// @param   start   const struct rusage *, usage of the shell at the start,
+///                  from getrusage(RUSAGE_SELF).
+////////////////////////////////////////////////////////////////////////////////
+void timing_usageSince(struct rusage *usage, const struct rusage *start);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print a JSON string, quoted and with '"', '\\' and control characters
+/// escaped. Also used for the trace file (see trace.h).
+///
+/// @param   stream   FILE *, stream to print to.
+/// @param   text     const char *, NULL-terminated string to print.
+////////////////////////////////////////////////////////////////////////////////
+void timing_printString(FILE *stream, const char *text);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the report of a timed pipeline.
+///
+/// @param   stream      FILE *, stream to print to.
+/// @param   format      int, TIMING_TEXT or TIMING_JSON.
+/// @param   real        double, wall time of the pipeline in seconds.
+/// @param   status      int, exit status of the pipeline.
+/// @param   stages      const timing_stage_t *, stages in pipeline order.
+/// @param   numStages   int, number of stages.
+////////////////////////////////////////////////////////////////////////////////
+void timing_print(FILE *stream,
+                  int format,
+                  double real,
+                  int status,
+                  const timing_stage_t *stages,
+                  int numStages);
@@ -1,5 +1,6 @@
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "token.h"
@@ -35,16 +36,278 @@ void expandEscapeCharacter(char *str)
     }
 }
 
-int tokenise(char *inputLine, char *token[])
+// Number of tokens the token array starts with, enough for most lines
+#define INITIAL_NUM_TOKENS 16
+
+////////////////////////////////////////////////////////////////////////////////
+/// Make sure there is room for one more token in the token array, doubling its
+/// size if it is full.
+///
+/// @return   int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static int reserveToken(char ***token, int *capacity, int numTokens)
+{
+    if (numTokens < *capacity) {
+        return 0;
+    }
+
+    int newCapacity = (*capacity > 0) ? *capacity * 2 : INITIAL_NUM_TOKENS;
+    char **newToken = (char **)realloc(*token, sizeof(char *) * newCapacity);
+    if (newToken == NULL) {
+        return -1;
+    }
+    *token = newToken;
+    *capacity = newCapacity;
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Character scanning
+///
+/// The tokeniser spends nearly all of its time stepping over runs of
+/// characters that need no special treatment. Each kind of run is skipped by a
+/// scan function that stops at the first character the tokeniser has to look
+/// at. The scan functions come in a scalar version and, on x86, SSE2 and AVX2
+/// versions that classify 16 or 32 characters at a time. The best version
+/// supported by the CPU is chosen the first time tokenise() is called.
+///
+/// The vector versions only ever load aligned blocks, so they never read
+/// across a page boundary, even when reading past the NULL-terminator.
+////////////////////////////////////////////////////////////////////////////////
+
+// Kinds of scans
+#define SCAN_BLANK 0  // Skip space, tab, newline etc. (stop at a printable)
+#define SCAN_PLAIN 1  // Skip printable characters other than \ " and '
+#define SCAN_QUOTED 2 // Skip characters other than \ and the two quotes given
+
+// Character scanning function, 'quote1' and 'quote2' are used by SCAN_QUOTED.
+// Returns a pointer to the first character at which the scan stops, which is
+// the NULL-terminator if the scan reaches the end of the string.
+typedef char *(*scanFunc_t)(char *it, int kind, char quote1, char quote2);
+
+// Characters the tokeniser treats as part of a token (not space, tab,
+// newline etc.)
+#define IS_PRINTABLE(c) (((c) > 32) && ((c) <= 126))
+
+// Returns 1 if a scan of the given kind stops at character 'c'
+static inline int scanStops(char c, int kind, char quote1, char quote2)
+{
+    switch (kind) {
+    case SCAN_BLANK:
+        return !c || IS_PRINTABLE(c);
+    case SCAN_PLAIN:
+        return !IS_PRINTABLE(c) || c == '\\' || c == '"' || c == '\'';
+    default:
+        return !c || c == '\\' || c == quote1 || c == quote2;
+    }
+}
+
+static char *scanScalar(char *it, int kind, char quote1, char quote2)
 {
+    while (!scanStops(*it, kind, quote1, quote2)) {
+        ++it;
+    }
+
+    return it;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define HAVE_VECTOR_SCAN
+
+////////////////////////////////////////////////////////////////////////////////
+/// Vector scans load the aligned block containing 'it' and ignore the bytes
+/// before 'it'. For every block a bit mask is computed of the bytes at which
+/// the scan stops, bit 'i' being set if the scan stops at byte 'i'.
+///
+/// Printable characters (33 - 126) are found with a signed comparison: bytes
+/// >= 128 are negative and so are not greater than ' '.
+////////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("sse2"))) static char *
+scanSSE2(char *it, int kind, char quote1, char quote2)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i del = _mm_set1_epi8(127);
+    const __m128i escape = _mm_set1_epi8('\\');
+    // Quote characters that stop the scan
+    const __m128i q1 = _mm_set1_epi8((kind == SCAN_PLAIN) ? '"' : quote1);
+    const __m128i q2 = _mm_set1_epi8((kind == SCAN_PLAIN) ? '\'' : quote2);
+
+    size_t offset = (size_t)it & 15;
+    char *block = it - offset;
+    unsigned int ignore = ~(0xffffu << offset);
+
+    for (;; block += 16, ignore = 0) {
+        __m128i bytes = _mm_load_si128((const __m128i *)block);
+
+        unsigned int stop;
+        if (kind == SCAN_QUOTED) {
+            __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, escape),
+                             _mm_cmpeq_epi8(bytes, zero)),
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, q1),
+                             _mm_cmpeq_epi8(bytes, q2)));
+            stop = _mm_movemask_epi8(special);
+        } else {
+            __m128i printable = _mm_andnot_si128(
+                _mm_cmpeq_epi8(bytes, del), _mm_cmpgt_epi8(bytes, space));
+            if (kind == SCAN_BLANK) {
+                stop = _mm_movemask_epi8(
+                    _mm_or_si128(printable, _mm_cmpeq_epi8(bytes, zero)));
+            } else {
+                __m128i special = _mm_or_si128(
+                    _mm_cmpeq_epi8(bytes, escape),
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, q1),
+                                 _mm_cmpeq_epi8(bytes, q2)));
+                stop = (~_mm_movemask_epi8(printable) & 0xffffu) |
+                       _mm_movemask_epi8(special);
+            }
+        }
+
+        stop &= ~ignore;
+        if (stop != 0) {
+            return block + __builtin_ctz(stop);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static char *
+scanAVX2(char *it, int kind, char quote1, char quote2)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i del = _mm256_set1_epi8(127);
+    const __m256i escape = _mm256_set1_epi8('\\');
+    // Quote characters that stop the scan
+    const __m256i q1 = _mm256_set1_epi8((kind == SCAN_PLAIN) ? '"' : quote1);
+    const __m256i q2 = _mm256_set1_epi8((kind == SCAN_PLAIN) ? '\'' : quote2);
+
+    size_t offset = (size_t)it & 31;
+    char *block = it - offset;
+    unsigned int ignore = (offset > 0) ? ~(0xffffffffu << offset) : 0;
+
+    for (;; block += 32, ignore = 0) {
+        __m256i bytes = _mm256_load_si256((const __m256i *)block);
+
+        unsigned int stop;
+        if (kind == SCAN_QUOTED) {
+            __m256i special = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, escape),
+                                _mm256_cmpeq_epi8(bytes, zero)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(bytes, q1),
+                                _mm256_cmpeq_epi8(bytes, q2)));
+            stop = (unsigned int)_mm256_movemask_epi8(special);
+        } else {
+            __m256i printable = _mm256_andnot_si256(
+                _mm256_cmpeq_epi8(bytes, del), _mm256_cmpgt_epi8(bytes, space));
+            if (kind == SCAN_BLANK) {
+                stop = (unsigned int)_mm256_movemask_epi8(
+                    _mm256_or_si256(printable, _mm256_cmpeq_epi8(bytes, zero)));
+            } else {
+                __m256i special = _mm256_or_si256(
+                    _mm256_cmpeq_epi8(bytes, escape),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(bytes, q1),
+                                    _mm256_cmpeq_epi8(bytes, q2)));
+                stop = ~(unsigned int)_mm256_movemask_epi8(printable) |
+                       (unsigned int)_mm256_movemask_epi8(special);
+            }
+        }
+
+        stop &= ~ignore;
+        if (stop != 0) {
+            return block + __builtin_ctz(stop);
+        }
+    }
+}
+#endif
+
+// Scan function used by tokenise(), NULL until chosen
+static scanFunc_t scan = NULL;
+
+int tokeniseSetImplementation(int impl)
+{
+    switch (impl) {
+    case TOKENISE_SCALAR:
+        scan = &scanScalar;
+        return 0;
+#ifdef HAVE_VECTOR_SCAN
+    case TOKENISE_SSE2:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+            scan = &scanSSE2;
+            return 0;
+        }
+        break;
+    case TOKENISE_AVX2:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            scan = &scanAVX2;
+            return 0;
+        }
+        break;
+#endif
+    }
+
+    return -1;
+}
+
+int tokeniseGetImplementation()
+{
+#ifdef HAVE_VECTOR_SCAN
+    if (scan == &scanAVX2) {
+        return TOKENISE_AVX2;
+    } else if (scan == &scanSSE2) {
+        return TOKENISE_SSE2;
+    }
+#endif
+
+    return TOKENISE_SCALAR;
+}
+
+// Choose the best scan function supported by the CPU
+static void chooseScan()
+{
+    if (tokeniseSetImplementation(TOKENISE_AVX2) != 0 &&
+        tokeniseSetImplementation(TOKENISE_SSE2) != 0) {
+        tokeniseSetImplementation(TOKENISE_SCALAR);
+    }
+}
+
+// Number of characters checked one at a time before using the scan function
+#define SCAN_PROBE_LENGTH 8
+
+////////////////////////////////////////////////////////////////////////////////
+/// Scan from 'it', see scanFunc_t. Most tokens and gaps between tokens are
+/// short, so the first few characters are checked inline before paying for a
+/// call to the (vector) scan function.
+////////////////////////////////////////////////////////////////////////////////
+static inline char *skip(char *it, int kind, char quote1, char quote2)
+{
+    for (int i = 0; i < SCAN_PROBE_LENGTH; ++i, ++it) {
+        if (scanStops(*it, kind, quote1, quote2)) {
+            return it;
+        }
+    }
+
+    return scan(it, kind, quote1, quote2);
+}
+
+int tokenise(char *inputLine, char ***token, int *capacity)
+{
+    if (scan == NULL) {
+        chooseScan();
+    }
+
     int numTokens = 0;
 
     char *it = inputLine;
-    while (*it && numTokens < MAX_NUM_TOKENS) {
+    while (*it) {
         // Skip characters we aren't interested in such as space, tab, newline
-        while (*it && ((*it <= 32) || (*it > 126))) {
-            ++it;
-        }
+        it = skip(it, SCAN_BLANK, 0, 0);
 
         if (*it) {
             if ((*it == '"') | (*it == '\'')) {
@@ -53,25 +316,34 @@ int tokenise(char *inputLine, char *token[])
 
                 // Assign start address of string (after quote) to array
                 // token[numTokens] = ++it;
-                token[numTokens] = it++;
+                if (reserveToken(token, capacity, numTokens) != 0) {
+                    return -1;
+                }
+                (*token)[numTokens] = it++;
                 ++numTokens;
 
                 // Don't stop consuming characters until we find end of input or
                 // end of string
-                while (*it) {
+                while (*(it = skip(it, SCAN_QUOTED, '"', quoteType))) {
                     // If escape character, skip over next character (ignore it)
                     if (*it == '\\') {
                         /* expandEscapeCharacter(it); */
-                        ++it;
+                        if (*(it + 1)) {
+                            ++it;
+                        }
                     } else if (*it == '"' || *it == quoteType) {
                         char innerQuoteType = *it;
                         char *itStr = ++it;
                         int isStringClosed = 0;
 
-                        while (*itStr) {
+                        while (*(itStr = skip(itStr, SCAN_QUOTED,
+                                              innerQuoteType,
+                                              innerQuoteType))) {
                             // Skip over escaped characters
                             if (*itStr == '\\') {
-                                ++itStr;
+                                if (*(itStr + 1)) {
+                                    ++itStr;
+                                }
                             } else if (*itStr == innerQuoteType) {
                                 isStringClosed = 1;
                                 break;
@@ -98,24 +370,32 @@ int tokenise(char *inputLine, char *token[])
                 ++it;
             } else {
                 // Assign start address of token to array
-                token[numTokens] = it;
+                if (reserveToken(token, capacity, numTokens) != 0) {
+                    return -1;
+                }
+                (*token)[numTokens] = it;
                 ++numTokens;
 
                 // Skip characters we are interested in ('a', 'b', '!', etc.)
                 // (not including space, tab, newline etc.)
-                while (*it && ((*it > 32) && (*it <= 126))) {
+                while (IS_PRINTABLE(*(it = skip(it, SCAN_PLAIN, 0, 0)))) {
                     // Skip escaped characters
                     if (*it == '\\') {
-                        ++it;
+                        if (*(it + 1)) {
+                            ++it;
+                        }
                     } else if ((*it == '"') | (*it == '\'')) {
                         // Ensure that string is closed
                         char quoteType = *it;
                         char *itStr = ++it;
                         int stringClosed = 0;
-                        while (*itStr) {
+                        while (*(itStr = skip(itStr, SCAN_QUOTED, quoteType,
+                                              quoteType))) {
                             // Skip over escaped characters
                             if (*itStr == '\\') {
-                                ++itStr;
+                                if (*(itStr + 1)) {
+                                    ++itStr;
+                                }
                             } else if (*itStr == quoteType) {
                                 stringClosed = 1;
                                 break;
@@ -141,12 +421,6 @@ int tokenise(char *inputLine, char *token[])
                 ++it;
             }
         }
-
-        // If we've reached maximum number of tokens and still have more input
-        // to tokenise, return error
-        if (numTokens == MAX_NUM_TOKENS && *it) {
-            return -1;
-        }
     }
 
     return numTokens;
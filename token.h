@@ -1,20 +1,45 @@
-#define MAX_NUM_TOKENS (100 * 1000)
+// Implementations of the tokeniser's character scanning
+#define TOKENISE_SCALAR 0 // One character at a time, works everywhere
+#define TOKENISE_SSE2 1   // 16 characters at a time (x86)
+#define TOKENISE_AVX2 2   // 32 characters at a time (x86)
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Given a string of characters provided in 'inputLine', splits the characters
-/// into a series of tokens and puts them in the output array 'token'.
+/// into a series of tokens and puts them in the output array '*token'.
+///
+/// The token array is grown as needed and can be reused for the next line, so
+/// a caller that keeps it around only pays for the allocation once.
 ///
 /// If successful, returns the number of tokens parsed. If an error occurs, one
 /// of the following error codes will be returned:
-///    -1 - if inputLine contains > MAX_NUM_TOKENS
+///    -1 - if the token array could not be grown (out of memory)
 ///    -2 - if string is not properly closed, e.g. ("Hello world) instead of
 ///         ("Hello world")
 ///
 /// @pre   'inputLine' is a NULL-terminated string.
-/// @pre   'token' is an array large enough to hold at least MAX_NUM_TOKENS
+/// @pre   '*token' is NULL or an array of '*capacity' elements allocated with
+///        malloc().
 ///
 /// @param   inputLine   char *, string of characters to tokenise.
-/// @param   token       char *[], tokens out.
+/// @param   token       char ***, token array in/out.
+/// @param   capacity    int *, number of elements in token array in/out.
 /// @return              int, >= 0 if successful, < 0 if error.
 ////////////////////////////////////////////////////////////////////////////////
-int tokenise(char *inputLine, char *token[]);
+int tokenise(char *inputLine, char ***token, int *capacity);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Choose the implementation used by tokenise() to scan the input. By default
+/// the fastest implementation supported by the CPU is used. All
+/// implementations produce exactly the same tokens.
+///
+/// @param   impl   int, one of TOKENISE_SCALAR, TOKENISE_SSE2, TOKENISE_AVX2.
+/// @return         int, 0 if successful, -1 if the implementation is not
+///                 supported on this machine.
+////////////////////////////////////////////////////////////////////////////////
+int tokeniseSetImplementation(int impl);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   int, implementation currently used by tokenise(), one of
+///           TOKENISE_SCALAR, TOKENISE_SSE2, TOKENISE_AVX2.
+////////////////////////////////////////////////////////////////////////////////
+int tokeniseGetImplementation();
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "trace.h"
+
+typedef struct trace_span_t {
+    const char *name;
+    uint64_t start;    // nanoseconds on the monotonic clock
+    uint64_t duration; // nanoseconds
+    char detail[24];   // empty if none
+} trace_span_t;
+
+int trace_enabled = 0;
+
+static trace_span_t *trace_spans = NULL;
+// Number of spans recorded, the next one goes to trace_numSpans %
+// TRACE_CAPACITY
+static uint64_t trace_numSpans = 0;
+static const char *trace_path = NULL;
+
+int trace_init()
+{
+    trace_path = getenv("SANE_TRACE");
+    if (trace_path == NULL || trace_path[0] == '\0') {
+        return 0;
+    }
+
+    trace_spans = (trace_span_t *)malloc(sizeof(trace_span_t) * TRACE_CAPACITY);
+    if (trace_spans == NULL) {
+        return -1;
+    }
+    trace_numSpans = 0;
+    trace_enabled = 1;
+
+    return 0;
+}
+
+uint64_t trace_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void trace_record(uint64_t start, const char *name, const char *detail)
+{
+    trace_span_t *span = &trace_spans[trace_numSpans++ % TRACE_CAPACITY];
+    span->name = name;
+    span->start = start;
+    span->duration = trace_clock() - start;
+    span->detail[0] = '\0';
+    if (detail != NULL) {
+        strncat(span->detail, detail, sizeof(span->detail) - 1);
+    }
+}
+
+void trace_shutdown()
+{
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = 0;
+
+    FILE *stream = fopen(trace_path, "w");
+    if (stream == NULL) {
+        perror("sane: trace");
+    } else {
+        // Complete ('X') events, timestamps in microseconds
+        int pid = getpid();
+        uint64_t first = (trace_numSpans > TRACE_CAPACITY)
+                             ? trace_numSpans - TRACE_CAPACITY
+                             : 0;
+        fprintf(stream, "{\"traceEvents\":[\n");
+        for (uint64_t i = first; i < trace_numSpans; ++i) {
+            const trace_span_t *span = &trace_spans[i % TRACE_CAPACITY];
+            fprintf(stream,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                    (i > first) ? ",\n" : "", span->name,
+                    span->start / 1e3, span->duration / 1e3, pid, pid);
+            if (span->detail[0] != '\0') {
+                fprintf(stream, ",\"args\":{\"detail\":");
+                timing_printString(stream, span->detail);
+                fprintf(stream, "}");
+            }
+            fprintf(stream, "}");
+        }
+        fprintf(stream, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(stream);
+    }
+
+    free(trace_spans);
+    trace_spans = NULL;
+}
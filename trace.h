@@ -0,0 +1,77 @@
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Tracing of the shell's phases (parsing, wildcard expansion, spawning,
+/// waiting...) into an in-memory ring buffer, written out as Chrome trace
+/// JSON when the shell exits. Run the shell with
+///
+///     SANE_TRACE=trace.json sane script
+///
+/// and open trace.json in Perfetto (ui.perfetto.dev) or chrome://tracing. The
+/// buffer keeps the last TRACE_CAPACITY spans.
+///
+/// A span is recorded around a phase with:
+///
+///     TRACE_START(span);
+///     ...
+///     TRACE_END(span, "tokenise", NULL);
+///
+/// Without SANE_TRACE in the environment a trace point costs a load and a
+/// branch. Build with -DSANE_NO_TRACE (make TRACE_FLAGS=-DSANE_NO_TRACE) to
+/// remove the trace points altogether.
+////////////////////////////////////////////////////////////////////////////////
+
+// Number of spans kept, older spans are overwritten
+#define TRACE_CAPACITY 65536
+
+// 1 if spans are being recorded
+extern int trace_enabled;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Start recording if SANE_TRACE is set in the environment.
+///
+/// @return   int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int trace_init();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Write the recorded spans to the file named by SANE_TRACE and release the
+/// buffer.
+////////////////////////////////////////////////////////////////////////////////
+void trace_shutdown();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   uint64_t, nanoseconds on the monotonic clock.
+////////////////////////////////////////////////////////////////////////////////
+uint64_t trace_clock();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Record a span that started at 'start' and ends now.
+///
+/// @param   start    uint64_t, start of the span, from trace_clock().
+/// @param   name     const char *, name of the phase, must be a literal.
+/// @param   detail   const char *, e.g. the command's name, copied (and cut
+///                   short), NULL for none.
+////////////////////////////////////////////////////////////////////////////////
+void trace_record(uint64_t start, const char *name, const char *detail);
+
+static inline uint64_t trace_start()
+{
+    return trace_enabled ? trace_clock() : 0;
+}
+
+static inline void
+trace_end(uint64_t start, const char *name, const char *detail)
+{
+    if (start != 0) {
+        trace_record(start, name, detail);
+    }
+}
+
+#ifndef SANE_NO_TRACE
+#define TRACE_START(span) uint64_t span = trace_start()
+#define TRACE_END(span, name, detail) trace_end(span, name, detail)
+#else
+#define TRACE_START(span)
+#define TRACE_END(span, name, detail)
+#endif
@@ -0,0 +1,913 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fastcopy.h"
+#include "utilities.h"
+
+// Exit status of a utility that stopped because of errno 'err', or -1 if the
+// error should be reported. Like the external commands, a utility interrupted
+// by the user or writing to a closed pipe stops quietly.
+static int sane_quietStatus(int err)
+{
+    if (err == EINTR) {
+        return 128 + SIGINT;
+    } else if (err == EPIPE) {
+        return 128 + SIGPIPE;
+    }
+
+    return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// cat
+////////////////////////////////////////////////////////////////////////////////
+
+int sane_catAccepts(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            break;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0' &&
+                   strcmp(argv[i], "-u") != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Copy one operand of cat to stdout, returns the exit status
+static int sane_catFile(const char *name)
+{
+    int fd = STDIN_FILENO;
+    if (strcmp(name, "-") != 0) {
+        fd = open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Copying a file to the end of itself would never finish
+    struct stat inStat, outStat;
+    if (fstat(fd, &inStat) == 0 && fstat(STDOUT_FILENO, &outStat) == 0 &&
+        S_ISREG(inStat.st_mode) && inStat.st_dev == outStat.st_dev &&
+        inStat.st_ino == outStat.st_ino &&
+        lseek(fd, 0, SEEK_CUR) < inStat.st_size) {
+        fprintf(stderr, "cat: %s: input file is output file\n", name);
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    if (fastcopy_fd(fd, STDOUT_FILENO) != 0) {
+        status = sane_quietStatus(errno);
+        if (status == -1) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    return status;
+}
+
+int sane_cat(int argc, char **argv)
+{
+    // Output of earlier builtins goes first
+    fflush(stdout);
+
+    // Skip options, '-u' (unbuffered) is what cat does anyway
+    int i = 1;
+    for (; i < argc && strcmp(argv[i], "-u") == 0; ++i) {
+    }
+    if (i < argc && strcmp(argv[i], "--") == 0) {
+        ++i;
+    }
+
+    if (i == argc) {
+        return sane_catFile("-");
+    }
+
+    int status = EXIT_SUCCESS;
+    for (; i < argc; ++i) {
+        int fileStatus = sane_catFile(argv[i]);
+        if (fileStatus > 128) {
+            return fileStatus;
+        } else if (fileStatus != EXIT_SUCCESS) {
+            status = fileStatus;
+        }
+    }
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// tee
+////////////////////////////////////////////////////////////////////////////////
+
+int sane_teeAccepts(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            break;
+        } else if (argv[i][0] == '-' && strcmp(argv[i], "-a") != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int sane_tee(int argc, char **argv)
+{
+    fflush(stdout);
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int i = 1;
+    for (; i < argc && strcmp(argv[i], "-a") == 0; ++i) {
+        flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    }
+    if (i < argc && strcmp(argv[i], "--") == 0) {
+        ++i;
+    }
+
+    // stdout is the first output, followed by the files
+    int *out = (int *)malloc(sizeof(int) * (argc - i + 1));
+    int *failed = (int *)calloc(argc - i + 1, sizeof(int));
+    const char **names =
+        (const char **)malloc(sizeof(char *) * (argc - i + 1));
+    if (out == NULL || failed == NULL || names == NULL) {
+        free(out);
+        free(failed);
+        free(names);
+        fprintf(stderr, "tee: %s\n", strerror(ENOMEM));
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    int numOut = 1;
+    out[0] = STDOUT_FILENO;
+    names[0] = "stdout";
+    for (; i < argc; ++i) {
+        int fd = open(argv[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", argv[i], strerror(errno));
+            status = EXIT_FAILURE;
+            continue;
+        }
+        out[numOut] = fd;
+        names[numOut] = argv[i];
+        ++numOut;
+    }
+
+    if (fastcopy_tee(STDIN_FILENO, out, numOut, failed) != 0) {
+        status = sane_quietStatus(errno);
+        if (status == -1) {
+            fprintf(stderr, "tee: stdin: %s\n", strerror(errno));
+            status = EXIT_FAILURE;
+        }
+    }
+
+    for (int j = 0; j < numOut; ++j) {
+        if (j > 0 && close(out[j]) != 0) {
+            failed[j] = 1;
+        }
+        if (failed[j] && status == EXIT_SUCCESS) {
+            // A closed pipe on stdout ends tee like SIGPIPE would
+            if (j == 0) {
+                status = 128 + SIGPIPE;
+                continue;
+            }
+            fprintf(stderr, "tee: %s: write error\n", names[j]);
+            status = EXIT_FAILURE;
+        }
+    }
+
+    free(out);
+    free(failed);
+    free(names);
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// cp
+////////////////////////////////////////////////////////////////////////////////
+
+int sane_cpAccepts(int argc, char **argv)
+{
+    // Options such as '-r' or '-p' are left to the external command
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-') {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Copy the regular file 'source' to 'target', returns the exit status
+static int sane_copyFile(const char *source, const char *target)
+{
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        fprintf(stderr, "cp: %s: %s\n", source, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct stat sourceStat, targetStat;
+    if (fstat(in, &sourceStat) != 0) {
+        fprintf(stderr, "cp: %s: %s\n", source, strerror(errno));
+        close(in);
+        return EXIT_FAILURE;
+    }
+    if (S_ISDIR(sourceStat.st_mode)) {
+        fprintf(stderr, "cp: %s: %s\n", source, strerror(EISDIR));
+        close(in);
+        return EXIT_FAILURE;
+    }
+    // Opening the target would truncate the source
+    if (stat(target, &targetStat) == 0 &&
+        targetStat.st_dev == sourceStat.st_dev &&
+        targetStat.st_ino == sourceStat.st_ino) {
+        fprintf(stderr, "cp: %s and %s are the same file\n", source, target);
+        close(in);
+        return EXIT_FAILURE;
+    }
+
+    int out = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   sourceStat.st_mode & 0777);
+    if (out < 0) {
+        fprintf(stderr, "cp: %s: %s\n", target, strerror(errno));
+        close(in);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    if (fastcopy_fd(in, out) != 0) {
+        status = sane_quietStatus(errno);
+        if (status == -1) {
+            fprintf(stderr, "cp: %s: %s\n", target, strerror(errno));
+            status = EXIT_FAILURE;
+        }
+    }
+    close(in);
+    if (close(out) != 0 && status == EXIT_SUCCESS) {
+        fprintf(stderr, "cp: %s: %s\n", target, strerror(errno));
+        status = EXIT_FAILURE;
+    }
+
+    return status;
+}
+
+int sane_cp(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: cp source target\n"
+                        "       cp source ... directory\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *target = argv[argc - 1];
+    struct stat targetStat;
+    int toDirectory = stat(target, &targetStat) == 0 &&
+                      S_ISDIR(targetStat.st_mode);
+    if (!toDirectory) {
+        if (argc > 3) {
+            fprintf(stderr, "cp: %s: %s\n", target, strerror(ENOTDIR));
+            return EXIT_FAILURE;
+        }
+        return sane_copyFile(argv[1], target);
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = 1; i < argc - 1; ++i) {
+        // Copy into the directory under the last component of the source
+        const char *slash = strrchr(argv[i], '/');
+        const char *name = (slash != NULL) ? slash + 1 : argv[i];
+
+        char *path = (char *)malloc(strlen(target) + strlen(name) + 2);
+        if (path == NULL) {
+            fprintf(stderr, "cp: %s\n", strerror(ENOMEM));
+            return EXIT_FAILURE;
+        }
+        sprintf(path, "%s/%s", target, name);
+
+        int fileStatus = sane_copyFile(argv[i], path);
+        free(path);
+        if (fileStatus > 128) {
+            return fileStatus;
+        } else if (fileStatus != EXIT_SUCCESS) {
+            status = fileStatus;
+        }
+    }
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// echo, printf
+////////////////////////////////////////////////////////////////////////////////
+
+// Print the character of the escape sequence after a '\' (e.g. 'n' of "\n").
+// Octal escapes are "\0NNN" for echo and %b ('zeroOctal' is 1) and "\NNN" in
+// printf formats. '\c' sets 'stop' to 1. Returns the first character after the
+// escape sequence.
+static const char *sane_printEscape(const char *it, int zeroOctal, int *stop)
+{
+    const char *escapes = "\\\\a\ab\be\033f\fn\nr\rt\tv\v\"\"''";
+    for (const char *e = escapes; *e != '\0'; e += 2) {
+        if (*it == *e) {
+            putchar(*(e + 1));
+            return it + 1;
+        }
+    }
+
+    if (*it == 'c') {
+        *stop = 1;
+        return it + 1;
+    }
+
+    if ((zeroOctal && *it == '0') || (!zeroOctal && *it >= '0' && *it <= '7')) {
+        const char *digits = zeroOctal ? it + 1 : it;
+        int value = 0;
+        int numDigits = 0;
+        for (; numDigits < 3 && digits[numDigits] >= '0' &&
+               digits[numDigits] <= '7';
+             ++numDigits) {
+            value = value * 8 + (digits[numDigits] - '0');
+        }
+        putchar(value);
+        return digits + numDigits;
+    }
+
+    if (*it == 'x' && isxdigit((unsigned char)*(it + 1))) {
+        int value = 0;
+        int numDigits = 1;
+        for (; numDigits <= 2 && isxdigit((unsigned char)it[numDigits]);
+             ++numDigits) {
+            char c = tolower((unsigned char)it[numDigits]);
+            value = value * 16 + (isdigit((unsigned char)c) ? c - '0'
+                                                            : c - 'a' + 10);
+        }
+        putchar(value);
+        return it + numDigits;
+    }
+
+    // Not an escape sequence, print it as it is
+    putchar('\\');
+    if (*it == '\0') {
+        return it;
+    }
+    putchar(*it);
+    return it + 1;
+}
+
+// Print a string, expanding escape sequences. Returns 1 if '\c' was found.
+static int sane_printEscapes(const char *str, int zeroOctal)
+{
+    int stop = 0;
+    while (*str != '\0' && !stop) {
+        if (*str == '\\') {
+            str = sane_printEscape(str + 1, zeroOctal, &stop);
+        } else {
+            putchar(*str++);
+        }
+    }
+
+    return stop;
+}
+
+int sane_echo(int argc, char **argv)
+{
+    int newline = 1;
+    int escapes = 0;
+
+    // Options as accepted by GNU echo ('-n', '-e', '-E' or combined like
+    // '-ne'), anything else is printed
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0' &&
+           strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1);
+         ++i) {
+        for (const char *it = argv[i] + 1; *it != '\0'; ++it) {
+            if (*it == 'n') {
+                newline = 0;
+            } else {
+                escapes = *it == 'e';
+            }
+        }
+    }
+
+    for (int first = i; i < argc; ++i) {
+        if (i > first) {
+            putchar(' ');
+        }
+        if (!escapes) {
+            fputs(argv[i], stdout);
+        } else if (sane_printEscapes(argv[i], 1)) {
+            return EXIT_SUCCESS;
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Convert an argument of a numeric printf conversion. A leading quote gives
+// the value of the next character. Sets 'status' to 1 if it isn't a number.
+static long long sane_printfInteger(const char *arg, int *status)
+{
+    if (arg[0] == '"' || arg[0] == '\'') {
+        return (unsigned char)arg[1];
+    }
+
+    char *end;
+    errno = 0;
+    long long value = (arg[0] == '-') ? strtoll(arg, &end, 0)
+                                      : (long long)strtoull(arg, &end, 0);
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = EXIT_FAILURE;
+    }
+
+    return value;
+}
+
+static long double sane_printfFloat(const char *arg, int *status)
+{
+    if (arg[0] == '"' || arg[0] == '\'') {
+        return (unsigned char)arg[1];
+    }
+
+    char *end;
+    long double value = strtold(arg, &end);
+    if (end == arg || *end != '\0') {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = EXIT_FAILURE;
+    }
+
+    return value;
+}
+
+// Call printf() with the arguments of a conversion, including the values of
+// its '*' width and precision
+#define SANE_PRINTF(spec, numStars, stars, value)                              \
+    ((numStars) == 0   ? printf(spec, value)                                   \
+     : (numStars) == 1 ? printf(spec, stars[0], value)                         \
+                       : printf(spec, stars[0], stars[1], value))
+
+int sane_printf(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: printf format [argument ...]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *format = argv[1];
+    char **args = argv + 2;
+    int numArgs = argc - 2;
+    int status = EXIT_SUCCESS;
+    int stop = 0;
+
+    // The format is reused as long as it consumes arguments
+    do {
+        int numUsed = 0;
+        for (const char *it = format; *it != '\0' && !stop;) {
+            if (*it == '\\') {
+                it = sane_printEscape(it + 1, 0, &stop);
+                continue;
+            } else if (*it != '%') {
+                putchar(*it++);
+                continue;
+            } else if (*(it + 1) == '%') {
+                putchar('%');
+                it += 2;
+                continue;
+            }
+
+            // Copy the conversion specification: flags, width and precision
+            // (either may be '*'), then the conversion character
+            char spec[64];
+            size_t len = 0;
+            int stars[2];
+            int numStars = 0;
+            spec[len++] = *it++;
+            while (*it != '\0' && strchr("-+ #0", *it) != NULL &&
+                   len < 16) {
+                spec[len++] = *it++;
+            }
+            for (int part = 0; part < 2; ++part) {
+                if (part == 1) {
+                    if (*it != '.') {
+                        break;
+                    }
+                    spec[len++] = *it++;
+                }
+                if (*it == '*') {
+                    const char *arg = (numUsed < numArgs) ? args[numUsed++]
+                                                          : "0";
+                    stars[numStars++] = (int)sane_printfInteger(arg, &status);
+                    spec[len++] = *it++;
+                } else {
+                    while (isdigit((unsigned char)*it) && len < 40) {
+                        spec[len++] = *it++;
+                    }
+                }
+            }
+
+            char conversion = *it;
+            if (conversion == '\0' ||
+                strchr("diouxXcsbfFeEgGaA", conversion) == NULL) {
+                fprintf(stderr, "printf: %%%c: invalid conversion\n",
+                        conversion);
+                return EXIT_FAILURE;
+            }
+            ++it;
+
+            // Missing arguments are empty strings or zero
+            const char *arg = NULL;
+            if (numUsed < numArgs) {
+                arg = args[numUsed++];
+            }
+            if (conversion == 'b') {
+                // %b is %s with the argument's escape sequences expanded,
+                // without width or precision
+                stop = sane_printEscapes(arg != NULL ? arg : "", 1);
+                continue;
+            }
+
+            if (strchr("diouxX", conversion) != NULL) {
+                spec[len++] = 'l';
+                spec[len++] = 'l';
+            } else if (strchr("fFeEgGaA", conversion) != NULL) {
+                spec[len++] = 'L';
+            }
+            spec[len++] = conversion;
+            spec[len] = '\0';
+
+            if (conversion == 's') {
+                SANE_PRINTF(spec, numStars, stars, arg != NULL ? arg : "");
+            } else if (conversion == 'c') {
+                if (arg != NULL && arg[0] != '\0') {
+                    SANE_PRINTF(spec, numStars, stars, arg[0]);
+                }
+            } else if (strchr("diouxX", conversion) != NULL) {
+                long long value =
+                    (arg != NULL) ? sane_printfInteger(arg, &status) : 0;
+                SANE_PRINTF(spec, numStars, stars, value);
+            } else {
+                long double value =
+                    (arg != NULL) ? sane_printfFloat(arg, &status) : 0;
+                SANE_PRINTF(spec, numStars, stars, value);
+            }
+        }
+
+        // Only loop again if arguments are left and some were used
+        args += numUsed;
+        numArgs -= numUsed;
+        if (numUsed == 0) {
+            break;
+        }
+    } while (numArgs > 0 && !stop);
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// true, false
+////////////////////////////////////////////////////////////////////////////////
+
+int sane_true(int argc, char **argv)
+{
+    return EXIT_SUCCESS;
+}
+
+int sane_false(int argc, char **argv)
+{
+    return EXIT_FAILURE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// test, [
+///
+/// Expressions of up to four arguments are evaluated as POSIX specifies,
+/// longer ones are parsed with '!', '-a', '-o' and parentheses, '-a' binding
+/// tighter than '-o'. Returns 0 if the expression is true, 1 if it's false and
+/// 2 on error.
+////////////////////////////////////////////////////////////////////////////////
+
+// Arguments of the expression being evaluated
+typedef struct sane_test_t {
+    char **argv;
+    int argc;
+    int pos;   // next argument to parse
+    int error; // 1 once an error was reported
+} sane_test_t;
+
+static int sane_testIsUnary(const char *op)
+{
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' &&
+           strchr("bcdefghknprsStuwxzLOG", op[1]) != NULL;
+}
+
+static int sane_testIsBinary(const char *op)
+{
+    static const char *ops[] = {"=",   "==",  "!=",  "-eq", "-ne",
+                                "-lt", "-le", "-gt", "-ge", "-nt",
+                                "-ot", "-ef", NULL};
+    for (int i = 0; ops[i] != NULL; ++i) {
+        if (strcmp(op, ops[i]) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int sane_testUnary(const char *op, const char *arg)
+{
+    if (op[1] == 'n') {
+        return arg[0] != '\0';
+    } else if (op[1] == 'z') {
+        return arg[0] == '\0';
+    } else if (op[1] == 't') {
+        char *end;
+        long fd = strtol(arg, &end, 10);
+        return *arg != '\0' && *end == '\0' && isatty(fd);
+    } else if (op[1] == 'r') {
+        return access(arg, R_OK) == 0;
+    } else if (op[1] == 'w') {
+        return access(arg, W_OK) == 0;
+    } else if (op[1] == 'x') {
+        return access(arg, X_OK) == 0;
+    }
+
+    // Symbolic links are only followed for operators other than -h and -L
+    struct stat st;
+    int isLink = op[1] == 'h' || op[1] == 'L';
+    if ((isLink ? lstat(arg, &st) : stat(arg, &st)) != 0) {
+        return 0;
+    }
+
+    switch (op[1]) {
+    case 'b':
+        return S_ISBLK(st.st_mode);
+    case 'c':
+        return S_ISCHR(st.st_mode);
+    case 'd':
+        return S_ISDIR(st.st_mode);
+    case 'e':
+        return 1;
+    case 'f':
+        return S_ISREG(st.st_mode);
+    case 'g':
+        return (st.st_mode & S_ISGID) != 0;
+    case 'h':
+    case 'L':
+        return S_ISLNK(st.st_mode);
+    case 'k':
+        return (st.st_mode & S_ISVTX) != 0;
+    case 'p':
+        return S_ISFIFO(st.st_mode);
+    case 's':
+        return st.st_size > 0;
+    case 'S':
+        return S_ISSOCK(st.st_mode);
+    case 'u':
+        return (st.st_mode & S_ISUID) != 0;
+    case 'O':
+        return st.st_uid == geteuid();
+    case 'G':
+        return st.st_gid == getegid();
+    }
+
+    return 0;
+}
+
+// Convert an operand of an integer comparison
+static long long sane_testInteger(sane_test_t *t, const char *arg)
+{
+    char *end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        ++end;
+    }
+    if (end == arg || *end != '\0' || errno == ERANGE) {
+        if (!t->error) {
+            fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        }
+        t->error = 1;
+    }
+
+    return value;
+}
+
+static int sane_testBinary(sane_test_t *t,
+                           const char *left,
+                           const char *op,
+                           const char *right)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) == 0;
+    } else if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) != 0;
+    }
+
+    if (op[1] == 'n' || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f')) {
+        // -nt, -ot and -ef compare files, a missing file is older than any
+        // existing one
+        struct stat leftStat, rightStat;
+        int haveLeft = stat(left, &leftStat) == 0;
+        int haveRight = stat(right, &rightStat) == 0;
+        if (op[1] == 'e') {
+            return haveLeft && haveRight &&
+                   leftStat.st_dev == rightStat.st_dev &&
+                   leftStat.st_ino == rightStat.st_ino;
+        }
+        if (!haveLeft || !haveRight) {
+            return (op[1] == 'n') ? haveLeft : haveRight;
+        }
+        struct timespec l = leftStat.st_mtim;
+        struct timespec r = rightStat.st_mtim;
+        int cmp = (l.tv_sec != r.tv_sec) ? (l.tv_sec > r.tv_sec ? 1 : -1)
+                                         : (l.tv_nsec > r.tv_nsec) -
+                                               (l.tv_nsec < r.tv_nsec);
+        return (op[1] == 'n') ? cmp > 0 : cmp < 0;
+    }
+
+    long long a = sane_testInteger(t, left);
+    long long b = sane_testInteger(t, right);
+    if (strcmp(op, "-eq") == 0) {
+        return a == b;
+    } else if (strcmp(op, "-ne") == 0) {
+        return a != b;
+    } else if (strcmp(op, "-lt") == 0) {
+        return a < b;
+    } else if (strcmp(op, "-le") == 0) {
+        return a <= b;
+    } else if (strcmp(op, "-gt") == 0) {
+        return a > b;
+    }
+    return a >= b;
+}
+
+static void sane_testSyntaxError(sane_test_t *t, const char *near)
+{
+    if (!t->error) {
+        if (near != NULL) {
+            fprintf(stderr, "test: %s: unexpected argument\n", near);
+        } else {
+            fprintf(stderr, "test: argument expected\n");
+        }
+    }
+    t->error = 1;
+}
+
+static int sane_testOr(sane_test_t *t);
+
+// primary: '(' or-expression ')' | unary-op arg | arg binary-op arg | arg
+static int sane_testPrimary(sane_test_t *t)
+{
+    if (t->pos >= t->argc) {
+        sane_testSyntaxError(t, NULL);
+        return 0;
+    }
+
+    char **argv = t->argv + t->pos;
+    int numLeft = t->argc - t->pos;
+    if (numLeft >= 3 && sane_testIsBinary(argv[1])) {
+        t->pos += 3;
+        return sane_testBinary(t, argv[0], argv[1], argv[2]);
+    } else if (numLeft >= 2 && sane_testIsUnary(argv[0])) {
+        t->pos += 2;
+        return sane_testUnary(argv[0], argv[1]);
+    } else if (strcmp(argv[0], "(") == 0) {
+        ++t->pos;
+        int result = sane_testOr(t);
+        if (t->pos >= t->argc || strcmp(t->argv[t->pos], ")") != 0) {
+            sane_testSyntaxError(t, (t->pos < t->argc) ? t->argv[t->pos]
+                                                       : NULL);
+            return 0;
+        }
+        ++t->pos;
+        return result;
+    }
+
+    ++t->pos;
+    return argv[0][0] != '\0';
+}
+
+static int sane_testNot(sane_test_t *t)
+{
+    if (t->pos < t->argc && strcmp(t->argv[t->pos], "!") == 0) {
+        ++t->pos;
+        return !sane_testNot(t);
+    }
+
+    return sane_testPrimary(t);
+}
+
+static int sane_testAnd(sane_test_t *t)
+{
+    int result = sane_testNot(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-a") == 0) {
+        ++t->pos;
+        // Evaluate both sides, errors are reported either way
+        result = sane_testNot(t) && result;
+    }
+
+    return result;
+}
+
+static int sane_testOr(sane_test_t *t)
+{
+    int result = sane_testAnd(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-o") == 0) {
+        ++t->pos;
+        result = sane_testAnd(t) || result;
+    }
+
+    return result;
+}
+
+// Evaluate 'argc' arguments starting at 'argv', following the POSIX rules for
+// up to four arguments
+static int sane_testEval(sane_test_t *t, char **argv, int argc)
+{
+    if (argc == 0) {
+        return 0;
+    } else if (argc == 1) {
+        return argv[0][0] != '\0';
+    } else if (argc == 2) {
+        if (strcmp(argv[0], "!") == 0) {
+            return !sane_testEval(t, argv + 1, 1);
+        } else if (sane_testIsUnary(argv[0])) {
+            return sane_testUnary(argv[0], argv[1]);
+        }
+    } else if (argc == 3) {
+        if (sane_testIsBinary(argv[1])) {
+            return sane_testBinary(t, argv[0], argv[1], argv[2]);
+        } else if (strcmp(argv[1], "-a") == 0) {
+            return argv[0][0] != '\0' && argv[2][0] != '\0';
+        } else if (strcmp(argv[1], "-o") == 0) {
+            return argv[0][0] != '\0' || argv[2][0] != '\0';
+        } else if (strcmp(argv[0], "!") == 0) {
+            return !sane_testEval(t, argv + 1, 2);
+        } else if (strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0) {
+            return sane_testEval(t, argv + 1, 1);
+        }
+    } else if (argc == 4) {
+        if (strcmp(argv[0], "!") == 0) {
+            return !sane_testEval(t, argv + 1, 3);
+        } else if (strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0) {
+            return sane_testEval(t, argv + 1, 2);
+        }
+    }
+
+    // Parse everything else
+    t->argv = argv;
+    t->argc = argc;
+    t->pos = 0;
+    int result = sane_testOr(t);
+    if (t->pos < t->argc) {
+        sane_testSyntaxError(t, t->argv[t->pos]);
+    }
+
+    return result;
+}
+
+int sane_test(int argc, char **argv)
+{
+    // '[' takes the same expression followed by ']'
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        --argc;
+    }
+
+    sane_test_t t = {NULL, 0, 0, 0};
+    int result = sane_testEval(&t, argv + 1, argc - 1);
+    if (t.error) {
+        return 2;
+    }
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,50 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Builtin versions of common utilities, run inside the shell to save starting
+/// a process. Utilities that only handle some of their options have an
+/// 'Accepts' function telling whether the builtin handles the given arguments,
+/// the external command is run otherwise (e.g. 'cat -n').
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+/// cat [-u] [file | -]...
+///
+/// Files are copied to stdout with fastcopy_fd(), so the data doesn't pass
+/// through the shell when the kernel can move it directly.
+////////////////////////////////////////////////////////////////////////////////
+int sane_cat(int argc, char **argv);
+int sane_catAccepts(int argc, char **argv);
+
+////////////////////////////////////////////////////////////////////////////////
+/// tee [-a] [file]...
+////////////////////////////////////////////////////////////////////////////////
+int sane_tee(int argc, char **argv);
+int sane_teeAccepts(int argc, char **argv);
+
+////////////////////////////////////////////////////////////////////////////////
+/// cp source target
+/// cp source... directory
+////////////////////////////////////////////////////////////////////////////////
+int sane_cp(int argc, char **argv);
+int sane_cpAccepts(int argc, char **argv);
+
+////////////////////////////////////////////////////////////////////////////////
+/// echo [-neE] [string]...
+///
+/// Options and escape sequences ('-e') as in GNU echo, which is what scripts
+/// got before echo was a builtin.
+////////////////////////////////////////////////////////////////////////////////
+int sane_echo(int argc, char **argv);
+
+////////////////////////////////////////////////////////////////////////////////
+/// printf format [argument]...
+////////////////////////////////////////////////////////////////////////////////
+int sane_printf(int argc, char **argv);
+
+int sane_true(int argc, char **argv);
+int sane_false(int argc, char **argv);
+
+////////////////////////////////////////////////////////////////////////////////
+/// test expression
+/// [ expression ]
+////////////////////////////////////////////////////////////////////////////////
+int sane_test(int argc, char **argv);
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strmap.h"
+#include "variable.h"
+
+typedef struct variable_t {
+    char *entry;    // "name=value", NULL if the variable isn't set
+    size_t nameLen; // offset of '=' in entry
+    int exported;   // 1 if passed to commands
+    size_t slot;    // index of entry in variable_env, if exported and set
+} variable_t;
+
+// Name -> variable_t *
+static strmap_t variable_map;
+// 1 once the environment was read into the map
+static int variable_loaded = 0;
+
+// Environment of commands, valid unless an exported variable was added or
+// removed since it was built
+static char **variable_env = NULL;
+static size_t variable_envCapacity = 0;
+static int variable_envValid = 0;
+
+static unsigned long variable_numChanges = 0;
+
+static void variable_free(void *value)
+{
+    variable_t *var = (variable_t *)value;
+
+    free(var->entry);
+    free(var);
+}
+
+int variable_isName(const char *name, size_t length)
+{
+    if (length == 0 || (name[0] >= '0' && name[0] <= '9')) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_')) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Read the environment into the map, returns 0 if successful, -1 otherwise
+static int variable_load()
+{
+    if (variable_loaded) {
+        return 0;
+    }
+    variable_loaded = 1;
+
+    extern char **environ;
+    for (char **it = environ; *it != NULL; ++it) {
+        const char *equal = strchr(*it, '=');
+        if (equal == NULL || !variable_isName(*it, equal - *it)) {
+            continue;
+        }
+
+        char *name = strndup(*it, equal - *it);
+        if (name == NULL) {
+            return -1;
+        }
+        // The first definition wins, like getenv()
+        int result = 0;
+        if (strmap_get(&variable_map, name) == NULL) {
+            result = variable_set(name, equal + 1, VARIABLE_EXPORT);
+        }
+        free(name);
+        if (result != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+const char *variable_get(const char *name)
+{
+    if (variable_load() != 0) {
+        return NULL;
+    }
+
+    variable_t *var = (variable_t *)strmap_get(&variable_map, name);
+    if (var == NULL || var->entry == NULL) {
+        return NULL;
+    }
+
+    return var->entry + var->nameLen + 1;
+}
+
+int variable_set(const char *name, const char *value, int exported)
+{
+    if (variable_load() != 0) {
+        return -1;
+    }
+
+    size_t nameLen = strlen(name);
+    char *entry = NULL;
+    if (value != NULL) {
+        size_t valueLen = strlen(value);
+        // + 2 for '=' and NULL-terminator
+        entry = (char *)malloc(nameLen + valueLen + 2);
+        if (entry == NULL) {
+            return -1;
+        }
+        memcpy(entry, name, nameLen);
+        entry[nameLen] = '=';
+        memcpy(entry + nameLen + 1, value, valueLen + 1);
+    }
+
+    variable_t *var = (variable_t *)strmap_get(&variable_map, name);
+    if (var == NULL) {
+        var = (variable_t *)calloc(1, sizeof(variable_t));
+        if (var == NULL ||
+            strmap_put(&variable_map, name, var, NULL) != 0) {
+            free(var);
+            free(entry);
+            return -1;
+        }
+        var->nameLen = nameLen;
+    }
+
+    int wasInEnv = var->exported && var->entry != NULL;
+    if (value != NULL) {
+        free(var->entry);
+        var->entry = entry;
+    }
+    if (exported != VARIABLE_KEEP) {
+        var->exported = exported;
+    }
+    int inEnv = var->exported && var->entry != NULL;
+
+    // A new value of an exported variable takes the slot of the old one
+    if (wasInEnv && inEnv) {
+        if (variable_envValid) {
+            variable_env[var->slot] = var->entry;
+        }
+    } else if (wasInEnv != inEnv) {
+        variable_envValid = 0;
+    }
+    ++variable_numChanges;
+
+    return 0;
+}
+
+int variable_unset(const char *name)
+{
+    if (variable_load() != 0) {
+        return -1;
+    }
+
+    variable_t *var = (variable_t *)strmap_remove(&variable_map, name);
+    if (var != NULL) {
+        if (var->exported && var->entry != NULL) {
+            variable_envValid = 0;
+        }
+        variable_free(var);
+        ++variable_numChanges;
+    }
+
+    return 0;
+}
+
+char **variable_envp()
+{
+    if (variable_load() != 0) {
+        return NULL;
+    }
+    if (variable_envValid) {
+        return variable_env;
+    }
+
+    if (variable_map.count + 1 > variable_envCapacity) {
+        size_t capacity = (variable_map.count + 1) * 2;
+        char **env = (char **)realloc(variable_env, sizeof(char *) * capacity);
+        if (env == NULL) {
+            return NULL;
+        }
+        variable_env = env;
+        variable_envCapacity = capacity;
+    }
+
+    size_t numExported = 0;
+    size_t it = 0;
+    const char *name;
+    void *value;
+    while (strmap_next(&variable_map, &it, &name, &value)) {
+        variable_t *var = (variable_t *)value;
+        if (var->exported && var->entry != NULL) {
+            var->slot = numExported;
+            variable_env[numExported++] = var->entry;
+        }
+    }
+    variable_env[numExported] = NULL;
+    variable_envValid = 1;
+
+    return variable_env;
+}
+
+unsigned long variable_generation()
+{
+    return variable_numChanges;
+}
+
+static int variable_compare(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+void variable_print(FILE *stream)
+{
+    if (variable_load() != 0 || variable_map.count == 0) {
+        return;
+    }
+
+    // Exported variables that aren't set are printed by name
+    const char **lines =
+        (const char **)malloc(sizeof(const char *) * variable_map.count);
+    if (lines == NULL) {
+        fprintf(stderr, "sane: out of memory\n");
+        return;
+    }
+    size_t numLines = 0;
+    size_t it = 0;
+    const char *name;
+    void *value;
+    while (strmap_next(&variable_map, &it, &name, &value)) {
+        variable_t *var = (variable_t *)value;
+        if (var->exported) {
+            lines[numLines++] = var->entry != NULL ? var->entry : name;
+        }
+    }
+
+    qsort(lines, numLines, sizeof(const char *), &variable_compare);
+    for (size_t i = 0; i < numLines; ++i) {
+        fprintf(stream, "export %s\n", lines[i]);
+    }
+    free(lines);
+}
+
+void variable_clear()
+{
+    strmap_destroy(&variable_map, &variable_free);
+    variable_loaded = 0;
+
+    free(variable_env);
+    variable_env = NULL;
+    variable_envCapacity = 0;
+    variable_envValid = 0;
+    ++variable_numChanges;
+}
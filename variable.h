@@ -0,0 +1,80 @@
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Shell variables (see the 'export' and 'unset' builtins).
+///
+/// Variables live in a hash map (see strmap.h), filled from the environment the
+/// first time a variable is used. Exported variables make up the environment of
+/// the commands the shell starts: variable_envp() returns an array that is kept
+/// between spawns and only rebuilt after an exported variable was added or
+/// removed. Changing the value of an exported variable replaces its entry in
+/// place. The shell's own environment (environ) is left as it was.
+///
+/// '$name' and '${name}' are expanded when a line is parsed (see command.h), a
+/// variable set by a line is seen from the next line on.
+////////////////////////////////////////////////////////////////////////////////
+
+// Values of 'exported' for variable_set()
+#define VARIABLE_KEEP -1 // keep the variable's attribute, new ones aren't
+                         // exported
+#define VARIABLE_LOCAL 0 // not passed to commands
+#define VARIABLE_EXPORT 1
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   name   const char *, name of the variable.
+/// @return         const char *, value of the variable, NULL if it isn't set.
+///                 Valid until the variable is set or unset.
+////////////////////////////////////////////////////////////////////////////////
+const char *variable_get(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Set a variable and/or change whether it is exported.
+///
+/// @param   name       const char *, name of the variable, see
+///                     variable_isName().
+/// @param   value      const char *, new value, NULL to keep the value (a
+///                     variable that isn't set stays unset, but is exported
+///                     once it is).
+/// @param   exported   int, VARIABLE_KEEP, VARIABLE_LOCAL or VARIABLE_EXPORT.
+/// @return             int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int variable_set(const char *name, const char *value, int exported);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   name   const char *, name of the variable to remove.
+/// @return         int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int variable_unset(const char *name);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @param   name     const char *, text to check.
+/// @param   length   size_t, number of characters to check.
+/// @return           int, 1 if the text is a valid variable name (a letter or
+///                   '_' followed by letters, digits and '_'), 0 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int variable_isName(const char *name, size_t length);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   char **, NULL-terminated "name=value" strings of the exported
+///           variables, to pass to posix_spawn() or execve(). Valid until a
+///           variable is set or unset. NULL if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+char **variable_envp();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @return   unsigned long, number of times variables were set or unset, for
+///           caches of values that depend on variables (see parsecache.h).
+////////////////////////////////////////////////////////////////////////////////
+unsigned long variable_generation();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Print the exported variables as 'export' commands.
+///
+/// @param   stream   FILE *, stream to print to.
+////////////////////////////////////////////////////////////////////////////////
+void variable_print(FILE *stream);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Remove all variables, the next use reads the environment again.
+////////////////////////////////////////////////////////////////////////////////
+void variable_clear();
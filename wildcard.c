@@ -0,0 +1,694 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "strmap.h"
+#include "trace.h"
+#include "variable.h"
+#include "wildcard.h"
+
+// Maximum number of directory listings kept, all are dropped once exceeded
+// (between lines)
+#define WILDCARD_MAX_DIRS 128
+// Directories modified less than this many seconds before they were listed
+// could be modified again without their mtime changing, their listings are
+// read again for every line
+#define WILDCARD_RACY_SECONDS 2
+
+////////////////////////////////////////////////////////////////////////////////
+/// Directory listings.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct wildcard_entry_t {
+    char *name;
+    unsigned char type; // d_type of the entry
+} wildcard_entry_t;
+
+typedef struct wildcard_dir_t {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int racy;           // 1 if the listing can't be trusted after this line
+    unsigned long line; // line the listing was last checked for
+    wildcard_entry_t *entries; // entries, including "." and ".."
+    size_t count;              // number of entries
+    arena_t arena;             // entries are allocated from the arena
+} wildcard_dir_t;
+
+// "dev:ino" -> wildcard_dir_t *
+static strmap_t wildcard_dirs;
+// Path -> wildcard_dir_t *, for directories already checked for this line
+static strmap_t wildcard_lineDirs;
+// Number of the current line
+static unsigned long wildcard_line = 1;
+
+static void wildcard_freeDir(void *value)
+{
+    wildcard_dir_t *dir = (wildcard_dir_t *)value;
+
+    arena_destroy(&dir->arena);
+    free(dir);
+}
+
+void wildcard_newLine()
+{
+    ++wildcard_line;
+    if (wildcard_lineDirs.count > 0) {
+        strmap_destroy(&wildcard_lineDirs, NULL);
+    }
+
+    // Listings are in use while a line is expanded, drop them in between
+    if (wildcard_dirs.count > WILDCARD_MAX_DIRS) {
+        strmap_destroy(&wildcard_dirs, &wildcard_freeDir);
+    }
+}
+
+// (Re)read the entries of a directory. Returns 0 if successful, -1 otherwise.
+static int wildcard_readDir(wildcard_dir_t *dir, const char *path)
+{
+    arena_reset(&dir->arena);
+    dir->entries = NULL;
+    dir->count = 0;
+
+    DIR *stream = opendir(path);
+    if (stream == NULL) {
+        return -1;
+    }
+
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(stream)) != NULL) {
+        if (dir->count == capacity) {
+            size_t newCapacity = (capacity > 0) ? capacity * 2 : 32;
+            wildcard_entry_t *entries = (wildcard_entry_t *)arena_realloc(
+                &dir->arena, dir->entries, sizeof(wildcard_entry_t) * capacity,
+                sizeof(wildcard_entry_t) * newCapacity);
+            if (entries == NULL) {
+                closedir(stream);
+                return -1;
+            }
+            dir->entries = entries;
+            capacity = newCapacity;
+        }
+
+        wildcard_entry_t *it = &dir->entries[dir->count];
+        it->name = arena_strdup(&dir->arena, entry->d_name);
+        if (it->name == NULL) {
+            closedir(stream);
+            return -1;
+        }
+        it->type = entry->d_type;
+        ++dir->count;
+    }
+    closedir(stream);
+
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Get the listing of a directory, reading it only if it changed since it was
+/// last read.
+///
+/// @param   path   const char *, path of the directory.
+/// @return         wildcard_dir_t *, listing, NULL if the directory can't be
+///                 read.
+////////////////////////////////////////////////////////////////////////////////
+static wildcard_dir_t *wildcard_getDir(const char *path)
+{
+    wildcard_dir_t *dir =
+        (wildcard_dir_t *)strmap_get(&wildcard_lineDirs, path);
+    if (dir != NULL) {
+        return dir;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    char key[64];
+    snprintf(key, sizeof(key), "%lx:%lx", (unsigned long)st.st_dev,
+             (unsigned long)st.st_ino);
+
+    dir = (wildcard_dir_t *)strmap_get(&wildcard_dirs, key);
+    if (dir == NULL) {
+        dir = (wildcard_dir_t *)malloc(sizeof(wildcard_dir_t));
+        if (dir == NULL) {
+            return NULL;
+        }
+        memset(dir, 0, sizeof(wildcard_dir_t));
+        arena_init(&dir->arena);
+        dir->dev = st.st_dev;
+        dir->ino = st.st_ino;
+        dir->racy = 1;
+
+        if (strmap_put(&wildcard_dirs, key, dir, NULL) != 0) {
+            wildcard_freeDir(dir);
+            return NULL;
+        }
+    }
+
+    if (dir->line != wildcard_line &&
+        (dir->racy || dir->mtime.tv_sec != st.st_mtim.tv_sec ||
+         dir->mtime.tv_nsec != st.st_mtim.tv_nsec)) {
+        // A modification in the same tick as the one before the listing is
+        // read doesn't change mtime, such a listing is read again next line
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        dir->racy = now.tv_sec - st.st_mtim.tv_sec < WILDCARD_RACY_SECONDS;
+        dir->mtime = st.st_mtim;
+
+        if (wildcard_readDir(dir, path) != 0) {
+            dir->racy = 1;
+            return NULL;
+        }
+    }
+    dir->line = wildcard_line;
+
+    if (strmap_put(&wildcard_lineDirs, path, dir, NULL) != 0) {
+        return NULL;
+    }
+
+    return dir;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Compiled patterns.
+///
+/// A path name component is compiled into a sequence of operations, character
+/// sets are turned into a bitmap so matching is a single lookup per character.
+////////////////////////////////////////////////////////////////////////////////
+enum { OP_CHAR, OP_ANY, OP_STAR, OP_SET };
+
+typedef struct wildcard_op_t {
+    int type;
+    unsigned char c;      // character to match (OP_CHAR)
+    unsigned long set[4]; // bitmap of characters to match (OP_SET)
+} wildcard_op_t;
+
+typedef struct wildcard_pattern_t {
+    wildcard_op_t *ops;
+    size_t numOps;
+    size_t capacity;
+    int magic; // 1 if any operation isn't a plain character
+} wildcard_pattern_t;
+
+#define SET_ADD(set, c) ((set)[(unsigned char)(c) / 64] |= 1UL << ((c) % 64))
+#define SET_HAS(set, c) (((set)[(unsigned char)(c) / 64] >> ((c) % 64)) & 1)
+
+static wildcard_op_t *wildcard_addOp(wildcard_pattern_t *pattern, int type)
+{
+    if (pattern->numOps == pattern->capacity) {
+        size_t newCapacity =
+            (pattern->capacity > 0) ? pattern->capacity * 2 : 16;
+        wildcard_op_t *ops = (wildcard_op_t *)realloc(
+            pattern->ops, sizeof(wildcard_op_t) * newCapacity);
+        if (ops == NULL) {
+            return NULL;
+        }
+        pattern->ops = ops;
+        pattern->capacity = newCapacity;
+    }
+
+    wildcard_op_t *op = &pattern->ops[pattern->numOps++];
+    op->type = type;
+    if (type != OP_CHAR) {
+        pattern->magic = 1;
+    }
+
+    return op;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parse a bracket expression starting at 'it' (just after '[').
+///
+/// @param   set   unsigned long [4], bitmap of matched characters out.
+/// @param   end   const char *, end of the path name component.
+/// @return        const char *, character following the closing ']', NULL if
+///                the expression isn't closed ('[' is then a plain character).
+////////////////////////////////////////////////////////////////////////////////
+static const char *
+wildcard_parseSet(const char *it, const char *end, unsigned long set[4])
+{
+    static const struct {
+        const char *name;
+        int (*is)(int);
+    } classes[] = {{"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+                   {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+                   {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+                   {"space", isspace}, {"upper", isupper},
+                   {"xdigit", isxdigit}};
+
+    memset(set, 0, sizeof(unsigned long) * 4);
+
+    int negate = 0;
+    if (it < end && (*it == '!' || *it == '^')) {
+        negate = 1;
+        ++it;
+    }
+
+    // A ']' first is a plain character
+    int first = 1;
+    while (it < end && (*it != ']' || first)) {
+        first = 0;
+
+        if (*it == '[' && it + 1 < end && *(it + 1) == ':') {
+            const char *name = it + 2;
+            const char *close = name;
+            while (close + 1 < end && !(*close == ':' && *(close + 1) == ']')) {
+                ++close;
+            }
+            if (close + 1 < end) {
+                size_t len = close - name;
+                int found = 0;
+                for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]);
+                     ++i) {
+                    if (strlen(classes[i].name) == len &&
+                        strncmp(classes[i].name, name, len) == 0) {
+                        for (int c = 1; c < 256; ++c) {
+                            if (classes[i].is(c)) {
+                                SET_ADD(set, c);
+                            }
+                        }
+                        found = 1;
+                    }
+                }
+                if (!found) {
+                    return NULL;
+                }
+                it = close + 2;
+                continue;
+            }
+        }
+
+        unsigned char low = *it++;
+        if (low == '\\' && it < end) {
+            low = *it++;
+        }
+        unsigned char high = low;
+        if (it + 1 < end && *it == '-' && *(it + 1) != ']') {
+            ++it;
+            high = *it++;
+            if (high == '\\' && it < end) {
+                high = *it++;
+            }
+        }
+        for (int c = low; c <= high; ++c) {
+            SET_ADD(set, c);
+        }
+    }
+
+    if (it >= end) {
+        return NULL;
+    }
+
+    if (negate) {
+        for (int i = 0; i < 4; ++i) {
+            set[i] = ~set[i];
+        }
+    }
+    // Never match the NULL-terminator or a path separator
+    set[0] &= ~(1UL | (1UL << '/'));
+
+    return it + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Compile the path name component [start, end) of a pattern.
+///
+/// @return   int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static int wildcard_compile(wildcard_pattern_t *pattern,
+                            const char *start,
+                            const char *end)
+{
+    pattern->numOps = 0;
+    pattern->magic = 0;
+
+    for (const char *it = start; it < end;) {
+        wildcard_op_t *op;
+        unsigned long set[4];
+        const char *next;
+
+        if (*it == '*') {
+            // Successive stars match the same as one
+            if (pattern->numOps == 0 ||
+                pattern->ops[pattern->numOps - 1].type != OP_STAR) {
+                if (wildcard_addOp(pattern, OP_STAR) == NULL) {
+                    return -1;
+                }
+            }
+            ++it;
+        } else if (*it == '?') {
+            if (wildcard_addOp(pattern, OP_ANY) == NULL) {
+                return -1;
+            }
+            ++it;
+        } else if (*it == '[' &&
+                   (next = wildcard_parseSet(it + 1, end, set)) != NULL) {
+            if ((op = wildcard_addOp(pattern, OP_SET)) == NULL) {
+                return -1;
+            }
+            memcpy(op->set, set, sizeof(set));
+            it = next;
+        } else {
+            if (*it == '\\' && it + 1 < end) {
+                ++it;
+            }
+            if ((op = wildcard_addOp(pattern, OP_CHAR)) == NULL) {
+                return -1;
+            }
+            op->c = *it++;
+        }
+    }
+
+    return 0;
+}
+
+// Returns 1 if the name matches the compiled pattern, 0 otherwise
+static int wildcard_match(const wildcard_pattern_t *pattern, const char *name)
+{
+    // A leading '.' must be matched explicitly
+    if (name[0] == '.' &&
+        (pattern->numOps == 0 || pattern->ops[0].type != OP_CHAR)) {
+        return 0;
+    }
+
+    const wildcard_op_t *op = pattern->ops;
+    const wildcard_op_t *opEnd = pattern->ops + pattern->numOps;
+    // Position after the last star, to backtrack to on a mismatch
+    const wildcard_op_t *starOp = NULL;
+    const char *starName = NULL;
+
+    while (1) {
+        if (op < opEnd && op->type == OP_STAR) {
+            starOp = ++op;
+            starName = name;
+            continue;
+        }
+
+        if (op < opEnd && *name != '\0' &&
+            ((op->type == OP_CHAR && op->c == (unsigned char)*name) ||
+             op->type == OP_ANY ||
+             (op->type == OP_SET && SET_HAS(op->set, (unsigned char)*name)))) {
+            ++op;
+            ++name;
+            continue;
+        }
+
+        if (op == opEnd && *name == '\0') {
+            return 1;
+        }
+
+        // Let the last star match one more character
+        if (starOp != NULL && *starName != '\0') {
+            op = starOp;
+            name = ++starName;
+            continue;
+        }
+
+        return 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Expansion.
+////////////////////////////////////////////////////////////////////////////////
+
+// Memory of the paths returned by the last call to wildcard_expand()
+static arena_t wildcard_resultArena;
+static char **wildcard_results = NULL;
+static size_t wildcard_numResults = 0;
+static size_t wildcard_resultsCapacity = 0;
+
+// Path being built
+static char *wildcard_path = NULL;
+static size_t wildcard_pathCapacity = 0;
+
+static int wildcard_reservePath(size_t len)
+{
+    if (len + 1 > wildcard_pathCapacity) {
+        size_t newCapacity = (len + 1) * 2;
+        char *path = (char *)realloc(wildcard_path, newCapacity);
+        if (path == NULL) {
+            return -1;
+        }
+        wildcard_path = path;
+        wildcard_pathCapacity = newCapacity;
+    }
+
+    return 0;
+}
+
+static int wildcard_addResult(const char *path)
+{
+    if (wildcard_numResults == wildcard_resultsCapacity) {
+        size_t newCapacity =
+            (wildcard_resultsCapacity > 0) ? wildcard_resultsCapacity * 2 : 16;
+        char **results = (char **)realloc(wildcard_results,
+                                          sizeof(char *) * newCapacity);
+        if (results == NULL) {
+            return -1;
+        }
+        wildcard_results = results;
+        wildcard_resultsCapacity = newCapacity;
+    }
+
+    char *copy = arena_strdup(&wildcard_resultArena, path);
+    if (copy == NULL) {
+        return -1;
+    }
+    wildcard_results[wildcard_numResults++] = copy;
+
+    return 0;
+}
+
+// Returns 1 if entry i of the listing of the directory at wildcard_path
+// (wildcard_path[0, len) is the directory, followed by the entry's name) is a
+// directory
+static int wildcard_isDir(const wildcard_dir_t *dir, size_t i)
+{
+    if (dir->entries[i].type == DT_DIR) {
+        return 1;
+    } else if (dir->entries[i].type != DT_LNK &&
+               dir->entries[i].type != DT_UNKNOWN) {
+        return 0;
+    }
+
+    struct stat st;
+    return stat(wildcard_path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Match the path name components of 'pattern' starting at 'component'
+/// against the file system, wildcard_path[0, len) holds the directory matched
+/// by the components before.
+///
+/// @return   int, 0 if successful, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+static int wildcard_expandFrom(const char *component,
+                               size_t len,
+                               wildcard_pattern_t *compiled)
+{
+    // Copy separators, "a//b" is the same as "a/b" but is kept as written
+    while (*component == '/') {
+        if (wildcard_reservePath(len + 1) != 0) {
+            return -1;
+        }
+        wildcard_path[len++] = '/';
+        ++component;
+    }
+    wildcard_path[len] = '\0';
+
+    if (*component == '\0') {
+        // Pattern ended with '/', the path matched only if it's a directory
+        struct stat st;
+        if (stat(wildcard_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            return wildcard_addResult(wildcard_path);
+        }
+        return 0;
+    }
+
+    const char *end = strchr(component, '/');
+    if (end == NULL) {
+        end = component + strlen(component);
+    }
+
+    if (wildcard_compile(compiled, component, end) != 0) {
+        return -1;
+    }
+
+    if (!compiled->magic) {
+        // Plain name, it exists or it doesn't
+        if (wildcard_reservePath(len + compiled->numOps) != 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < compiled->numOps; ++i) {
+            wildcard_path[len + i] = compiled->ops[i].c;
+        }
+        len += compiled->numOps;
+        wildcard_path[len] = '\0';
+
+        if (*end == '\0') {
+            struct stat st;
+            if (lstat(wildcard_path, &st) == 0) {
+                return wildcard_addResult(wildcard_path);
+            }
+            return 0;
+        }
+
+        return wildcard_expandFrom(end, len, compiled);
+    }
+
+    wildcard_dir_t *dir = wildcard_getDir((len > 0) ? wildcard_path : ".");
+    if (dir == NULL) {
+        return 0;
+    }
+
+    // Components after this one are compiled into their own pattern
+    wildcard_pattern_t rest = {NULL, 0, 0, 0};
+    int result = 0;
+
+    for (size_t i = 0; i < dir->count && result == 0; ++i) {
+        if (!wildcard_match(compiled, dir->entries[i].name)) {
+            continue;
+        }
+
+        size_t nameLen = strlen(dir->entries[i].name);
+        if (wildcard_reservePath(len + nameLen) != 0) {
+            result = -1;
+            break;
+        }
+        memcpy(wildcard_path + len, dir->entries[i].name, nameLen + 1);
+
+        if (*end == '\0') {
+            result = wildcard_addResult(wildcard_path);
+        } else if (wildcard_isDir(dir, i)) {
+            result = wildcard_expandFrom(end, len + nameLen, &rest);
+        }
+    }
+
+    free(rest.ops);
+
+    return result;
+}
+
+int wildcard_hasMagic(const char *pattern)
+{
+    for (const char *it = pattern; *it != '\0'; ++it) {
+        if (*it == '*' || *it == '?') {
+            return 1;
+        } else if (*it == '[') {
+            const char *end = strchr(it, '/');
+            unsigned long set[4];
+            if (wildcard_parseSet(it + 1, end ? end : it + strlen(it), set)) {
+                return 1;
+            }
+        } else if (*it == '\\' && *(it + 1) != '\0') {
+            ++it;
+        }
+    }
+
+    return 0;
+}
+
+static int wildcard_compareResults(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int wildcard_expand(const char *pattern, int flags, char ***paths)
+{
+    arena_reset(&wildcard_resultArena);
+    wildcard_numResults = 0;
+    *paths = wildcard_results;
+
+    // Replace '~' or '~user' with the home directory
+    char *expanded = NULL;
+    if ((flags & WILDCARD_TILDE) && pattern[0] == '~') {
+        const char *rest = strchr(pattern, '/');
+        if (rest == NULL) {
+            rest = pattern + strlen(pattern);
+        }
+
+        const char *home = NULL;
+        if (rest == pattern + 1) {
+            home = variable_get("HOME");
+            if (home == NULL) {
+                struct passwd *pw = getpwuid(getuid());
+                home = (pw != NULL) ? pw->pw_dir : NULL;
+            }
+        } else {
+            char *user = strndup(pattern + 1, rest - pattern - 1);
+            if (user == NULL) {
+                return -1;
+            }
+            struct passwd *pw = getpwnam(user);
+            free(user);
+            home = (pw != NULL) ? pw->pw_dir : NULL;
+        }
+
+        if (home != NULL) {
+            size_t homeLen = strlen(home);
+            expanded = (char *)arena_alloc(&wildcard_resultArena,
+                                           homeLen + strlen(rest) + 1);
+            if (expanded == NULL) {
+                return -1;
+            }
+            memcpy(expanded, home, homeLen);
+            strcpy(expanded + homeLen, rest);
+            pattern = expanded;
+        }
+    }
+
+    if (!wildcard_hasMagic(pattern)) {
+        if (expanded == NULL) {
+            return 0;
+        }
+        if (wildcard_addResult(expanded) != 0) {
+            return -1;
+        }
+        *paths = wildcard_results;
+        return 1;
+    }
+
+    TRACE_START(glob);
+    if (wildcard_reservePath(0) != 0) {
+        return -1;
+    }
+    wildcard_pattern_t compiled = {NULL, 0, 0, 0};
+    int result = wildcard_expandFrom(pattern, 0, &compiled);
+    free(compiled.ops);
+    if (result != 0) {
+        return -1;
+    }
+
+    qsort(wildcard_results, wildcard_numResults, sizeof(char *),
+          &wildcard_compareResults);
+    TRACE_END(glob, "glob", pattern);
+
+    *paths = wildcard_results;
+    return (int)wildcard_numResults;
+}
+
+void wildcard_clear()
+{
+    strmap_destroy(&wildcard_lineDirs, NULL);
+    strmap_destroy(&wildcard_dirs, &wildcard_freeDir);
+
+    arena_destroy(&wildcard_resultArena);
+    free(wildcard_results);
+    wildcard_results = NULL;
+    wildcard_numResults = 0;
+    wildcard_resultsCapacity = 0;
+
+    free(wildcard_path);
+    wildcard_path = NULL;
+    wildcard_pathCapacity = 0;
+}
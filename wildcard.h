@@ -0,0 +1,50 @@
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Wildcard ('*', '?', '[...]') expansion of path names, a replacement for
+/// glob() that keeps the listings of the directories it reads.
+///
+/// A listing is reused as long as the directory's device, inode and mtime are
+/// unchanged. Within a single line (see wildcard_newLine()) a directory is
+/// looked up only once, so 'ls *.c *.h' reads the working directory once and a
+/// loop running the same line doesn't read it at all.
+///
+/// Matching follows glob() without flags: a leading '.' must be matched
+/// explicitly, '\' escapes the next character and matches are sorted.
+////////////////////////////////////////////////////////////////////////////////
+
+// Expand a leading '~' or '~user' to the home directory (like GLOB_TILDE)
+#define WILDCARD_TILDE 1
+
+////////////////////////////////////////////////////////////////////////////////
+/// Returns 1 if the pattern contains wildcards, i.e. expanding it could
+/// produce something other than the pattern itself.
+///
+/// @param   pattern   const char *, NULL-terminated pattern.
+/// @return            int, 1 if the pattern contains wildcards, 0 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int wildcard_hasMagic(const char *pattern);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Find the paths matching a pattern. Patterns without wildcards are not
+/// looked up at all (unless a '~' was expanded, see WILDCARD_TILDE).
+///
+/// @param   pattern   const char *, NULL-terminated pattern.
+/// @param   flags     int, 0 or WILDCARD_TILDE.
+/// @param   paths     char ***, set to the sorted array of matching paths,
+///                    valid until the next call to wildcard_expand().
+/// @return            int, number of matching paths, 0 if nothing matched or
+///                    the pattern has no wildcards, -1 if out of memory.
+////////////////////////////////////////////////////////////////////////////////
+int wildcard_expand(const char *pattern, int flags, char ***paths);
+
+////////////////////////////////////////////////////////////////////////////////
+/// Start expanding the patterns of a new line. Directories are checked for
+/// changes again once for every line.
+////////////////////////////////////////////////////////////////////////////////
+void wildcard_newLine();
+
+////////////////////////////////////////////////////////////////////////////////
+/// Release all cached directory listings and expansion results.
+////////////////////////////////////////////////////////////////////////////////
+void wildcard_clear();